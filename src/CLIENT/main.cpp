@@ -1,26 +1,80 @@
 
+#include <array>
 #include <iostream>
+#include <fstream>
+#include <optional>
+#include <chrono>
+#include <future>
+#include <memory_resource>
 
 #include "MAPPARSER/mapparser.h"
+#include "MAP/mapsnapshot.h"
+#include "MAP/memoryreport.h"
+#include "MAP/versionedmap.h"
 #include "MAPRENDERER/maprenderer.h"
 #include "SOLVER/Solver.h"
 
 using namespace AStarCities;
 
 void richMap(const std::string& filePath);
-void pathMap(const std::string& filePath);
+void pathMap(const std::string& filePath, const std::optional<ClipRegion>& clipRegion, const std::optional<std::string>& memoryReportPath,
+             const std::optional<std::string>& changePath);
+int benchmarkMap(const std::string& filePath, const std::string& allocator);
+int compareBackends(const std::string& filePath);
+int checkThreads(const std::string& filePath, uint32_t threadCount);
+std::set<RoadType> getMainRoadTypes();
+std::shared_ptr<Map> parseMainNetwork(const std::string& filePath, const std::optional<ClipRegion>& clipRegion, uint32_t width, uint32_t height,
+                                      std::pmr::memory_resource* resource = std::pmr::get_default_resource(), MemoryReport* memoryReport = nullptr,
+                                      bool incrementalUpdates = false);
 
 int main(int argc, char** args) {
 
-    if (argc != 2) {
-        std::cout << "Pass path to .osm file as parameter" << std::endl;
+    if (argc == 4 && std::string(args[1]) == "--benchmark") {
+        return benchmarkMap(std::string(args[3]), std::string(args[2]));
+    }
+
+    if (argc == 3 && std::string(args[1]) == "--compare-backends") {
+        return compareBackends(std::string(args[2]));
+    }
+
+    if (argc == 4 && std::string(args[1]) == "--check-threads") {
+        return checkThreads(std::string(args[3]), static_cast<uint32_t>(std::stoul(args[2])));
+    }
+
+    std::optional<std::string> memoryReportPath;
+    if (argc >= 3 && std::string(args[1]) == "--memory-report") {
+        memoryReportPath = std::string(args[2]);
+        argc -= 2;
+        args += 2;
+    }
+
+    std::optional<std::string> changePath;
+    if (argc >= 3 && std::string(args[1]) == "--change") {
+        changePath = std::string(args[2]);
+        argc -= 2;
+        args += 2;
+    }
+
+    if (argc != 2 && argc != 6) {
+        std::cout << "Pass path to .osm, .osm.gz or .osm.bz2 file as parameter" << std::endl;
+        std::cout << "Optionally followed by a bounding box: minlat minlon maxlat maxlon" << std::endl;
+        std::cout << "Or benchmark the map construction: --benchmark default|monotonic|pool file" << std::endl;
+        std::cout << "Or compare the maps parsed by pugixml and the osm tokenizer: --compare-backends file" << std::endl;
+        std::cout << "Or compare the maps analysed on one and on more threads: --check-threads count file" << std::endl;
+        std::cout << "Prefix with --memory-report file.json to report the memory usage of every stage" << std::endl;
+        std::cout << "Then optionally with --change file.osc to apply an osm change file to the shown map with the U key" << std::endl;
         return 1;
     }
 
     const std::string osmFilePath = std::string(args[1]);
 
+    std::optional<ClipRegion> clipRegion;
+    if (argc == 6) {
+        clipRegion.emplace(std::stod(args[2]), std::stod(args[4]), std::stod(args[3]), std::stod(args[5]));
+    }
+
     //richMap(osmFilePath);
-    pathMap(osmFilePath);
+    pathMap(osmFilePath, clipRegion, memoryReportPath, changePath);
 
     return 0;
 
@@ -108,15 +162,22 @@ void richMap(const std::string& filePath) {
 
     renderer.openWindow(WIDTH, HEIGHT);
 
+    // the tessellated buildings are cached next to the map file
+    const std::string parseOptions = std::to_string(WIDTH) + "x" + std::to_string(HEIGHT);
+    renderer.setBuildingCache(filePath + ".buildings", MapSnapshot::hashFile(filePath, MapSnapshot::hashData(parseOptions.data(), parseOptions.size())));
+
+    // the tokenizer parses while the file is read and decompressed, see --compare-backends
     MapParser parser;
     parser.parseRoadTypes(RoadType::getAll());
-    parser.parseMap(parser.loadFromFile(filePath), WIDTH, HEIGHT);
+    parser.setXmlBackend(MapParser::XmlBackend::OSM_TOKENIZER);
+    parser.parseFile(filePath, WIDTH, HEIGHT);
 
     renderer.setMap(parser.getMap());
     renderer.runSimulation();
 }
 
-void pathMap(const std::string& filePath) {
+void pathMap(const std::string& filePath, const std::optional<ClipRegion>& clipRegion, const std::optional<std::string>& memoryReportPath,
+             const std::optional<std::string>& changePath) {
 
     MapRenderer renderer;
 
@@ -139,6 +200,178 @@ void pathMap(const std::string& filePath) {
 
     renderer.openWindow(WIDTH, HEIGHT);
 
+    // the analysed main network is cached next to the map file
+    std::string parseOptions = std::to_string(WIDTH) + "x" + std::to_string(HEIGHT);
+    if (clipRegion) {
+        parseOptions += " " + std::to_string(clipRegion->getMinLatitude()) + " " + std::to_string(clipRegion->getMinLongitude()) +
+                        " " + std::to_string(clipRegion->getMaxLatitude()) + " " + std::to_string(clipRegion->getMaxLongitude());
+    }
+    const std::string snapshotPath = filePath + ".snapshot";
+    const uint64_t sourceHash = MapSnapshot::hashFile(filePath, MapSnapshot::hashData(parseOptions.data(), parseOptions.size()));
+
+    MemoryReport memoryReport;
+
+    // the snapshot does not keep the source roads needed to apply changes
+    std::shared_ptr<Map> map = changePath ? nullptr : MapSnapshot::load(snapshotPath, sourceHash);
+    if (map) {
+        memoryReport.addStage("load", map->getMemoryUsage());
+    } else {
+        memoryReport.addStage("load");
+        map = parseMainNetwork(filePath, clipRegion, WIDTH, HEIGHT, std::pmr::get_default_resource(), &memoryReport, changePath.has_value());
+        if (!MapSnapshot::write(*map, snapshotPath, sourceHash))
+            std::cerr << "Failed to write map snapshot" << std::endl;
+    }
+
+    std::shared_ptr<VersionedMap> versionedMap;
+    if (changePath) {
+        MapParser parser;
+        parser.parseRoadTypes(getMainRoadTypes());
+        const std::shared_ptr<const MapChange> change = std::make_shared<const MapChange>(parser.parseChangeFile(*changePath));
+
+        // a damaged change file gives an empty change and is never applied
+        if (!change->isEmpty()) {
+
+            // every version is allocated from an arena of its own, it is released with the last version using its tables
+            versionedMap = std::make_shared<VersionedMap>(map, []() { return std::make_shared<std::pmr::monotonic_buffer_resource>(); });
+
+            // the change is applied once on another thread while the old version is still shown,
+            // the renderer takes the new version before the next frame after it is published
+            const std::shared_ptr<std::future<uint64_t>> update = std::make_shared<std::future<uint64_t>>();
+            renderer.setMapUpdate([versionedMap, change, update]() {
+                if (!update->valid())
+                    *update = std::async(std::launch::async, [versionedMap, change]() { return versionedMap->applyChange(*change); });
+            });
+        }
+    }
+
+    const auto& [start, end] = Solver::selectStartAndEndIntersection(map);
+    std::shared_ptr<Solver> solver = std::shared_ptr<Solver>(new Solver(map, start, end));
+
+    if (versionedMap)
+        renderer.setVersionedMap(versionedMap);
+    else
+        renderer.setMap(map);
+    renderer.setSolver(solver);
+    memoryReport.addStage("render setup", map->getMemoryUsage());
+
+    if (memoryReportPath) {
+        memoryReport.print(std::cout);
+        std::ofstream file(*memoryReportPath);
+        memoryReport.writeJson(file);
+        if (!file)
+            std::cerr << "Failed to write memory report: " << *memoryReportPath << std::endl;
+    }
+
+    renderer.runSimulation();
+}
+
+/*
+ * Builds the main network of a map with one allocator and prints the time
+ * to construct and to free it. Only one allocator is used per run, so the
+ * peak resident set size belongs to it.
+ */
+int benchmarkMap(const std::string& filePath, const std::string& allocator) {
+
+    std::unique_ptr<std::pmr::memory_resource> arena;
+    if (allocator == "monotonic") {
+        arena = std::make_unique<std::pmr::monotonic_buffer_resource>();
+    } else if (allocator == "pool") {
+        arena = std::make_unique<std::pmr::unsynchronized_pool_resource>();
+    } else if (allocator != "default") {
+        std::cout << "Unknown allocator: " << allocator << " (default, monotonic or pool)" << std::endl;
+        return 1;
+    }
+
+    std::pmr::memory_resource* resource = arena ? arena.get() : std::pmr::get_default_resource();
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    std::shared_ptr<Map> map = parseMainNetwork(filePath, std::nullopt, 1600, 900, resource);
+
+    const auto builtTime = std::chrono::steady_clock::now();
+    const std::size_t roadCount = map->getRoads().size();
+    const std::size_t intersectionCount = map->getIntersections().size();
+
+    map.reset();
+    arena.reset();
+
+    const auto freedTime = std::chrono::steady_clock::now();
+
+    const std::chrono::duration<double> constructionTime = builtTime - startTime;
+    const std::chrono::duration<double> releaseTime = freedTime - builtTime;
+
+    std::cout << "Benchmark allocator: " << allocator << std::endl;
+    std::cout << "Roads:               " << roadCount << std::endl;
+    std::cout << "Intersections:       " << intersectionCount << std::endl;
+    std::cout << "Construction time:   " << constructionTime.count() << " s" << std::endl;
+    std::cout << "Release time:        " << releaseTime.count() << " s" << std::endl;
+    std::cout << "Peak RSS:            " << static_cast<double>(MemoryReport::getPeakResidentSetSize()) / 1e6 << " MB" << std::endl;
+
+    return 0;
+}
+
+/*
+ * Parses the map with all roads and buildings with both xml backends. The
+ * parse speed of each backend is printed by the parser, the maps must be
+ * the same.
+ */
+int compareBackends(const std::string& filePath) {
+
+    std::array<std::shared_ptr<Map>, 2> maps;
+    const std::array<MapParser::XmlBackend, 2> backends = {MapParser::XmlBackend::PUGIXML, MapParser::XmlBackend::OSM_TOKENIZER};
+
+    for (std::size_t ii = 0; ii < backends.size(); ii++) {
+        std::cout << (backends[ii] == MapParser::XmlBackend::PUGIXML ? "Backend: pugixml" : "Backend: osm tokenizer") << std::endl;
+        MapParser parser;
+        parser.parseRoadTypes(RoadType::getAll());
+        parser.setXmlBackend(backends[ii]);
+        parser.parseFile(filePath);
+        maps[ii] = parser.getMap();
+    }
+
+    const std::size_t differenceCount = maps[0]->printDifferences(*maps[1], std::cout);
+    std::cout << "Differences:        " << differenceCount << std::endl;
+
+    return differenceCount == 0 ? 0 : 1;
+}
+
+/*
+ * Analyses the map on one thread and on the given number of threads, the
+ * analysed maps and the main networks must be the same. A thread count of
+ * 0 uses all hardware threads.
+ */
+int checkThreads(const std::string& filePath, uint32_t threadCount) {
+
+    std::array<std::shared_ptr<Map>, 2> maps;
+    const std::array<uint32_t, 2> threadCounts = {1, threadCount};
+
+    for (std::size_t ii = 0; ii < threadCounts.size(); ii++) {
+        MapParser parser;
+        parser.parseRoadTypes(getMainRoadTypes());
+        parser.parseBuildings(false);
+        parser.setXmlBackend(MapParser::XmlBackend::OSM_TOKENIZER);
+        parser.parseFile(filePath);
+        maps[ii] = parser.getMap();
+        maps[ii]->setThreadCount(threadCounts[ii]);
+        maps[ii]->analyseRoadNetwork();
+    }
+
+    std::size_t differenceCount = maps[0]->printDifferences(*maps[1], std::cout);
+    std::cout << "Analysis differences:     " << differenceCount << std::endl;
+
+    for (const std::shared_ptr<Map>& map : maps) {
+        map->keepMainNetwork();
+    }
+
+    const std::size_t mainDifferenceCount = maps[0]->printDifferences(*maps[1], std::cout);
+    std::cout << "Main network differences: " << mainDifferenceCount << std::endl;
+
+    differenceCount += mainDifferenceCount;
+    return differenceCount == 0 ? 0 : 1;
+}
+
+std::set<RoadType> getMainRoadTypes() {
+
     std::set<RoadType> roadTypes;
     roadTypes.insert(RoadType::MOTORWAY);
     roadTypes.insert(RoadType::MOTORWAY_LINK);
@@ -154,19 +387,36 @@ void pathMap(const std::string& filePath) {
     roadTypes.insert(RoadType::RESIDENTIAL);
     roadTypes.insert(RoadType::LIVING_STREET);
 
-    MapParser parser;
-    parser.parseRoadTypes(roadTypes);
+    return roadTypes;
+}
+
+std::shared_ptr<Map> parseMainNetwork(const std::string& filePath, const std::optional<ClipRegion>& clipRegion, uint32_t width, uint32_t height,
+                                      std::pmr::memory_resource* resource, MemoryReport* memoryReport, bool incrementalUpdates) {
+
+    MapParser parser(resource);
+    parser.parseRoadTypes(getMainRoadTypes());
     parser.parseBuildings(false);
-    parser.parseMap(parser.loadFromFile(filePath), WIDTH, HEIGHT);
+    parser.setXmlBackend(MapParser::XmlBackend::OSM_TOKENIZER);
+    if (clipRegion)
+        parser.setClipRegion(*clipRegion);
+    parser.parseFile(filePath, width, height);
 
     std::shared_ptr<Map> map = parser.getMap();
+    if (memoryReport) {
+        std::vector<MemoryReport::Usage> containers = map->getMemoryUsage();
+        const std::vector<MemoryReport::Usage> parserContainers = parser.getMemoryUsage();
+        containers.insert(containers.end(), parserContainers.begin(), parserContainers.end());
+        memoryReport->addStage("parse", std::move(containers));
+    }
+
+    map->setIncrementalUpdates(incrementalUpdates);
     map->analyseRoadNetwork();
-    map = map->getMainNetwork();
+    if (memoryReport)
+        memoryReport->addStage("analyse", map->getMemoryUsage());
 
-    const auto& [start, end] = Solver::selectStartAndEndIntersection(map);
-    std::shared_ptr<Solver> solver = std::shared_ptr<Solver>(new Solver(map, start, end));
+    map->keepMainNetwork();
+    if (memoryReport)
+        memoryReport->addStage("main network", map->getMemoryUsage());
 
-    renderer.setMap(map);
-    renderer.setSolver(solver);
-    renderer.runSimulation();
+    return map;
 }
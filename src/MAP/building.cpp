@@ -1,18 +1,10 @@
 
 #include "building.h"
+#include "map.h"
 
 using namespace AStarCities;
 
-void Building::setNodes(const std::vector<std::reference_wrapper<const Node>>& nodes) {
-    this->nodes = nodes;
-}
-
-void Building::addInnerShapeNodes(const std::vector<std::reference_wrapper<const Node>>& nodes) {
-
-    innerShapes.push_back(nodes);
-}
-
-void Building::setInnerShapeNodes(const std::vector<std::vector<std::reference_wrapper<const Node>>>& shapes) {
-
-    innerShapes = shapes;
+NodeRange Building::getShapeNodes(std::size_t shape) const {
+    const Map::Shape& range = map->shapes[firstShape + shape];
+    return NodeRange(*map, std::span<const NodeIndex>(map->shapeNodes).subspan(range.firstNode, range.nodeCount));
 }
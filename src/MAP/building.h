@@ -1,49 +1,49 @@
 #pragma once
 
 #include "buildingtype.h"
+#include "node.h"
 
 #include <cstdint>
-#include <functional>
 
 namespace AStarCities {
 
-    class Node;
+    class Map;
 
+    /*
+     * Building stored in a map. The shapes are a range in the shapes of the map,
+     * the first shape is the outer shape.
+     */
     class Building {
 
         public:
 
-            Building(uint64_t id, BuildingType type) :
-                id(id), type(type) {};
-
-            Building(uint64_t id, BuildingType type, const std::vector<std::reference_wrapper<const Node>>& nodes) :
-                id(id), type(type), nodes(nodes) {};
-
-            virtual ~Building() = default;
-
-            void setNodes(const std::vector<std::reference_wrapper<const Node>>& nodes);
-
-            void addInnerShapeNodes(const std::vector<std::reference_wrapper<const Node>>& nodes);
-
-            void setInnerShapeNodes(const std::vector<std::vector<std::reference_wrapper<const Node>>>& shapes);
+            Building(const Map& map, uint64_t id, BuildingType type, uint32_t firstShape, uint32_t shapeCount) :
+                map(&map), id(id), type(type), firstShape(firstShape), shapeCount(shapeCount) {};
 
             [[nodiscard]] uint64_t getId() const noexcept { return id; }
 
             [[nodiscard]] BuildingType getType() const noexcept { return type; }
 
-            [[nodiscard]] const std::vector<std::reference_wrapper<const Node>>& getNodes() const { return nodes; }
+            [[nodiscard]] NodeRange getNodes() const { return getShapeNodes(0); }
 
-            [[nodiscard]] const std::vector<std::vector<std::reference_wrapper<const Node>>>& getInnerShapeNodes() const { return innerShapes; }
+            [[nodiscard]] std::size_t getInnerShapeCount() const noexcept { return shapeCount - 1; }
+            [[nodiscard]] NodeRange getInnerShapeNodes(std::size_t shape) const { return getShapeNodes(shape + 1); }
 
         private:
 
+            friend class Map;
+            friend class MapSnapshot;
+
+            [[nodiscard]] NodeRange getShapeNodes(std::size_t shape) const;
+
+            const Map* map;
+
             uint64_t id;
 
             BuildingType type;
 
-            std::vector<std::reference_wrapper<const Node>> nodes;
-
-            std::vector<std::vector<std::reference_wrapper<const Node>>> innerShapes;
+            uint32_t firstShape;
+            uint32_t shapeCount;
 
     };
 }
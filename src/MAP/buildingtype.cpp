@@ -1,9 +1,12 @@
 
 #include "buildingtype.h"
+#include "perfecthash.h"
 
 using namespace AStarCities;
 
-const std::map<std::string, BuildingType::Type> BuildingType::typeNameMap = {
+using enum BuildingType::Type;
+
+static constexpr auto typeNames = std::to_array<std::pair<std::string_view, BuildingType::Type>>({
     // ===== ACCOMODATION =====
     { "apartments",         APPARTMENTS        },
     { "barracks",           BARRACKS           },
@@ -145,7 +148,9 @@ const std::map<std::string, BuildingType::Type> BuildingType::typeNameMap = {
     { "brewery",            BREWERY            },
     { "chimney",            CHIMNEY            },
     { "tomb",               TOMB               }
-};
+});
+
+static constexpr PerfectHash<BuildingType::Type, typeNames.size()> typeNameHash(typeNames, UNKNOWN);
 
 const std::set<BuildingType> BuildingType::ACCOMODATIONS = {
     APPARTMENTS, BARRACKS,    BUNGALOW, CABIN,    DETACHED,
@@ -225,10 +230,4 @@ const std::set<BuildingType>& BuildingType::getAll() {
     return allTypes;
 }
 
-BuildingType::BuildingType(const std::string& type) {
-    if (auto find = typeNameMap.find(type); find != typeNameMap.end()) {
-        this->type = find->second;
-    } else {
-        this->type = UNKNOWN;
-    }
-}
+BuildingType::BuildingType(std::string_view type) : type(typeNameHash.find(type)) {}
@@ -1,8 +1,7 @@
 #pragma once
 
 #include <cstdint>
-#include <string>
-#include <map>
+#include <string_view>
 #include <set>
 
 namespace AStarCities {
@@ -171,7 +170,7 @@ namespace AStarCities {
 
             BuildingType() = default;
 
-            BuildingType(const std::string& type);
+            BuildingType(std::string_view type);
 
             BuildingType(Type type) : type(type) {}
 
@@ -187,8 +186,6 @@ namespace AStarCities {
 
             Type type = Type::UNKNOWN;
 
-            static const std::map<std::string, Type> typeNameMap;
-
             static std::set<BuildingType> allTypes;
     };
 }
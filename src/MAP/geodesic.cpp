@@ -0,0 +1,250 @@
+
+#include "geodesic.h"
+
+#include <cmath>
+#include <numbers>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace AStarCities;
+
+// pi / 2 split into a part with 33 bits and the rest, so k * PIO2_HI is exact for small k
+static constexpr double PIO2_HI = 1.57079632673412561417e+00;
+static constexpr double PIO2_LO = 6.07710050650619224932e-11;
+static constexpr double TWO_OVER_PI = 2.0 / std::numbers::pi;
+
+// minimax polynomials of sin and cos on [-pi/4, pi/4] as in fdlibm
+static constexpr double S1 = -1.66666666666666324348e-01;
+static constexpr double S2 =  8.33333333332248946124e-03;
+static constexpr double S3 = -1.98412698298579493134e-04;
+static constexpr double S4 =  2.75573137070700676789e-06;
+static constexpr double S5 = -2.50507602534068634195e-08;
+static constexpr double S6 =  1.58969099521155010221e-10;
+
+static constexpr double C1 =  4.16666666666666019037e-02;
+static constexpr double C2 = -1.38888888888741095749e-03;
+static constexpr double C3 =  2.48015872894767294178e-05;
+static constexpr double C4 = -2.75573143513906633035e-07;
+static constexpr double C5 =  2.08757232129817482790e-09;
+static constexpr double C6 = -1.13596475577881948265e-11;
+
+/*
+ * Sine and cosine of an angle in [-pi, pi]. The angle is reduced to
+ * [-pi/4, pi/4] by a multiple k of pi/2 with k in [-2, 2]. The vector
+ * versions below use the same operations in the same order, so all of them
+ * give the same results.
+ */
+static void sinCos(double angle, double& sine, double& cosine) {
+
+    const double k = std::nearbyint(angle * TWO_OVER_PI);
+    const double x = (angle - k * PIO2_HI) - k * PIO2_LO;
+
+    const double z = x * x;
+    const double sinR = S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)));
+    const double sinX = x + (z * x) * (S1 + z * sinR);
+
+    const double cosR = z * (C1 + z * (C2 + z * (C3 + z * (C4 + z * (C5 + z * C6)))));
+    const double halfZ = 0.5 * z;
+    const double w = 1.0 - halfZ;
+    const double cosX = w + (((1.0 - w) - halfZ) + z * cosR);
+
+    // quadrant k mod 4: swap for odd k, sine negative for 2 and 3, cosine negative for 1 and 2
+    const double absK = std::abs(k);
+    const bool swap = absK == 1.0;
+    sine   = swap ? cosX : sinX;
+    cosine = swap ? sinX : cosX;
+    if (absK == 2.0 || k == -1.0)
+        sine = -sine;
+    if (absK == 2.0 || k == 1.0)
+        cosine = -cosine;
+}
+
+std::array<double, 3> AStarCities::toUnitVector(double latitude, double longitude) {
+
+    const double lat = latitude  * std::numbers::pi / 180.0;
+    const double lon = longitude * std::numbers::pi / 180.0;
+
+    double sinLat, cosLat, sinLon, cosLon;
+    sinCos(lat, sinLat, cosLat);
+    sinCos(lon, sinLon, cosLon);
+
+    return {cosLat * cosLon, cosLat * sinLon, sinLat};
+}
+
+double AStarCities::geodesicDistance(double latitude1, double longitude1, double latitude2, double longitude2) {
+
+    const auto [x1, y1, z1] = toUnitVector(latitude1, longitude1);
+    const auto [x2, y2, z2] = toUnitVector(latitude2, longitude2);
+
+    const double dx = x1 - x2;
+    const double dy = y1 - y2;
+    const double dz = z1 - z2;
+    return EARTH_RADIUS * std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+#if defined(__AVX2__)
+
+static void sinCos(__m256d angle, __m256d& sine, __m256d& cosine) {
+
+    const __m256d k = _mm256_round_pd(_mm256_mul_pd(angle, _mm256_set1_pd(TWO_OVER_PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m256d x = _mm256_sub_pd(_mm256_sub_pd(angle, _mm256_mul_pd(k, _mm256_set1_pd(PIO2_HI))), _mm256_mul_pd(k, _mm256_set1_pd(PIO2_LO)));
+
+    const __m256d z = _mm256_mul_pd(x, x);
+    __m256d sinR = _mm256_add_pd(_mm256_set1_pd(S5), _mm256_mul_pd(z, _mm256_set1_pd(S6)));
+    sinR = _mm256_add_pd(_mm256_set1_pd(S4), _mm256_mul_pd(z, sinR));
+    sinR = _mm256_add_pd(_mm256_set1_pd(S3), _mm256_mul_pd(z, sinR));
+    sinR = _mm256_add_pd(_mm256_set1_pd(S2), _mm256_mul_pd(z, sinR));
+    const __m256d sinX = _mm256_add_pd(x, _mm256_mul_pd(_mm256_mul_pd(z, x), _mm256_add_pd(_mm256_set1_pd(S1), _mm256_mul_pd(z, sinR))));
+
+    __m256d cosR = _mm256_add_pd(_mm256_set1_pd(C5), _mm256_mul_pd(z, _mm256_set1_pd(C6)));
+    cosR = _mm256_add_pd(_mm256_set1_pd(C4), _mm256_mul_pd(z, cosR));
+    cosR = _mm256_add_pd(_mm256_set1_pd(C3), _mm256_mul_pd(z, cosR));
+    cosR = _mm256_add_pd(_mm256_set1_pd(C2), _mm256_mul_pd(z, cosR));
+    cosR = _mm256_mul_pd(z, _mm256_add_pd(_mm256_set1_pd(C1), _mm256_mul_pd(z, cosR)));
+    const __m256d halfZ = _mm256_mul_pd(_mm256_set1_pd(0.5), z);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d w = _mm256_sub_pd(one, halfZ);
+    const __m256d cosX = _mm256_add_pd(w, _mm256_add_pd(_mm256_sub_pd(_mm256_sub_pd(one, w), halfZ), _mm256_mul_pd(z, cosR)));
+
+    const __m256d signBit = _mm256_set1_pd(-0.0);
+    const __m256d absK = _mm256_andnot_pd(signBit, k);
+    const __m256d swap = _mm256_cmp_pd(absK, one, _CMP_EQ_OQ);
+    const __m256d halfTurn = _mm256_cmp_pd(absK, _mm256_set1_pd(2.0), _CMP_EQ_OQ);
+    const __m256d negateSine   = _mm256_or_pd(halfTurn, _mm256_cmp_pd(k, _mm256_set1_pd(-1.0), _CMP_EQ_OQ));
+    const __m256d negateCosine = _mm256_or_pd(halfTurn, _mm256_cmp_pd(k, one, _CMP_EQ_OQ));
+
+    sine   = _mm256_xor_pd(_mm256_blendv_pd(sinX, cosX, swap), _mm256_and_pd(negateSine, signBit));
+    cosine = _mm256_xor_pd(_mm256_blendv_pd(cosX, sinX, swap), _mm256_and_pd(negateCosine, signBit));
+}
+
+#elif defined(__SSE2__)
+
+// adding and subtracting it rounds to the nearest integer like std::nearbyint, SSE2 has no rounding instruction
+static constexpr double ROUND_MAGIC = 6755399441055744.0;
+
+static __m128d select(__m128d mask, __m128d ifTrue, __m128d ifFalse) {
+    return _mm_or_pd(_mm_and_pd(mask, ifTrue), _mm_andnot_pd(mask, ifFalse));
+}
+
+static void sinCos(__m128d angle, __m128d& sine, __m128d& cosine) {
+
+    const __m128d magic = _mm_set1_pd(ROUND_MAGIC);
+    const __m128d k = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(angle, _mm_set1_pd(TWO_OVER_PI)), magic), magic);
+    const __m128d x = _mm_sub_pd(_mm_sub_pd(angle, _mm_mul_pd(k, _mm_set1_pd(PIO2_HI))), _mm_mul_pd(k, _mm_set1_pd(PIO2_LO)));
+
+    const __m128d z = _mm_mul_pd(x, x);
+    __m128d sinR = _mm_add_pd(_mm_set1_pd(S5), _mm_mul_pd(z, _mm_set1_pd(S6)));
+    sinR = _mm_add_pd(_mm_set1_pd(S4), _mm_mul_pd(z, sinR));
+    sinR = _mm_add_pd(_mm_set1_pd(S3), _mm_mul_pd(z, sinR));
+    sinR = _mm_add_pd(_mm_set1_pd(S2), _mm_mul_pd(z, sinR));
+    const __m128d sinX = _mm_add_pd(x, _mm_mul_pd(_mm_mul_pd(z, x), _mm_add_pd(_mm_set1_pd(S1), _mm_mul_pd(z, sinR))));
+
+    __m128d cosR = _mm_add_pd(_mm_set1_pd(C5), _mm_mul_pd(z, _mm_set1_pd(C6)));
+    cosR = _mm_add_pd(_mm_set1_pd(C4), _mm_mul_pd(z, cosR));
+    cosR = _mm_add_pd(_mm_set1_pd(C3), _mm_mul_pd(z, cosR));
+    cosR = _mm_add_pd(_mm_set1_pd(C2), _mm_mul_pd(z, cosR));
+    cosR = _mm_mul_pd(z, _mm_add_pd(_mm_set1_pd(C1), _mm_mul_pd(z, cosR)));
+    const __m128d halfZ = _mm_mul_pd(_mm_set1_pd(0.5), z);
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d w = _mm_sub_pd(one, halfZ);
+    const __m128d cosX = _mm_add_pd(w, _mm_add_pd(_mm_sub_pd(_mm_sub_pd(one, w), halfZ), _mm_mul_pd(z, cosR)));
+
+    const __m128d signBit = _mm_set1_pd(-0.0);
+    const __m128d absK = _mm_andnot_pd(signBit, k);
+    const __m128d swap = _mm_cmpeq_pd(absK, one);
+    const __m128d halfTurn = _mm_cmpeq_pd(absK, _mm_set1_pd(2.0));
+    const __m128d negateSine   = _mm_or_pd(halfTurn, _mm_cmpeq_pd(k, _mm_set1_pd(-1.0)));
+    const __m128d negateCosine = _mm_or_pd(halfTurn, _mm_cmpeq_pd(k, one));
+
+    sine   = _mm_xor_pd(select(swap, cosX, sinX), _mm_and_pd(negateSine, signBit));
+    cosine = _mm_xor_pd(select(swap, sinX, cosX), _mm_and_pd(negateCosine, signBit));
+}
+
+#endif
+
+/*
+ * Blocks of 4 (AVX2) or 2 (SSE2) positions are converted at once, the rest
+ * one by one with toUnitVector.
+ */
+void AStarCities::toUnitVectors(const int32_t* latitudes, const int32_t* longitudes, double scale, std::size_t count, double* x, double* y, double* z) {
+
+    std::size_t ii = 0;
+
+#if defined(__AVX2__)
+    const __m256d scaleVector = _mm256_set1_pd(scale);
+    const __m256d pi = _mm256_set1_pd(std::numbers::pi);
+    const __m256d degrees = _mm256_set1_pd(180.0);
+    for (; ii + 4 <= count; ii += 4) {
+        const __m256d latitude  = _mm256_div_pd(_mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(latitudes + ii))), scaleVector);
+        const __m256d longitude = _mm256_div_pd(_mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(longitudes + ii))), scaleVector);
+        __m256d sinLat, cosLat, sinLon, cosLon;
+        sinCos(_mm256_div_pd(_mm256_mul_pd(latitude, pi), degrees), sinLat, cosLat);
+        sinCos(_mm256_div_pd(_mm256_mul_pd(longitude, pi), degrees), sinLon, cosLon);
+        _mm256_storeu_pd(x + ii, _mm256_mul_pd(cosLat, cosLon));
+        _mm256_storeu_pd(y + ii, _mm256_mul_pd(cosLat, sinLon));
+        _mm256_storeu_pd(z + ii, sinLat);
+    }
+#elif defined(__SSE2__)
+    const __m128d scaleVector = _mm_set1_pd(scale);
+    const __m128d pi = _mm_set1_pd(std::numbers::pi);
+    const __m128d degrees = _mm_set1_pd(180.0);
+    for (; ii + 2 <= count; ii += 2) {
+        const __m128d latitude  = _mm_div_pd(_mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(latitudes + ii))), scaleVector);
+        const __m128d longitude = _mm_div_pd(_mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(longitudes + ii))), scaleVector);
+        __m128d sinLat, cosLat, sinLon, cosLon;
+        sinCos(_mm_div_pd(_mm_mul_pd(latitude, pi), degrees), sinLat, cosLat);
+        sinCos(_mm_div_pd(_mm_mul_pd(longitude, pi), degrees), sinLon, cosLon);
+        _mm_storeu_pd(x + ii, _mm_mul_pd(cosLat, cosLon));
+        _mm_storeu_pd(y + ii, _mm_mul_pd(cosLat, sinLon));
+        _mm_storeu_pd(z + ii, sinLat);
+    }
+#endif
+
+    for (; ii < count; ii++) {
+        const auto [nodeX, nodeY, nodeZ] = toUnitVector(static_cast<double>(latitudes[ii]) / scale, static_cast<double>(longitudes[ii]) / scale);
+        x[ii] = nodeX;
+        y[ii] = nodeY;
+        z[ii] = nodeZ;
+    }
+}
+
+/*
+ * Blocks of 4 (AVX2) or 2 (SSE2) segments are computed at once, the rest
+ * is done one by one. The blocks use the same operations in the same order
+ * as the scalar loop, so the lengths do not depend on the instruction set.
+ */
+void AStarCities::segmentLengths(const double* x, const double* y, const double* z, std::size_t count, double* lengths) {
+
+    std::size_t ii = 0;
+
+#if defined(__AVX2__)
+    const __m256d radius = _mm256_set1_pd(EARTH_RADIUS);
+    for (; ii + 4 <= count; ii += 4) {
+        const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + ii), _mm256_loadu_pd(x + ii + 1));
+        const __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + ii), _mm256_loadu_pd(y + ii + 1));
+        const __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(z + ii), _mm256_loadu_pd(z + ii + 1));
+        const __m256d squared = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+        _mm256_storeu_pd(lengths + ii, _mm256_mul_pd(radius, _mm256_sqrt_pd(squared)));
+    }
+#elif defined(__SSE2__)
+    const __m128d radius = _mm_set1_pd(EARTH_RADIUS);
+    for (; ii + 2 <= count; ii += 2) {
+        const __m128d dx = _mm_sub_pd(_mm_loadu_pd(x + ii), _mm_loadu_pd(x + ii + 1));
+        const __m128d dy = _mm_sub_pd(_mm_loadu_pd(y + ii), _mm_loadu_pd(y + ii + 1));
+        const __m128d dz = _mm_sub_pd(_mm_loadu_pd(z + ii), _mm_loadu_pd(z + ii + 1));
+        const __m128d squared = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+        _mm_storeu_pd(lengths + ii, _mm_mul_pd(radius, _mm_sqrt_pd(squared)));
+    }
+#endif
+
+    for (; ii < count; ii++) {
+        const double dx = x[ii] - x[ii + 1];
+        const double dy = y[ii] - y[ii + 1];
+        const double dz = z[ii] - z[ii + 1];
+        lengths[ii] = EARTH_RADIUS * std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+}
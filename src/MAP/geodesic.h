@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace AStarCities {
+
+    // mean earth radius in metres
+    constexpr double EARTH_RADIUS = 6371008.8;
+
+    // position on the unit sphere of a latitude and longitude in degrees
+    [[nodiscard]] std::array<double, 3> toUnitVector(double latitude, double longitude);
+
+    /*
+     * Unit vectors of count positions in fixed point degrees, the degrees are
+     * the values divided by the scale. The results are the same as the ones of
+     * toUnitVector, but several positions are converted at once.
+     */
+    void toUnitVectors(const int32_t* latitudes, const int32_t* longitudes, double scale, std::size_t count, double* x, double* y, double* z);
+
+    /*
+     * Distance in metres of the chord between two positions on the earth. For
+     * the distances within a city it differs from the great circle distance by
+     * less than a micrometre, but unlike the great circle it is a metric in
+     * three dimensions: the distance of two positions is never longer than a
+     * road between them, so it is a consistent heuristic for road lengths.
+     */
+    [[nodiscard]] double geodesicDistance(double latitude1, double longitude1, double latitude2, double longitude2);
+
+    /*
+     * Chord lengths in metres of count segments between count + 1 consecutive
+     * positions given as unit vectors in separate coordinate arrays.
+     * lengths[i] is the length from position i to position i + 1.
+     */
+    void segmentLengths(const double* x, const double* y, const double* z, std::size_t count, double* lengths);
+}
@@ -16,6 +16,13 @@ namespace AStarCities {
                 return lastId;
             }
 
+            // reserve count consecutive new ids, returns the first one
+            uint64_t getNewIds(uint64_t count) {
+                const uint64_t firstId = lastId + 1;
+                lastId += count;
+                return firstId;
+            }
+
             void updateUsedIds(uint64_t updateId) {
                 if (updateId > lastId)
                     lastId = updateId;
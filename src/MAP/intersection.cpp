@@ -1,35 +1,17 @@
 
 #include "intersection.h"
-#include "road.h"
+#include "map.h"
 
 using namespace AStarCities;
 
-void Intersection::addRoad(const Road& road) {
-    roads.push_back(road);
+IntersectionIndex Intersection::getIndex() const {
+    return static_cast<IntersectionIndex>(this - map->intersections.data());
 }
 
-void Intersection::removeRoad(const Road& road) {
-    removeRoad(road.getId());
+RoadRange Intersection::getRoads() const {
+    return RoadRange(map->roads.data(), std::span<const RoadIndex>(map->intersectionRoads).subspan(firstRoad, roadCount));
 }
 
-void Intersection::removeRoad(uint64_t roadId) {
-    roads.erase(std::remove_if(roads.begin(), roads.end(), [roadId](const Road& road){ return road.getId() == roadId; }));
-}
-
-std::vector<Intersection::Connection> Intersection::getConnections() const {
-
-    std::vector<Connection> connections;
-
-    for (const Road& road : getRoads()) {
-
-        const auto& [start, end] = road.getIntersections();
-
-        if (*this == start) {
-            connections.push_back({road, end});
-        } else if (*this == end) {
-            connections.push_back({road, start});
-        }
-    }
-
-    return connections;
+std::span<const Intersection::Connection> Intersection::getConnections() const {
+    return std::span<const Connection>(map->connections).subspan(firstConnection, connectionCount);
 }
@@ -1,16 +1,22 @@
 #pragma once
 
 #include "node.h"
+#include "road.h"
 
+#include <span>
 #include <vector>
 #include <cstdint>
 #include <iostream>
 
 namespace AStarCities {
 
-    class Node;
-    class Road;
+    class Map;
 
+    /*
+     * Intersection stored in a map. The roads are a range in the intersection
+     * road buffer of the map, the connections to the neighbouring intersections
+     * are computed once after the road network has changed.
+     */
     class Intersection {
 
         public:
@@ -19,39 +25,50 @@ namespace AStarCities {
 
                 Connection() = delete;
                 Connection(const Road& road, const Intersection& inter) :
-                    road(road), intersection(inter) {}
+                    road(road), intersection(inter), length(road.getLength()) {}
 
                 const Road& road;
                 const Intersection& intersection;
 
+                // length of the road in metres
+                double length;
+
                 void printId() const { std::cout << intersection.getId() << '\n'; }
             };
 
-            Intersection(const Node& node) : node(node) {}
-            virtual ~Intersection() = default;
-
-            bool operator==(const Intersection& inter) const { return getId() == inter.getId(); }
-            bool operator<(const Intersection& inter) const { return getId() < inter.getId(); }
+            Intersection(const Map& map, NodeIndex node, uint32_t firstRoad, uint32_t roadCount) :
+                map(&map), node(node), firstRoad(firstRoad), roadCount(roadCount) {}
 
-            void addRoad(const Road& road);
+            // the node table is sorted by id, comparing the node indices compares the ids
+            bool operator==(const Intersection& inter) const { return node == inter.node; }
+            bool operator<(const Intersection& inter) const { return node < inter.node; }
 
-            void removeRoad(const Road& road);
-            void removeRoad(uint64_t roadId);
+            [[nodiscard]] IntersectionIndex getIndex() const;
+            [[nodiscard]] uint64_t getId() const { return getNode().getId(); }
+            [[nodiscard]] Node getNode() const { return Node(*map, node); }
 
-            [[nodiscard]] uint64_t getId() const { return node.getId(); }
-            [[nodiscard]] const Node& getNode() const { return node; }
+            [[nodiscard]] std::size_t getRoadCount() const { return roadCount; }
+            [[nodiscard]] RoadRange getRoads() const;
 
-            [[nodiscard]] std::size_t getRoadCount() const { return roads.size(); }
-            [[nodiscard]] const std::vector<std::reference_wrapper<const Road>>& getRoads() const { return roads; }
-            [[nodiscard]] std::vector<Connection> getConnections() const;
+            // every road once, loops lead back to this intersection
+            [[nodiscard]] std::span<const Connection> getConnections() const;
 
-            [[nodiscard]] std::pair<double, double> getPosition() const { return node.getLocalPosition(); }
+            [[nodiscard]] std::pair<double, double> getPosition() const { return getNode().getLocalPosition(); }
 
         private:
 
-            const Node& node;
+            friend class Map;
+            friend class MapSnapshot;
+
+            const Map* map;
+
+            NodeIndex node;
+
+            uint32_t firstRoad;
+            uint32_t roadCount;
 
-            std::vector<std::reference_wrapper<const Road>> roads;
+            uint32_t firstConnection = 0;
+            uint32_t connectionCount = 0;
 
     };
 }
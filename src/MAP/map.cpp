@@ -1,11 +1,198 @@
 
 #include "map.h"
 #include "intersection.h"
+#include "topologybuilder.h"
+#include "geodesic.h"
+#include "parallelfor.h"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <set>
 
 using namespace AStarCities;
 
+// the resource is not owned, an empty owner with the resource as its pointer
+Map::Map(std::pmr::memory_resource* resource) :
+    Map(std::shared_ptr<std::pmr::memory_resource>(std::shared_ptr<void>(), resource)) {}
+
+Map::Map(std::shared_ptr<std::pmr::memory_resource> resource) :
+    memoryResource(resource), nodes(resource), roads(resource.get()), roadNodes(resource), roadNames(resource), buildings(resource.get()), shapes(resource),
+    shapeNodes(resource), intersections(resource.get()), intersectionRoads(resource), connections(resource.get()),
+    incrementalState(new IncrementalState()) {
+
+    incrementalState->owner = this;
+}
+
+/*
+ * The node table, the index tables, the road names and the network labels
+ * are shared with the copy. Roads, intersections and buildings point to their
+ * map, so they are copied and pointed to the copy, and the connections are set
+ * again. The source roads are handed over to the copy instead of being copied.
+ */
+std::unique_ptr<Map> Map::clone(std::shared_ptr<std::pmr::memory_resource> resource) const {
+
+    std::unique_ptr<Map> map = std::unique_ptr<Map>(resource ? new Map(std::move(resource)) : new Map());
+
+    map->idHandler = idHandler;
+
+    map->minLatitude = minLatitude;
+    map->maxLatitude = maxLatitude;
+    map->minLongitude = minLongitude;
+    map->maxLongitude = maxLongitude;
+    map->localWidth = localWidth;
+    map->localHeight = localHeight;
+    map->refWidth = refWidth;
+    map->refHeight = refHeight;
+    map->threadCount = threadCount;
+    map->version = version;
+
+    // copy assignment keeps the memory resource of the copy
+    map->nodes = nodes;
+    map->roadNodes = roadNodes;
+    map->roadNames = roadNames;
+    map->shapes = shapes;
+    map->shapeNodes = shapeNodes;
+    map->intersectionRoads = intersectionRoads;
+
+    map->roads = roads;
+    map->buildings = buildings;
+    map->intersections = intersections;
+
+    for (Road& road : map->roads)
+        road.map = map.get();
+    for (Building& building : map->buildings)
+        building.map = map.get();
+    for (Intersection& intersection : map->intersections)
+        intersection.map = map.get();
+
+    map->setIntersectionConnections();
+
+    if (networkFinder)
+        map->networkFinder = std::unique_ptr<NetworkFinder>(new NetworkFinder(*map, *networkFinder));
+
+    map->incrementalUpdates = incrementalUpdates && ownsIncrementalState();
+    if (map->incrementalUpdates) {
+        map->incrementalState = incrementalState;
+        incrementalState->owner.store(map.get(), std::memory_order_release);
+    }
+
+    return map;
+}
+
+std::vector<MemoryReport::Usage> Map::getMemoryUsage() const {
+
+    std::vector<MemoryReport::Usage> usage = {
+        {"nodes", nodes.size(), nodes.getAllocatedBytes()},
+        MemoryReport::measureVector("roads", roads),
+        MemoryReport::measureVector("road nodes", roadNodes),
+        {"road names", roadNames.size(), roadNames.getAllocatedBytes()},
+        MemoryReport::measureVector("intersections", intersections),
+        MemoryReport::measureVector("intersection roads", intersectionRoads),
+        MemoryReport::measureVector("connections", connections),
+        MemoryReport::measureVector("buildings", buildings),
+        MemoryReport::measureVector("building shapes", shapes),
+        MemoryReport::measureVector("shape nodes", shapeNodes)
+    };
+
+    if (networkFinder)
+        usage.push_back({"networks", networkFinder->getNetworkCount(), networkFinder->getAllocatedBytes()});
+
+    if (incrementalUpdates && ownsIncrementalState()) {
+        const auto getRoadIds = [](const std::vector<uint64_t>& roadIds) -> const std::vector<uint64_t>& { return roadIds; };
+        usage.push_back(MemoryReport::measureTree("source roads", incrementalState->sourceRoads, [](const RoadEntry& road) -> const std::vector<NodeIndex>& { return road.nodes; }));
+        usage.push_back(MemoryReport::measureTree("node source roads", incrementalState->nodeSourceRoads, getRoadIds));
+        usage.push_back(MemoryReport::measureTree("road sources", incrementalState->roadSources, getRoadIds));
+        usage.push_back(MemoryReport::measureTree("source road parts", incrementalState->sourceRoadParts, getRoadIds));
+    }
+
+    return usage;
+}
+
+/*
+ * Entities are compared by their ids and values, not by their indices
+ * into other tables, so maps with the same content but a different node
+ * table are equal. The road lengths must be bit identical and the network
+ * labels must group the intersections the same way.
+ */
+std::size_t Map::printDifferences(const Map& other, std::ostream& stream, std::size_t maxPrinted) const {
+
+    std::size_t differenceCount = 0;
+
+    const auto report = [&differenceCount, &stream, maxPrinted](std::string_view table, std::size_t index, std::string_view value) {
+        if (differenceCount++ < maxPrinted)
+            stream << "Map - Difference: " << table << " " << index << ": " << value << std::endl;
+    };
+
+    const auto compareSize = [&report](std::string_view table, std::size_t size, std::size_t otherSize) {
+        if (size != otherSize)
+            report(table, std::min(size, otherSize), "count " + std::to_string(size) + " != " + std::to_string(otherSize));
+        return std::min(size, otherSize);
+    };
+
+    const auto sameNodes = [](NodeRange nodes, NodeRange otherNodes) {
+        return std::ranges::equal(nodes, otherNodes, {}, [](const Node& node) { return node.getId(); }, [](const Node& node) { return node.getId(); });
+    };
+
+    for (NodeIndex index = 0; index < compareSize("node", nodes.size(), other.nodes.size()); index++) {
+        if (nodes.getId(index) != other.nodes.getId(index))
+            report("node", index, "id " + std::to_string(nodes.getId(index)) + " != " + std::to_string(other.nodes.getId(index)));
+        else if (nodes.getRawLatitude(index) != other.nodes.getRawLatitude(index) || nodes.getRawLongitude(index) != other.nodes.getRawLongitude(index))
+            report("node", index, "position of " + std::to_string(nodes.getId(index)));
+    }
+
+    for (RoadIndex index = 0; index < compareSize("road", roads.size(), other.roads.size()); index++) {
+        const Road& road = roads[index];
+        const Road& otherRoad = other.roads[index];
+        if (road.getId() != otherRoad.getId())
+            report("road", index, "id " + std::to_string(road.getId()) + " != " + std::to_string(otherRoad.getId()));
+        else if (road.getName() != otherRoad.getName() || road.getType() != otherRoad.getType())
+            report("road", index, "name or type of " + std::to_string(road.getId()));
+        else if (!sameNodes(road.getNodes(), otherRoad.getNodes()))
+            report("road", index, "nodes of " + std::to_string(road.getId()));
+        else if (road.getLength() != otherRoad.getLength())
+            report("road", index, "length of " + std::to_string(road.getId()));
+    }
+
+    for (std::size_t index = 0; index < compareSize("building", buildings.size(), other.buildings.size()); index++) {
+        const Building& building = buildings[index];
+        const Building& otherBuilding = other.buildings[index];
+        bool sameShapes = building.getInnerShapeCount() == otherBuilding.getInnerShapeCount() && sameNodes(building.getNodes(), otherBuilding.getNodes());
+        for (std::size_t shape = 0; sameShapes && shape < building.getInnerShapeCount(); shape++)
+            sameShapes = sameNodes(building.getInnerShapeNodes(shape), otherBuilding.getInnerShapeNodes(shape));
+        if (building.getId() != otherBuilding.getId())
+            report("building", index, "id " + std::to_string(building.getId()) + " != " + std::to_string(otherBuilding.getId()));
+        else if (building.getType() != otherBuilding.getType() || !sameShapes)
+            report("building", index, "type or shapes of " + std::to_string(building.getId()));
+    }
+
+    // the networks are numbered in the order of their first intersection, as after a full analysis
+    const auto getLabels = [](const std::unique_ptr<NetworkFinder>& networkFinder) {
+        std::vector<uint32_t> labels;
+        std::map<uint32_t, uint32_t> networks;
+        for (uint32_t network : networkFinder ? networkFinder->getNetworkIndices() : std::span<const uint32_t>())
+            labels.push_back(networks.emplace(network, static_cast<uint32_t>(networks.size())).first->second);
+        return labels;
+    };
+    const std::vector<uint32_t> labels = getLabels(networkFinder);
+    const std::vector<uint32_t> otherLabels = getLabels(other.networkFinder);
+    compareSize("network label", labels.size(), otherLabels.size());
+
+    for (IntersectionIndex index = 0; index < compareSize("intersection", intersections.size(), other.intersections.size()); index++) {
+        const Intersection& intersection = intersections[index];
+        const Intersection& otherIntersection = other.intersections[index];
+        if (intersection.getId() != otherIntersection.getId())
+            report("intersection", index, "id " + std::to_string(intersection.getId()) + " != " + std::to_string(otherIntersection.getId()));
+        else if (!std::ranges::equal(intersection.getRoads(), otherIntersection.getRoads(), {}, &Road::getId, &Road::getId))
+            report("intersection", index, "roads of " + std::to_string(intersection.getId()));
+        else if (index < labels.size() && index < otherLabels.size() && labels[index] != otherLabels[index])
+            report("intersection", index, "network of " + std::to_string(intersection.getId()));
+    }
+
+    return differenceCount;
+}
+
 void Map::setReferenceResolution(uint32_t width, uint32_t height) {
     refWidth = width;
     refHeight = height;
@@ -33,310 +220,933 @@ void Map::setGlobalBounds(double minlat, double maxlat, double minlon, double ma
     std::cout << "Map - local  dimensions: " << localWidth << " " << localHeight << std::endl;
 }
 
-void Map::addRoad(const Road& road) {
+NodeIndex Map::addNode(uint64_t id, double latitude, double longitude) {
+    nodes.addNode(id, latitude, longitude);
+    idHandler.updateUsedIds(id);
+    return static_cast<NodeIndex>(nodes.size() - 1);
+}
 
-    std::vector<std::reference_wrapper<const Node>> nodes = addNodes(road.getNodes());
+/*
+ * Nodes are appended without checking for duplicates,
+ * sortById merges them once all roads and buildings are added.
+ */
+std::vector<NodeIndex> Map::addNodes(const NodeTable& table, const std::vector<NodeTable::Index>& indices) {
 
-    const auto [roadIterator, success] = roads.insert({road.getId(), road});
-    if (success) {
-        roadIterator->second.setNodes(nodes);
-        idHandler.updateUsedIds(road.getId());
-    } else {
-        std::cerr << "Map - Error: Unable to insert new road - id: " << road.getId() << std::endl;
+    std::vector<NodeIndex> returnNodes;
+    returnNodes.reserve(indices.size());
+
+    for (NodeTable::Index index : indices) {
+        nodes.addRawNode(table.getId(index), table.getRawLatitude(index), table.getRawLongitude(index));
+        idHandler.updateUsedIds(table.getId(index));
+        returnNodes.push_back(static_cast<NodeIndex>(nodes.size() - 1));
     }
+
+    return returnNodes;
 }
 
-void Map::addBuilding(const Building& building) {
+void Map::addRoad(uint64_t id, std::string_view name, RoadType type, const std::vector<NodeIndex>& nodes) {
+    appendRoad(id, roadNames.add(name), type, nodes);
+    idHandler.updateUsedIds(id);
+}
 
-    std::vector<std::reference_wrapper<const Node>> nodes = addNodes(building.getNodes());
+void Map::addRoad(const Road& road) {
+    const Map& source = *road.map;
+    addRoad(road.getId(), road.getName(), road.getType(), addNodes(source.nodes, {road.getNodes().getIndices().begin(), road.getNodes().getIndices().end()}));
+}
 
-    std::vector<std::vector<std::reference_wrapper<const Node>>> innerShapes;
-    for (const std::vector<std::reference_wrapper<const Node>>& shape : building.getInnerShapeNodes()) {
-        innerShapes.push_back(addNodes(shape));
-    }
+void Map::addBuilding(uint64_t id, BuildingType type, const std::vector<NodeIndex>& nodes, const std::vector<std::vector<NodeIndex>>& innerShapes) {
 
-    const auto [buildingIterator, success] = buildings.insert({building.getId(), building});
-    if (success) {
-        buildingIterator->second.setNodes(nodes);
-        buildingIterator->second.setInnerShapeNodes(innerShapes);
-        idHandler.updateUsedIds(building.getId());
-    } else {
-        std::cerr << "Map - Error: Unable to insert new building - id: " << building.getId() << std::endl;
+    buildings.emplace_back(*this, id, type, static_cast<uint32_t>(shapes.size()), static_cast<uint32_t>(innerShapes.size() + 1));
+
+    const auto addShape = [this](const std::vector<NodeIndex>& shape) {
+        shapes.push_back({static_cast<uint32_t>(shapeNodes.size()), static_cast<uint32_t>(shape.size())});
+        shapeNodes.insert(shapeNodes.end(), shape.begin(), shape.end());
+    };
+
+    addShape(nodes);
+    for (const std::vector<NodeIndex>& shape : innerShapes) {
+        addShape(shape);
     }
+
+    idHandler.updateUsedIds(id);
 }
 
-std::vector<std::reference_wrapper<const Node>> Map::addNodes(const std::vector<std::reference_wrapper<const Node>>& nodes) {
+void Map::appendRoad(uint64_t id, StringPool::Id name, RoadType type, std::span<const NodeIndex> nodes) {
+
+    roads.emplace_back(*this, id, name, type, static_cast<uint32_t>(roadNodes.size()), static_cast<uint32_t>(nodes.size()));
+    roadNodes.insert(roadNodes.end(), nodes.begin(), nodes.end());
+}
 
-    std::vector<std::reference_wrapper<const Node>> returnNodes;
+void Map::sortById() {
 
-    for (const Node& node : nodes) {
-        const Node* newNode = addNode(node);
-        if (newNode != nullptr) {
-            returnNodes.push_back(*newNode);
-        } else {
-            std::cerr << "Map - Error: Unable to create new node - id: " << node.getId();
+    // nodes that were added more than once are merged into the first one
+    const std::vector<NodeIndex> newIndices = nodes.sortById();
+    if (!newIndices.empty()) {
+
+        for (NodeIndex& node : roadNodes.edit())
+            node = newIndices[node];
+        for (NodeIndex& node : shapeNodes.edit())
+            node = newIndices[node];
+        for (Intersection& intersection : intersections)
+            intersection.node = newIndices[intersection.node];
+
+        // source roads taken over by a copy belong to the node table of the copy
+        if (ownsIncrementalState()) {
+            for (auto& [id, road] : incrementalState->sourceRoads) {
+                for (NodeIndex& node : road.nodes)
+                    node = newIndices[node];
+            }
+
+            std::map<NodeIndex, std::vector<uint64_t>> oldNodeSourceRoads = std::move(incrementalState->nodeSourceRoads);
+            incrementalState->nodeSourceRoads.clear();
+            for (auto& [node, roadIds] : oldNodeSourceRoads)
+                incrementalState->nodeSourceRoads.emplace_hint(incrementalState->nodeSourceRoads.end(), newIndices[node], std::move(roadIds));
         }
     }
 
-    return returnNodes;
-}
+    // the first of multiple roads or buildings with the same id is kept
+    if (!std::ranges::is_sorted(roads, {}, &Road::getId)) {
+        std::ranges::stable_sort(roads, {}, &Road::getId);
+    }
+    const auto duplicatedRoads = std::ranges::unique(roads, {}, &Road::getId);
+    for (const Road& road : duplicatedRoads)
+        std::cerr << "Map - Error: Unable to insert new road - id: " << road.getId() << std::endl;
+    roads.erase(duplicatedRoads.begin(), duplicatedRoads.end());
 
-const Node* Map::addNode(const Node& node) {
-    const auto [nodeIterator, success] = nodes.insert({node.getId(), node});
-    if (success) {
-        nodeIterator->second.setLocalPosition(globalPosToLocal(node.getGlobalPosition()));
-        idHandler.updateUsedIds(node.getId());
-        return &nodeIterator->second;
-    } else {
-        auto nodeIterator = nodes.find(node.getId());
-        if (nodeIterator != nodes.end()) {
-            return &nodeIterator->second;
-        } else {
-            std::cerr << "Map - Error: Unable to insert node and unable to find node - id: " << node.getId() << std::endl;
-        }
+    if (!std::ranges::is_sorted(buildings, {}, &Building::getId)) {
+        std::ranges::stable_sort(buildings, {}, &Building::getId);
     }
-    return nullptr;
+    const auto duplicatedBuildings = std::ranges::unique(buildings, {}, &Building::getId);
+    for (const Building& building : duplicatedBuildings)
+        std::cerr << "Map - Error: Unable to insert new building - id: " << building.getId() << std::endl;
+    buildings.erase(duplicatedBuildings.begin(), duplicatedBuildings.end());
 }
 
-std::pair<double, double> Map::globalPosToLocal(std::pair<double, double> globalPos) {
+std::pair<double, double> Map::globalPosToLocal(std::pair<double, double> globalPos) const {
     const double posX = (globalPos.second - minLongitude) / getGlobalWidth()  * localWidth;
     const double posY = localHeight - (globalPos.first  - minLatitude)  / getGlobalHeight() * localHeight;
     return {posX, posY};
 }
 
+std::pair<double, double> Map::getLocalPosition(NodeIndex index) const {
+    return globalPosToLocal({nodes.getLatitude(index), nodes.getLongitude(index)});
+}
+
+/*
+ * The fixed point positions of all road nodes are gathered into separate
+ * arrays in the order of the road node buffer, so the conversion to unit
+ * vectors and the lengths of all segments are computed by vectorised
+ * kernels. The segments between the last node of a road and the first node
+ * of the next road are computed as well and skipped when the lengths of the
+ * roads are summed.
+ */
+void Map::setRoadLengths() {
+
+    const std::size_t count = roadNodes.size();
+
+    std::vector<double> x(count);
+    std::vector<double> y(count);
+    std::vector<double> z(count);
+    std::vector<double> lengths(count);
+
+    parallelFor(count, threadCount, [this, &x, &y, &z](std::size_t begin, std::size_t end) {
+        std::vector<int32_t> latitudes(end - begin);
+        std::vector<int32_t> longitudes(end - begin);
+        for (std::size_t ii = begin; ii < end; ii++) {
+            latitudes[ii - begin]  = nodes.getRawLatitude(roadNodes[ii]);
+            longitudes[ii - begin] = nodes.getRawLongitude(roadNodes[ii]);
+        }
+        toUnitVectors(latitudes.data(), longitudes.data(), NodeTable::SCALE, end - begin, x.data() + begin, y.data() + begin, z.data() + begin);
+    });
+
+    if (count > 1) {
+        parallelFor(count - 1, threadCount, [&x, &y, &z, &lengths](std::size_t begin, std::size_t end) {
+            segmentLengths(x.data() + begin, y.data() + begin, z.data() + begin, end - begin, lengths.data() + begin);
+        });
+    }
+
+    parallelFor(roads.size(), threadCount, [this, &lengths](std::size_t begin, std::size_t end) {
+        for (std::size_t ii = begin; ii < end; ii++) {
+            Road& road = roads[ii];
+            road.length = 0;
+            for (uint32_t node = road.firstNode; node + 1 < road.firstNode + road.nodeCount; node++)
+                road.length += lengths[node];
+        }
+    });
+}
+
+// the same kernels and the same order of summation as for all roads, so the length is bit identical
+void Map::setRoadLength(Road& road) {
+
+    const std::size_t count = road.nodeCount;
+
+    std::vector<int32_t> latitudes(count);
+    std::vector<int32_t> longitudes(count);
+    for (std::size_t ii = 0; ii < count; ii++) {
+        latitudes[ii]  = nodes.getRawLatitude(roadNodes[road.firstNode + ii]);
+        longitudes[ii] = nodes.getRawLongitude(roadNodes[road.firstNode + ii]);
+    }
+
+    std::vector<double> x(count);
+    std::vector<double> y(count);
+    std::vector<double> z(count);
+    toUnitVectors(latitudes.data(), longitudes.data(), NodeTable::SCALE, count, x.data(), y.data(), z.data());
+
+    std::vector<double> lengths(count > 1 ? count - 1 : 0);
+    segmentLengths(x.data(), y.data(), z.data(), lengths.size(), lengths.data());
+
+    road.length = 0;
+    for (double length : lengths)
+        road.length += length;
+}
+
 void Map::analyseRoadNetwork() {
 
-    findIntersections();
-    splitRoadsOnIntersections();
-    findIntersections();
-    fuseRoads(); // this step is optional
-    setIntersectionsToEndOfRoads();
+    // a map whose source roads were taken over by a copy starts with new ones
+    if (!ownsIncrementalState()) {
+        incrementalState = std::shared_ptr<IncrementalState>(new IncrementalState());
+        incrementalState->owner = this;
+    }
+
+    sortById();
+
+    incrementalState->roadSources.clear();
+
+    // the roads as added to the map are the source of the analysed roads
+    if (incrementalUpdates) {
+        incrementalState->sourceRoads = getRoadEntries();
+        countRoadNodes(incrementalState->sourceRoads);
+    }
+
+    TopologyBuilder builder(*this, threadCount);
+    builder.build();
+    setRoadLengths();
+    setIntersectionConnections();
 
-    networkFinder = std::unique_ptr<NetworkFinder>(new NetworkFinder(*this));
+    if (incrementalUpdates) {
+        incrementalState->roadSources = builder.getRoadSources();
+        for (const auto& [id, sources] : incrementalState->roadSources) {
+            for (uint64_t sourceId : sources)
+                incrementalState->sourceRoadParts[sourceId].push_back(id);
+        }
+    } else {
+        incrementalState->nodeSourceRoads.clear();
+    }
+
+    networkFinder = std::unique_ptr<NetworkFinder>(new NetworkFinder(*this, threadCount));
     networkFinder->generateNetworks();
+
+    version++;
+}
+
+Map::RoadEntries Map::getRoadEntries() const {
+
+    RoadEntries entries;
+
+    for (const Road& road : roads) {
+        entries.emplace_hint(entries.end(), road.getId(), getRoadEntry(road));
+    }
+
+    return entries;
+}
+
+Map::RoadEntry Map::getRoadEntry(const Road& road) const {
+    const std::span<const NodeIndex> nodes = road.getNodes().getIndices();
+    return RoadEntry{road.name, road.type, {nodes.begin(), nodes.end()}};
+}
+
+RoadIndex Map::findRoad(uint64_t id) const {
+    const auto iterator = std::ranges::lower_bound(roads, id, {}, &Road::getId);
+    if (iterator == roads.end() || iterator->getId() != id)
+        return Road::NO_ROAD;
+    return static_cast<RoadIndex>(iterator - roads.begin());
+}
+
+IntersectionIndex Map::findIntersection(NodeIndex node) const {
+    const auto iterator = std::ranges::lower_bound(intersections, node, {}, [](const Intersection& intersection) { return intersection.node; });
+    if (iterator == intersections.end() || iterator->node != node)
+        return Road::NO_INTERSECTION;
+    return static_cast<IntersectionIndex>(iterator - intersections.begin());
 }
 
-std::unique_ptr<Map> Map::getMainNetwork() const {
+/*
+ * The road lists of the intersections contain the roads at the ends twice,
+ * every connection is only stored once. The connections reference the
+ * roads and intersections, so they are set again after every change.
+ */
+void Map::setIntersectionConnections() {
 
-    if (!networkFinder)
-        return nullptr;
+    connections.clear();
+    connections.reserve(intersectionRoads.size() / 2);
 
-    std::vector<NetworkFinder::RoadNetwork> networks = networkFinder->getRoadNetworks();
+    for (uint32_t index = 0; index < intersections.size(); index++) {
 
-    std::unique_ptr<Map> map = std::unique_ptr<Map>(new Map());
+        Intersection& intersection = intersections[index];
+        intersection.firstConnection = static_cast<uint32_t>(connections.size());
 
-    NetworkFinder::RoadNetwork& mainNetwork = networks.at(0);
+        const std::span<const RoadIndex> roadIndices = intersection.getRoads().getIndices();
+        for (auto iterator = roadIndices.begin(); iterator != roadIndices.end(); iterator++) {
 
-    std::size_t totalNodeCount = NetworkFinder::getNetworkNodeCount(mainNetwork);
+            if (std::find(roadIndices.begin(), iterator, *iterator) != iterator)
+                continue;
 
-    for (auto iterator = networks.begin() + 1; iterator != networks.end(); iterator++) {
-        totalNodeCount += NetworkFinder::getNetworkNodeCount(*iterator);
-        if (iterator->size() > mainNetwork.size()) {
-            mainNetwork = *iterator;
+            const Road& road = roads[*iterator];
+            if (road.startIntersection == index) {
+                connections.emplace_back(road, intersections[road.endIntersection]);
+            } else if (road.endIntersection == index) {
+                connections.emplace_back(road, intersections[road.startIntersection]);
+            }
         }
+
+        intersection.connectionCount = static_cast<uint32_t>(connections.size()) - intersection.firstConnection;
+    }
+}
+
+/*
+ * Roads and intersections of all other networks are removed in place and the
+ * indices of the remaining entities are remapped. Nodes that are not used
+ * anymore are removed from the node table, the buildings are kept. The
+ * source roads of the main network are kept for later changes.
+ */
+void Map::keepMainNetwork() {
+
+    if (!networkFinder) {
+        std::cerr << "Map - Error: The road network must be analysed before the main network can be selected" << std::endl;
+        return;
+    }
+
+    // a road belongs to the network of its intersections
+    const std::span<const uint32_t> networkIndices = networkFinder->getNetworkIndices();
+    std::vector<std::size_t> networkRoadCounts(networkFinder->getNetworkCount(), 0);
+    std::vector<std::size_t> networkNodeCounts(networkFinder->getNetworkCount(), 0);
+    for (const Road& road : roads) {
+        networkRoadCounts[networkIndices[road.startIntersection]]++;
+        networkNodeCounts[networkIndices[road.startIntersection]] += road.nodeCount;
+    }
+
+    // the first network with the most roads
+    const uint32_t mainNetwork = static_cast<uint32_t>(std::ranges::max_element(networkRoadCounts) - networkRoadCounts.begin());
+    const std::size_t mainNetworkNodeCount = networkNodeCounts.at(mainNetwork);
+    const std::size_t totalNodeCount = std::accumulate(networkNodeCounts.begin(), networkNodeCounts.end(), std::size_t(0));
+
+    // old index -> new index of roads and intersections
+    constexpr uint32_t REMOVED = std::numeric_limits<uint32_t>::max();
+    std::vector<RoadIndex> roadIndices(roads.size(), REMOVED);
+    std::vector<uint32_t> intersectionIndices(intersections.size(), REMOVED);
+
+    RoadIndex roadCount = 0;
+    for (RoadIndex index = 0; index < roads.size(); index++) {
+        if (networkIndices[roads[index].startIntersection] == mainNetwork)
+            roadIndices[index] = roadCount++;
+    }
+    uint32_t intersectionCount = 0;
+    for (uint32_t index = 0; index < intersections.size(); index++) {
+        if (networkIndices[index] == mainNetwork)
+            intersectionIndices[index] = intersectionCount++;
     }
 
-    map->setReferenceResolution(refWidth, refHeight);
-    map->setGlobalBounds(minLatitude, maxLatitude, minLongitude, maxLongitude);
-    for (const Road& road : mainNetwork) {
-        map->addRoad(road);
+    std::vector<bool> usedNodes(nodes.size(), false);
+    for (NodeIndex node : shapeNodes)
+        usedNodes[node] = true;
+
+    // the remaining roads and intersections are moved to the front
+    std::pmr::vector<NodeIndex> mainRoadNodes(getMemoryResource());
+    mainRoadNodes.reserve(mainNetworkNodeCount);
+    for (RoadIndex index = 0; index < roads.size(); index++) {
+        if (roadIndices[index] == REMOVED)
+            continue;
+        Road& road = roads[roadIndices[index]];
+        if (roadIndices[index] != index)
+            road = std::move(roads[index]);
+        const auto nodesBegin = roadNodes.begin() + road.firstNode;
+        road.firstNode = static_cast<uint32_t>(mainRoadNodes.size());
+        mainRoadNodes.insert(mainRoadNodes.end(), nodesBegin, nodesBegin + road.nodeCount);
+        road.startIntersection = intersectionIndices[road.startIntersection];
+        road.endIntersection = intersectionIndices[road.endIntersection];
+    }
+    roads.erase(roads.begin() + roadCount, roads.end());
+    roadNodes = std::move(mainRoadNodes);
+
+    std::pmr::vector<RoadIndex> mainIntersectionRoads(getMemoryResource());
+    for (uint32_t index = 0; index < intersections.size(); index++) {
+        if (intersectionIndices[index] == REMOVED)
+            continue;
+        Intersection& intersection = intersections[intersectionIndices[index]];
+        if (intersectionIndices[index] != index)
+            intersection = intersections[index];
+        const auto roadsBegin = intersectionRoads.begin() + intersection.firstRoad;
+        intersection.firstRoad = static_cast<uint32_t>(mainIntersectionRoads.size());
+        for (auto iterator = roadsBegin; iterator != roadsBegin + intersection.roadCount; iterator++)
+            mainIntersectionRoads.push_back(roadIndices[*iterator]);
+    }
+    intersections.erase(intersections.begin() + intersectionCount, intersections.end());
+    intersectionRoads = std::move(mainIntersectionRoads);
+
+    for (NodeIndex node : roadNodes)
+        usedNodes[node] = true;
+
+    const std::vector<NodeIndex> newIndices = nodes.removeUnused(usedNodes);
+    for (NodeIndex& node : roadNodes.edit())
+        node = newIndices[node];
+    for (NodeIndex& node : shapeNodes.edit())
+        node = newIndices[node];
+    for (Intersection& intersection : intersections)
+        intersection.node = newIndices[intersection.node];
+
+    setIntersectionConnections();
+
+    // the sources of the removed roads are dropped, all parts of a source are in the same network
+    if (incrementalUpdates && ownsIncrementalState()) {
+        for (auto iterator = incrementalState->sourceRoads.begin(); iterator != incrementalState->sourceRoads.end();) {
+            const auto parts = incrementalState->sourceRoadParts.find(iterator->first);
+            if (parts != incrementalState->sourceRoadParts.end() && findRoad(parts->second.front()) != Road::NO_ROAD) {
+                for (NodeIndex& node : iterator->second.nodes)
+                    node = newIndices[node];
+                iterator++;
+                continue;
+            }
+            if (parts != incrementalState->sourceRoadParts.end()) {
+                for (uint64_t roadId : parts->second)
+                    incrementalState->roadSources.erase(roadId);
+                incrementalState->sourceRoadParts.erase(parts);
+            }
+            iterator = incrementalState->sourceRoads.erase(iterator);
+        }
+        countRoadNodes(incrementalState->sourceRoads);
     }
 
-    const std::size_t mainNetworkNodeCount = NetworkFinder::getNetworkNodeCount(mainNetwork);
     const float remainingNodesPercent = static_cast<float>(mainNetworkNodeCount) / static_cast<float>(totalNodeCount) * 100.0f;
     std::cout << "Nodes removed: " << totalNodeCount - mainNetworkNodeCount << " (" << 100.0f - remainingNodesPercent << "%)\n";
 
     if (remainingNodesPercent < 0.66f) {
-        std::cerr << "Mpa - Warning: More then 1/3 of nodes removed from main network. Maybe there is a problem.\n";
+        std::cerr << "Mpa - Warning: More then 1/3 of nodes removed from main network. Maybe there is a problem." << std::endl;
     }
 
-    map->analyseRoadNetwork();
+    networkFinder = std::unique_ptr<NetworkFinder>(new NetworkFinder(*this, threadCount));
+    networkFinder->generateNetworks();
 
-    return map;
+    version++;
 }
 
-void Map::findIntersections() {
+/*
+ * Only the roads made of changed source roads are split and fused again.
+ * Unchanged roads ending at the new roads are taken into the fusion, so
+ * that the result is the same as analysing the whole map again. Only the
+ * replaced roads and their intersections are changed in the tables.
+ */
+void Map::applyChange(const MapChange& change) {
 
-    // all road nodes
-    std::map<uint64_t, Intersection> allRoadNodes;
-    for (auto& [roadId, road] : roads) {
-        for (const Node& node : road.getNodes()) {
-            Intersection intersection(node);
-            auto [intersectionIterator, success] = allRoadNodes.insert({node.getId(), intersection});
-            intersectionIterator->second.addRoad(road);
+    if (!incrementalUpdates || !networkFinder) {
+        std::cerr << "Map - Error: Changes can only be applied to an analysed map with incremental updates enabled" << std::endl;
+        return;
+    }
+
+    if (!ownsIncrementalState()) {
+        std::cerr << "Map - Error: Changes can only be applied to the last copy of the map" << std::endl;
+        return;
+    }
+
+    // new nodes are sorted into the node table first, this changes the node indices
+    std::map<uint64_t, std::pair<double, double>> newNodes;
+    for (const MapChange::NodeUpdate& update : change.updatedNodes) {
+        if (nodes.find(update.id) == NodeTable::NOT_FOUND)
+            newNodes.insert_or_assign(update.id, std::pair<double, double>(update.latitude, update.longitude));
+    }
+    for (const auto& [id, position] : newNodes) {
+        addNode(id, position.first, position.second);
+    }
+    sortById();
+
+    std::set<uint64_t> changedSources;
+
+    const auto addSourceRoadsOfNode = [this, &changedSources](NodeIndex node) {
+        if (auto iterator = incrementalState->nodeSourceRoads.find(node); iterator != incrementalState->nodeSourceRoads.end())
+            changedSources.insert(iterator->second.begin(), iterator->second.end());
+    };
+
+    // deleted nodes are kept, buildings might still use them
+    for (const MapChange::NodeUpdate& update : change.updatedNodes) {
+        const NodeIndex node = nodes.find(update.id);
+        if (nodes.setPosition(node, update.latitude, update.longitude) || newNodes.contains(update.id)) {
+            idHandler.updateUsedIds(update.id);
+            addSourceRoadsOfNode(node);
         }
     }
 
-    // find intersections with multiple roads
-    for (const auto& [id, intersection] : allRoadNodes) {
-        if (intersection.getRoadCount() > 1) {
-            intersections.insert({id, intersection});
+    const auto removeSourceRoad = [this, &changedSources, &addSourceRoadsOfNode](uint64_t roadId) {
+        const auto iterator = incrementalState->sourceRoads.find(roadId);
+        if (iterator == incrementalState->sourceRoads.end())
+            return;
+        changedSources.insert(roadId);
+        for (NodeIndex node : iterator->second.nodes) {
+            addSourceRoadsOfNode(node);
+            std::vector<uint64_t>& roadIds = incrementalState->nodeSourceRoads[node];
+            roadIds.erase(std::find(roadIds.begin(), roadIds.end(), roadId));
+            if (roadIds.empty())
+                incrementalState->nodeSourceRoads.erase(node);
+        }
+        incrementalState->sourceRoads.erase(iterator);
+    };
+
+    for (uint64_t roadId : change.deletedRoads) {
+        removeSourceRoad(roadId);
+    }
+
+    for (const MapChange::RoadUpdate& update : change.updatedRoads) {
+
+        removeSourceRoad(update.id);
+
+        std::vector<NodeIndex> roadNodes;
+        for (uint64_t nodeId : update.nodeIds) {
+            if (const NodeIndex node = nodes.find(nodeId); node != NodeTable::NOT_FOUND) {
+                roadNodes.push_back(node);
+            } else {
+                std::cerr << "Map - Error: Unable to find node '" << nodeId << "' of changed road: " << update.id << std::endl;
+            }
+        }
+
+        if (roadNodes.size() < 2)
+            continue;
+
+        incrementalState->sourceRoads.insert({update.id, RoadEntry{roadNames.add(update.name), update.type, roadNodes}});
+        idHandler.updateUsedIds(update.id);
+
+        changedSources.insert(update.id);
+        for (NodeIndex node : roadNodes) {
+            addSourceRoadsOfNode(node);
+            incrementalState->nodeSourceRoads[node].push_back(update.id);
+        }
+    }
+
+    // all parts of the changed source roads and all sources of these parts are analysed again
+    std::set<uint64_t> sources;
+    std::set<uint64_t> removedRoads;
+    std::vector<uint64_t> openSources(changedSources.begin(), changedSources.end());
+    sources.insert(changedSources.begin(), changedSources.end());
+
+    while (!openSources.empty()) {
+        const uint64_t sourceId = openSources.back();
+        openSources.pop_back();
+        for (uint64_t roadId : incrementalState->sourceRoadParts[sourceId]) {
+            if (!removedRoads.insert(roadId).second)
+                continue;
+            for (uint64_t partSourceId : incrementalState->roadSources[roadId]) {
+                if (sources.insert(partSourceId).second)
+                    openSources.push_back(partSourceId);
+            }
+        }
+    }
+
+    RoadEntries sourceSubset;
+    for (uint64_t sourceId : sources) {
+        if (auto iterator = incrementalState->sourceRoads.find(sourceId); iterator != incrementalState->sourceRoads.end())
+            sourceSubset.insert(*iterator);
+    }
+
+    for (uint64_t roadId : removedRoads) {
+        incrementalState->roadSources.erase(roadId);
+    }
+
+    RoadEntries newRoads;
+    splitRoadsOnIntersections(sourceSubset, newRoads);
+
+    // unchanged roads at the ends of the new roads are needed for the fusion
+    std::set<NodeIndex> fusableNodes;
+    std::set<uint64_t> neighbourRoads;
+    for (const auto& [id, road] : newRoads) {
+        for (NodeIndex node : {road.nodes.front(), road.nodes.back()}) {
+            fusableNodes.insert(node);
+            if (const IntersectionIndex intersection = findIntersection(node); intersection != Road::NO_INTERSECTION) {
+                for (const Road& neighbour : intersections[intersection].getRoads()) {
+                    if (!removedRoads.contains(neighbour.getId()))
+                        neighbourRoads.insert(neighbour.getId());
+                }
+            }
+        }
+    }
+
+    for (uint64_t roadId : neighbourRoads) {
+        newRoads.insert({roadId, getRoadEntry(roads[findRoad(roadId)])});
+    }
+    removedRoads.insert(neighbourRoads.begin(), neighbourRoads.end());
+
+    IntersectionEntries newIntersections;
+    findIntersections(newRoads, newIntersections);
+    fuseRoads(newRoads, newIntersections, [&fusableNodes](NodeIndex node) { return fusableNodes.contains(node); });
+
+    // the parts of the sources are the new roads and the roads that are not replaced
+    const auto isRemaining = [this, &newRoads, &removedRoads](uint64_t roadId) {
+        return newRoads.contains(roadId) || (!removedRoads.contains(roadId) && findRoad(roadId) != Road::NO_ROAD);
+    };
+
+    std::set<uint64_t> partSources = sources;
+    for (const auto& [id, road] : newRoads) {
+        partSources.insert(incrementalState->roadSources[id].begin(), incrementalState->roadSources[id].end());
+    }
+
+    for (uint64_t sourceId : partSources) {
+        std::erase_if(incrementalState->sourceRoadParts[sourceId], [&isRemaining](uint64_t roadId) { return !isRemaining(roadId); });
+    }
+    for (const auto& [id, road] : newRoads) {
+        for (uint64_t sourceId : incrementalState->roadSources[id]) {
+            std::vector<uint64_t>& parts = incrementalState->sourceRoadParts[sourceId];
+            if (std::find(parts.begin(), parts.end(), id) == parts.end())
+                parts.push_back(id);
         }
     }
+    for (uint64_t sourceId : partSources) {
+        if (incrementalState->sourceRoadParts[sourceId].empty())
+            incrementalState->sourceRoadParts.erase(sourceId);
+    }
+
+    replaceRoads(removedRoads, newRoads);
+
+    std::cout << "Map - Changed roads: " << removedRoads.size() << " removed, " << newRoads.size() << " added" << std::endl;
+
+    version++;
 }
 
-void printRoad(const Road& road) {
-    std::cout << road.getName() << "\n";
-    for (const Node& node : road.getNodes()) {
-        std::cout << node.getId() << "\n";
+/*
+ * The removed roads are taken out of the id ordered roads in place and the
+ * new roads are merged in, their nodes are appended to the road nodes. Only
+ * the intersections at the ends of the removed and the new roads get new road
+ * lists, the lists of all other intersections are remapped. Like after the
+ * analysis every road is listed once per end ordered by id and then again,
+ * unless it is the only road at the intersection.
+ *
+ * The lengths of the new roads are measured and the networks are updated
+ * around the changed roads. The connections reference the moved roads and
+ * intersections, so they are set again.
+ */
+void Map::replaceRoads(const std::set<uint64_t>& removedRoadIds, const RoadEntries& newRoads) {
+
+    constexpr uint32_t REMOVED = std::numeric_limits<uint32_t>::max();
+
+    // the ends of the removed and the new roads
+    std::set<NodeIndex> changedNodes;
+    std::vector<std::pair<IntersectionIndex, IntersectionIndex>> removedRoadEnds;
+
+    // old index -> new index of roads and intersections
+    std::vector<RoadIndex> roadIndices(roads.size(), 0);
+    std::vector<IntersectionIndex> intersectionIndices(intersections.size(), 0);
+
+    for (uint64_t roadId : removedRoadIds) {
+        const RoadIndex index = findRoad(roadId);
+        if (index == Road::NO_ROAD)
+            continue;
+        const Road& road = roads[index];
+        changedNodes.insert(roadNodes[road.firstNode]);
+        changedNodes.insert(roadNodes[road.firstNode + road.nodeCount - 1]);
+        removedRoadEnds.emplace_back(road.startIntersection, road.endIntersection);
+        roadIndices[index] = REMOVED;
+    }
+
+    // the remaining roads are moved to the front, they are shifted by the new roads ordered before them
+    RoadIndex roadCount = 0;
+    RoadIndex newRoadsBefore = 0;
+    auto newRoad = newRoads.begin();
+    for (RoadIndex index = 0; index < roadIndices.size(); index++) {
+        if (roadIndices[index] == REMOVED)
+            continue;
+        if (roadCount != index)
+            roads[roadCount] = std::move(roads[index]);
+        for (; newRoad != newRoads.end() && newRoad->first < roads[roadCount].getId(); newRoad++)
+            newRoadsBefore++;
+        roadIndices[index] = roadCount++ + newRoadsBefore;
+    }
+    roads.erase(roads.begin() + roadCount, roads.end());
+
+    for (const auto& [id, road] : newRoads) {
+        appendRoad(id, road.name, road.type, road.nodes);
+        changedNodes.insert(road.nodes.front());
+        changedNodes.insert(road.nodes.back());
+    }
+    std::ranges::inplace_merge(roads, roads.begin() + roadCount, {}, &Road::getId);
+
+    std::vector<RoadIndex> addedRoads;
+    std::vector<bool> isAddedRoad(roads.size(), false);
+    for (const auto& [id, road] : newRoads) {
+        addedRoads.push_back(findRoad(id));
+        isAddedRoad[addedRoads.back()] = true;
+    }
+
+    // node -> roads ending at the node, once per end
+    std::map<NodeIndex, std::vector<RoadIndex>> endRoads;
+    for (RoadIndex index : addedRoads) {
+        const Road& road = roads[index];
+        endRoads[roadNodes[road.firstNode]].push_back(index);
+        endRoads[roadNodes[road.firstNode + road.nodeCount - 1]].push_back(index);
+    }
+
+    // the ends of the remaining roads still refer to the old intersections
+    for (NodeIndex node : changedNodes) {
+        const IntersectionIndex intersection = findIntersection(node);
+        if (intersection == Road::NO_INTERSECTION)
+            continue;
+        const auto roadsBegin = intersectionRoads.begin() + intersections[intersection].firstRoad;
+        const auto roadsEnd = roadsBegin + intersections[intersection].roadCount;
+        for (auto iterator = roadsBegin; iterator != roadsEnd; iterator++) {
+            if (roadIndices[*iterator] == REMOVED || std::find(roadsBegin, iterator, *iterator) != iterator)
+                continue;
+            const Road& road = roads[roadIndices[*iterator]];
+            if (road.startIntersection == intersection)
+                endRoads[node].push_back(roadIndices[*iterator]);
+            if (road.endIntersection == intersection)
+                endRoads[node].push_back(roadIndices[*iterator]);
+        }
+    }
+
+    const std::span<RoadIndex> remappedRoads = intersectionRoads.edit();
+    for (Intersection& intersection : intersections) {
+        for (RoadIndex& road : remappedRoads.subspan(intersection.firstRoad, intersection.roadCount))
+            road = roadIndices[road];
+    }
+
+    // the changed intersections get new road lists, intersections without roads are removed
+    std::vector<Intersection> newIntersections;
+    for (NodeIndex node : changedNodes) {
+
+        std::vector<RoadIndex>& nodeRoads = endRoads[node];
+        std::ranges::sort(nodeRoads);
+
+        const IntersectionIndex intersection = findIntersection(node);
+        if (intersection != Road::NO_INTERSECTION && nodeRoads.empty()) {
+            intersectionIndices[intersection] = REMOVED;
+            continue;
+        } else if (nodeRoads.empty()) {
+            continue;
+        }
+
+        const uint32_t firstRoad = static_cast<uint32_t>(intersectionRoads.size());
+        intersectionRoads.insert(intersectionRoads.end(), nodeRoads.begin(), nodeRoads.end());
+        if (nodeRoads.size() > 1)
+            intersectionRoads.insert(intersectionRoads.end(), nodeRoads.begin(), nodeRoads.end());
+        const uint32_t roadCount = static_cast<uint32_t>(intersectionRoads.size()) - firstRoad;
+
+        if (intersection != Road::NO_INTERSECTION) {
+            intersections[intersection].firstRoad = firstRoad;
+            intersections[intersection].roadCount = roadCount;
+        } else {
+            newIntersections.emplace_back(*this, node, firstRoad, roadCount);
+        }
+    }
+
+    uint32_t intersectionCount = 0;
+    auto newIntersection = newIntersections.begin();
+    for (IntersectionIndex index = 0; index < intersectionIndices.size(); index++) {
+        if (intersectionIndices[index] == REMOVED)
+            continue;
+        if (intersectionCount != index)
+            intersections[intersectionCount] = intersections[index];
+        while (newIntersection != newIntersections.end() && newIntersection->node < intersections[intersectionCount].node)
+            newIntersection++;
+        intersectionIndices[index] = intersectionCount++ + static_cast<uint32_t>(newIntersection - newIntersections.begin());
+    }
+    intersections.erase(intersections.begin() + intersectionCount, intersections.end());
+    intersections.insert(intersections.end(), newIntersections.begin(), newIntersections.end());
+    std::ranges::inplace_merge(intersections, intersections.begin() + intersectionCount, {}, [](const Intersection& intersection) { return intersection.node; });
+
+    for (RoadIndex index = 0; index < roads.size(); index++) {
+        Road& road = roads[index];
+        if (isAddedRoad[index]) {
+            road.startIntersection = findIntersection(roadNodes[road.firstNode]);
+            road.endIntersection = findIntersection(roadNodes[road.firstNode + road.nodeCount - 1]);
+            setRoadLength(road);
+        } else {
+            road.startIntersection = intersectionIndices[road.startIntersection];
+            road.endIntersection = intersectionIndices[road.endIntersection];
+        }
+    }
+
+    // the replaced ranges are dropped once they are the majority of the buffers
+    std::size_t usedRoadNodes = 0;
+    for (const Road& road : roads)
+        usedRoadNodes += road.nodeCount;
+    if (roadNodes.size() > 2 * usedRoadNodes) {
+        std::pmr::vector<NodeIndex> compactRoadNodes(getMemoryResource());
+        compactRoadNodes.reserve(usedRoadNodes);
+        for (Road& road : roads) {
+            const auto nodesBegin = roadNodes.begin() + road.firstNode;
+            road.firstNode = static_cast<uint32_t>(compactRoadNodes.size());
+            compactRoadNodes.insert(compactRoadNodes.end(), nodesBegin, nodesBegin + road.nodeCount);
+        }
+        roadNodes = std::move(compactRoadNodes);
+    }
+
+    std::size_t usedIntersectionRoads = 0;
+    for (const Intersection& intersection : intersections)
+        usedIntersectionRoads += intersection.roadCount;
+    if (intersectionRoads.size() > 2 * usedIntersectionRoads) {
+        std::pmr::vector<RoadIndex> compactIntersectionRoads(getMemoryResource());
+        compactIntersectionRoads.reserve(usedIntersectionRoads);
+        for (Intersection& intersection : intersections) {
+            const auto roadsBegin = intersectionRoads.begin() + intersection.firstRoad;
+            intersection.firstRoad = static_cast<uint32_t>(compactIntersectionRoads.size());
+            compactIntersectionRoads.insert(compactIntersectionRoads.end(), roadsBegin, roadsBegin + intersection.roadCount);
+        }
+        intersectionRoads = std::move(compactIntersectionRoads);
+    }
+
+    setIntersectionConnections();
+
+    // REMOVED is the same as Road::NO_INTERSECTION
+    networkFinder->updateNetworks(intersectionIndices, removedRoadEnds, addedRoads);
+}
+
+void Map::countRoadNodes(const RoadEntries& roads) {
+
+    incrementalState->nodeSourceRoads.clear();
+
+    for (const auto& [roadId, road] : roads) {
+        for (NodeIndex node : road.nodes) {
+            incrementalState->nodeSourceRoads[node].push_back(roadId);
+        }
     }
-    std::cout << std::endl;
 }
 
-void Map::splitRoadsOnIntersections () {
+bool Map::isIntersectionNode(NodeIndex node) const {
+    // nodes used more than once, also by the same road
+    const auto iterator = incrementalState->nodeSourceRoads.find(node);
+    return iterator != incrementalState->nodeSourceRoads.end() && iterator->second.size() > 1;
+}
 
-    std::map<uint64_t, Road> newRoads;
+void Map::findIntersections(const RoadEntries& roads, IntersectionEntries& intersections) {
+
+    // all road nodes
+    IntersectionEntries allRoadNodes;
+    for (const auto& [roadId, road] : roads) {
+        for (NodeIndex node : road.nodes) {
+            allRoadNodes[node].push_back(roadId);
+        }
+    }
+
+    // find intersections with multiple roads
+    for (auto& [node, roadIds] : allRoadNodes) {
+        if (roadIds.size() > 1) {
+            intersections.insert({node, std::move(roadIds)});
+        }
+    }
+}
+
+void Map::splitRoadsOnIntersections(const RoadEntries& roads, RoadEntries& newRoads) {
 
     // iterate over all roads
     for (const auto& [id, road] : roads) {
 
         // iterate over all nodes in the road except the first and the last
-        const std::vector<std::reference_wrapper<const Node>>& nodes = road.getNodes();
+        const std::vector<NodeIndex>& nodes = road.nodes;
         auto lastIntersection = nodes.begin();
         for (auto nodeIter = nodes.begin() + 1; nodeIter != nodes.end() - 1; nodeIter++) {
 
             // check if node is intersection
-            if (intersections.contains(nodeIter->get().getId())) {
+            if (isIntersectionNode(*nodeIter)) {
 
                 // create new road from previous intersection to current intersection
-                Road newRoad(idHandler.getNewId(), road.getName(), road.getType());
-                newRoad.setNodes({lastIntersection, nodeIter + 1});
-                const auto [iter, success] = newRoads.insert({newRoad.getId(), newRoad});
+                const uint64_t newRoadId = idHandler.getNewId();
+                const auto [iter, success] = newRoads.insert({newRoadId, RoadEntry{road.name, road.type, {lastIntersection, nodeIter + 1}}});
                 if (!success)
-                    std::cerr << "Map - Unable to insert new road: " << newRoad.getName() << " - " << newRoad.getId() << std::endl;
+                    std::cerr << "Map - Unable to insert new road: " << roadNames.get(road.name) << " - " << newRoadId << std::endl;
+                incrementalState->roadSources[newRoadId] = {id};
                 lastIntersection = nodeIter;
             }
         }
 
         // create new road for last part of the road
-        Road newRoad(road.getId(), road.getName(), road.getType());
-        newRoad.setNodes({lastIntersection, nodes.end()});
-        const auto [iter, success] = newRoads.insert({newRoad.getId(), newRoad});
+        const auto [iter, success] = newRoads.insert({id, RoadEntry{road.name, road.type, {lastIntersection, nodes.end()}}});
         if (!success)
-            std::cerr << "Map - Unable to insert new road: " << newRoad.getName() << " - " << newRoad.getId() << std::endl;
+            std::cerr << "Map - Unable to insert new road: " << roadNames.get(road.name) << " - " << id << std::endl;
+        incrementalState->roadSources[id] = {id};
     }
-
-    // because of new roads the intersections are no longer valid
-    intersections.clear();
-    roads = newRoads;
 }
 
 /*
  * Remove intersections that have exactly two connected roads
  */
-void Map::fuseRoads() {
+void Map::fuseRoads(RoadEntries& roads, IntersectionEntries& intersections, const std::function<bool(NodeIndex)>& canFuse) {
 
     // iterate over all intersections
-    for (auto& [id, intersection] : intersections) {
-        if (intersection.getRoadCount() == 2) {
+    for (auto& [node, intersection] : intersections) {
+        if (intersection.size() == 2 && canFuse(node)) {
+
+            const uint64_t road1Id = intersection.at(0);
+            const uint64_t road2Id = intersection.at(1);
 
-            const Road& road1 = intersection.getRoads().at(0);
-            const Road& road2 = intersection.getRoads().at(1);
+            const RoadEntry& road1 = roads.at(road1Id);
+            const RoadEntry& road2 = roads.at(road2Id);
 
-            if (road1.getId() != road2.getId() &&
-                road1.getType() == road2.getType() &&
-                road1.getName() == road2.getName()) {
+            if (road1Id != road2Id &&
+                road1.type == road2.type &&
+                road1.name == road2.name) {
 
                 // create one new road
-                Road newRoad = connectRoads(road1, road2);
+                const uint64_t newRoadId = idHandler.getNewId();
 
-                const auto& [newRoadIter, success] = roads.insert({newRoad.getId(), newRoad});
+                const auto& [newRoadIter, success] = roads.insert({newRoadId, connectRoads(roads, road1Id, road2Id)});
                 if (!success)
                     std::cerr << "Map - Failed to create new road" << std::endl;
 
+                std::vector<uint64_t>& sources = incrementalState->roadSources[newRoadId];
+                sources = incrementalState->roadSources[road1Id];
+                sources.insert(sources.end(), incrementalState->roadSources[road2Id].begin(), incrementalState->roadSources[road2Id].end());
+                incrementalState->roadSources.erase(road1Id);
+                incrementalState->roadSources.erase(road2Id);
+
                 // replace road 1 on the other intersection
-                uint64_t intersection1Id = road1.getNodes().back().get().getId() == intersection.getId() ?
-                    road1.getNodes().front().get().getId() : road1.getNodes().back().get().getId();
-                if (auto findInter = intersections.find(intersection1Id); findInter != intersections.end()) {
-                    findInter->second.removeRoad(road1.getId());
-                    findInter->second.addRoad(newRoadIter->second);
+                const NodeIndex intersection1 = road1.nodes.back() == node ? road1.nodes.front() : road1.nodes.back();
+                if (auto findInter = intersections.find(intersection1); findInter != intersections.end()) {
+                    std::erase(findInter->second, road1Id);
+                    findInter->second.push_back(newRoadId);
                 }
 
                 // replace road 2 on the other intersection
-                uint64_t intersection2Id = road2.getNodes().back().get().getId() == intersection.getId() ?
-                    road2.getNodes().front().get().getId() : road2.getNodes().back().get().getId();
-                if (auto findInter = intersections.find(intersection2Id); findInter != intersections.end()) {
-                    findInter->second.removeRoad(road2.getId());
-                    findInter->second.addRoad(newRoadIter->second);
+                const NodeIndex intersection2 = road2.nodes.back() == node ? road2.nodes.front() : road2.nodes.back();
+                if (auto findInter = intersections.find(intersection2); findInter != intersections.end()) {
+                    std::erase(findInter->second, road2Id);
+                    findInter->second.push_back(newRoadId);
                 }
 
                 // remove roads from map
-                roads.erase(road1.getId());
-                roads.erase(road2.getId());
+                roads.erase(road1Id);
+                roads.erase(road2Id);
 
-                intersection.removeRoad(road1.getId());
-                intersection.removeRoad(road2.getId());
+                std::erase(intersection, road1Id);
+                std::erase(intersection, road2Id);
             }
         }
     }
 
     // remove intersections with no roads
-    for (auto iter = intersections.begin(); iter != intersections.end();) {
-        if (iter->second.getRoadCount() == 0) {
-            iter = intersections.erase(iter);
-        } else {
-            iter++;
-        }
-    }
+    std::erase_if(intersections, [](const auto& entry) { return entry.second.empty(); });
 }
 
-Road Map::connectRoads(const Road& road1, const Road& road2) {
+Map::RoadEntry Map::connectRoads(const RoadEntries& roads, uint64_t road1Id, uint64_t road2Id) {
 
-    Road road(idHandler.getNewId(), road1.getName(), road1.getType());
+    const RoadEntry& road1 = roads.at(road1Id);
+    const RoadEntry& road2 = roads.at(road2Id);
 
-    std::vector<std::reference_wrapper<const Node>> newNodes;
-    newNodes.reserve(road1.getNodes().size() + road2.getNodes().size() - 1);
+    RoadEntry road{road1.name, road1.type, {}};
 
-    if (road1.getNodes().front().get().getId() == road2.getNodes().front().get().getId()) {
-        newNodes.insert(newNodes.end(), road1.getNodes().rbegin(), road1.getNodes().rend() - 1);
-        newNodes.insert(newNodes.end(), road2.getNodes().begin(), road2.getNodes().end());
-    } else if (road1.getNodes().front().get().getId() == road2.getNodes().back().get().getId()) {
-        newNodes.insert(newNodes.end(), road1.getNodes().rbegin(), road1.getNodes().rend());
-        newNodes.insert(newNodes.end(), road2.getNodes().rbegin() + 1, road2.getNodes().rend());
-    } else if (road1.getNodes().back().get().getId() == road2.getNodes().front().get().getId()) {
-        newNodes.insert(newNodes.end(), road1.getNodes().begin(), road1.getNodes().end());
-        newNodes.insert(newNodes.end(), road2.getNodes().begin() + 1, road2.getNodes().end());
-    } else if (road1.getNodes().back().get().getId() == road2.getNodes().back().get().getId()) {
-        newNodes.insert(newNodes.end(), road1.getNodes().begin(), road1.getNodes().end());
-        newNodes.insert(newNodes.end(), road2.getNodes().rbegin() + 1, road2.getNodes().rend());
+    const std::vector<NodeIndex>& nodes1 = road1.nodes;
+    const std::vector<NodeIndex>& nodes2 = road2.nodes;
+
+    std::vector<NodeIndex>& newNodes = road.nodes;
+    newNodes.reserve(nodes1.size() + nodes2.size() - 1);
+
+    if (nodes1.front() == nodes2.front()) {
+        newNodes.insert(newNodes.end(), nodes1.rbegin(), nodes1.rend() - 1);
+        newNodes.insert(newNodes.end(), nodes2.begin(), nodes2.end());
+    } else if (nodes1.front() == nodes2.back()) {
+        newNodes.insert(newNodes.end(), nodes1.rbegin(), nodes1.rend());
+        newNodes.insert(newNodes.end(), nodes2.rbegin() + 1, nodes2.rend());
+    } else if (nodes1.back() == nodes2.front()) {
+        newNodes.insert(newNodes.end(), nodes1.begin(), nodes1.end());
+        newNodes.insert(newNodes.end(), nodes2.begin() + 1, nodes2.end());
+    } else if (nodes1.back() == nodes2.back()) {
+        newNodes.insert(newNodes.end(), nodes1.begin(), nodes1.end());
+        newNodes.insert(newNodes.end(), nodes2.rbegin() + 1, nodes2.rend());
     } else {
-        std::cerr << "Map - Error: unable to connect roads: " << road1.getId() << " and " << road2.getId() << std::endl;
+        std::cerr << "Map - Error: unable to connect roads: " << road1Id << " and " << road2Id << std::endl;
     }
 
-    road.setNodes(newNodes);
-
     return road;
 }
-
-/*
- * Set intersections at the end of roads. If the end of a road has no intersection
- * because there are no other roads connected, create a new intersection.
- */
-void Map::setIntersectionsToEndOfRoads() {
-
-    // iterate over all roads
-    for (auto& [id, road] : roads) {
-
-        // check if the road has an intersection at the beginning
-        const Node& startNode = road.getStartNode();
-        if (auto interIter = intersections.find(startNode.getId()); interIter == intersections.end()) {
-            const auto [iter, success] = intersections.insert({startNode.getId(), Intersection(startNode)});
-            iter->second.addRoad(road);
-            road.setEndPoint(&iter->second);
-        } else {
-            interIter->second.addRoad(road);
-            road.setEndPoint(&interIter->second);
-        }
-
-        // check if the road has an intersection at the end
-        const Node& endNode = road.getEndNode();
-        if (auto interIter = intersections.find(endNode.getId()); interIter == intersections.end()) {
-            const auto [iter, success] = intersections.insert({endNode.getId(), Intersection(endNode)});
-            iter->second.addRoad(road);
-            road.setEndPoint(&iter->second);
-        } else {
-            interIter->second.addRoad(road);
-            road.setEndPoint(&interIter->second);
-        }
-    }
-}
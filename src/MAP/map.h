@@ -6,53 +6,190 @@
 #include "intersection.h"
 #include "idhandler.h"
 #include "networkfinder.h"
+#include "nodetable.h"
+#include "stringpool.h"
+#include "mapchange.h"
+#include "memoryreport.h"
+#include "sharedvector.h"
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include <functional>
+#include <ostream>
+#include <set>
+#include <span>
 
 namespace AStarCities {
 
+    /*
+     * All entities are stored in contiguous vectors sorted by id. Nodes are kept
+     * in a node table, roads and building shapes are ranges of node indices in
+     * shared buffers and intersections are ranges of road indices.
+     *
+     * The tables, road names and network labels are allocated from the memory
+     * resource of the map, so a whole map can live in a few arenas. The resource
+     * must outlive the map and is only used by the thread building the map. The
+     * tables without references to entities can also be borrowed from a mapped
+     * snapshot, they are copied into the resource when they are changed.
+     *
+     * A copy made by clone shares these tables with the map until it changes
+     * them, so a changed copy only allocates the tables it has changed. A shared
+     * resource is kept alive by the tables allocated from it.
+     */
     class Map {
 
         public:
 
-            Map() = default;
+            Map(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+            Map(std::shared_ptr<std::pmr::memory_resource> resource);
             virtual ~Map() = default;
 
+            Map(const Map&) = delete;
+            Map& operator=(const Map&) = delete;
+
+            // copy of the map allocated from the resource, a resource of nullptr uses the default resource,
+            // the copy takes over the source roads, so only the copy can apply changes afterwards
+            [[nodiscard]] std::unique_ptr<Map> clone(std::shared_ptr<std::pmr::memory_resource> resource = nullptr) const;
+
             void setReferenceResolution(uint32_t width, uint32_t height);
             void setGlobalBounds(double minlat, double maxlat, double minlon, double maxlon);
 
-            [[nodiscard]] const std::map<uint64_t, Node>&         getNodes()         const noexcept { return nodes; }
-            [[nodiscard]] const std::map<uint64_t, Road>&         getRoads()         const noexcept { return roads; }
-            [[nodiscard]] const std::map<uint64_t, Building>&     getBuildings()     const noexcept { return buildings; }
-            [[nodiscard]] const std::map<uint64_t, Intersection>& getIntersections() const noexcept { return intersections; }
+            [[nodiscard]] std::size_t getNodeCount() const noexcept { return nodes.size(); }
+            [[nodiscard]] Node getNode(NodeIndex index) const { return Node(*this, index); }
+
+            [[nodiscard]] std::span<const Road>         getRoads()         const noexcept { return roads; }
+            [[nodiscard]] std::span<const Building>     getBuildings()     const noexcept { return buildings; }
+            [[nodiscard]] std::span<const Intersection> getIntersections() const noexcept { return intersections; }
+
+            [[nodiscard]] std::pmr::memory_resource* getMemoryResource() const noexcept { return memoryResource.get(); }
+
+            // keeps the resource alive if the map owns it
+            [[nodiscard]] const std::shared_ptr<std::pmr::memory_resource>& getSharedMemoryResource() const noexcept { return memoryResource; }
 
             [[nodiscard]] double getLocalWidth()  const noexcept { return localWidth; }
             [[nodiscard]] double getLocalHeight() const noexcept { return localHeight; }
 
+            NodeIndex addNode(uint64_t id, double latitude, double longitude);
+            std::vector<NodeIndex> addNodes(const NodeTable& table, const std::vector<NodeTable::Index>& indices);
+
+            void addRoad(uint64_t id, std::string_view name, RoadType type, const std::vector<NodeIndex>& nodes);
             void addRoad(const Road& road);
-            void addBuilding(const Building& building);
+
+            void addBuilding(uint64_t id, BuildingType type, const std::vector<NodeIndex>& nodes,
+                             const std::vector<std::vector<NodeIndex>>& innerShapes = {});
+
+            // must be called after adding nodes, roads or buildings and before the first lookup,
+            // duplicated nodes are merged and the node indices of roads and buildings are updated
+            void sortById();
+
+            [[nodiscard]] uint64_t getNewId() { return idHandler.getNewId(); }
+
+            // threads used by the road network analysis, 0 uses all hardware threads,
+            // the analysed map is the same for every thread count
+            void setThreadCount(uint32_t count) { threadCount = count; }
 
             void analyseRoadNetwork();
 
-            std::unique_ptr<Map> getMainNetwork() const;
+            // keep the source roads after the analysis, needed for applyChange
+            void setIncrementalUpdates(bool enabled) { incrementalUpdates = enabled; }
+
+            // update the analysed road network with the changes of an osm change file
+            void applyChange(const MapChange& change);
+
+            // remove all roads and intersections that are not part of the largest road network,
+            // later changes do not bring back the roads of the other networks
+            void keepMainNetwork();
+
+            // incremented whenever the roads, intersections or nodes change, references to
+            // entities and indices taken from an older version must not be used anymore
+            [[nodiscard]] uint64_t getVersion() const noexcept { return version; }
+
+            // allocated bytes and element count of every table, the source roads are only measured
+            // by the map that owns them and must not be measured while a copy is made or changed
+            [[nodiscard]] std::vector<MemoryReport::Usage> getMemoryUsage() const;
+
+            // compares the nodes, roads, buildings, intersections and network labels by value,
+            // prints the first differences and returns the number of differences
+            std::size_t printDifferences(const Map& other, std::ostream& stream, std::size_t maxPrinted = 10) const;
 
         private:
 
+            friend class Node;
+            friend class Road;
+            friend class Building;
+            friend class Intersection;
+            friend class MapSnapshot;
+            friend class TopologyBuilder;
+
+            struct Shape {
+                uint32_t firstNode;
+                uint32_t nodeCount;
+            };
+
+            // editable roads and intersections used while analysing the road network
+            struct RoadEntry {
+                StringPool::Id name;
+                RoadType type;
+                std::vector<NodeIndex> nodes;
+            };
+
+            using RoadEntries = std::map<uint64_t, RoadEntry>;
+            using IntersectionEntries = std::map<NodeIndex, std::vector<uint64_t>>;
+
+            // the roads before the analysis and which analysed roads are made of them,
+            // a copy of the map takes them over instead of copying them
+            struct IncrementalState {
+
+                // node -> roads using the node, counted before the roads are split
+                std::map<NodeIndex, std::vector<uint64_t>> nodeSourceRoads;
+
+                RoadEntries sourceRoads;
+                std::map<uint64_t, std::vector<uint64_t>> roadSources;
+                std::map<uint64_t, std::vector<uint64_t>> sourceRoadParts;
+
+                // the map the state belongs to, the last copy that took it over
+                std::atomic<const Map*> owner = nullptr;
+            };
+
+            [[nodiscard]] bool ownsIncrementalState() const noexcept { return incrementalState->owner.load(std::memory_order_acquire) == this; }
+
             [[nodiscard]] double getGlobalWidth()  const noexcept { return maxLongitude - minLongitude; }
             [[nodiscard]] double getGlobalHeight() const noexcept { return maxLatitude  - minLatitude;  }
 
-            [[nodiscard]] std::pair<double, double> globalPosToLocal(std::pair<double, double> globalPos);
+            [[nodiscard]] std::pair<double, double> globalPosToLocal(std::pair<double, double> globalPos) const;
+            [[nodiscard]] std::pair<double, double> getLocalPosition(NodeIndex index) const;
+
+            // must be called after the road nodes or node positions have changed
+            void setRoadLengths();
+            void setRoadLength(Road& road);
+
+            void appendRoad(uint64_t id, StringPool::Id name, RoadType type, std::span<const NodeIndex> nodes);
+
+            // the index of the road or intersection, Road::NO_ROAD or Road::NO_INTERSECTION if there is none
+            [[nodiscard]] RoadIndex findRoad(uint64_t id) const;
+            [[nodiscard]] IntersectionIndex findIntersection(NodeIndex node) const;
+
+            [[nodiscard]] RoadEntries getRoadEntries() const;
+            [[nodiscard]] RoadEntry getRoadEntry(const Road& road) const;
+
+            // replaces roads of the analysed road network in place
+            void replaceRoads(const std::set<uint64_t>& removedRoadIds, const RoadEntries& newRoads);
+
+            // must be called after the roads or intersections have changed
+            void setIntersectionConnections();
 
-            std::vector<std::reference_wrapper<const Node>> addNodes(const std::vector<std::reference_wrapper<const Node>>& nodes);
-            const Node* addNode(const Node& node);
+            void countRoadNodes(const RoadEntries& roads);
+            [[nodiscard]] bool isIntersectionNode(NodeIndex node) const;
 
-            void findIntersections();
-            void splitRoadsOnIntersections();
-            void fuseRoads();
-            void setIntersectionsToEndOfRoads();
+            static void findIntersections(const RoadEntries& roads, IntersectionEntries& intersections);
+            void splitRoadsOnIntersections(const RoadEntries& roads, RoadEntries& newRoads);
+            void fuseRoads(RoadEntries& roads, IntersectionEntries& intersections, const std::function<bool(NodeIndex)>& canFuse);
 
-            [[nodiscard]] Road connectRoads(const Road& road1, const Road& road2);
+            [[nodiscard]] static RoadEntry connectRoads(const RoadEntries& roads, uint64_t road1Id, uint64_t road2Id);
+
+            std::shared_ptr<std::pmr::memory_resource> memoryResource;
 
             IdHandler idHandler;
 
@@ -69,10 +206,29 @@ namespace AStarCities {
             uint32_t refWidth = 1600;
             uint32_t refHeight = 900;
 
-            std::map<uint64_t, Node> nodes;
-            std::map<uint64_t, Road> roads;
-            std::map<uint64_t, Building> buildings;
-            std::map<uint64_t, Intersection> intersections;
+            uint32_t threadCount = 0;
+
+            uint64_t version = 0;
+
+            NodeTable nodes;
+
+            std::pmr::vector<Road> roads;
+            SharedVector<NodeIndex> roadNodes;
+
+            // every road name is stored once, roads with the same name share its id
+            StringPool roadNames;
+
+            std::pmr::vector<Building> buildings;
+            SharedVector<Shape> shapes;
+            SharedVector<NodeIndex> shapeNodes;
+
+            std::pmr::vector<Intersection> intersections;
+            SharedVector<RoadIndex> intersectionRoads;
+            std::pmr::vector<Intersection::Connection> connections;
+
+            bool incrementalUpdates = false;
+
+            std::shared_ptr<IncrementalState> incrementalState;
 
     };
 }
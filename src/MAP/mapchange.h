@@ -0,0 +1,40 @@
+#pragma once
+
+#include "roadtype.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace AStarCities {
+
+    /*
+     * Changes of nodes and roads read from an osm change file (.osc).
+     * Created and modified elements are both handled as updates.
+     */
+    struct MapChange {
+
+        struct NodeUpdate {
+            uint64_t id;
+            double latitude;
+            double longitude;
+        };
+
+        struct RoadUpdate {
+            uint64_t id;
+            std::string name;
+            RoadType type;
+            std::vector<uint64_t> nodeIds;
+        };
+
+        [[nodiscard]] bool isEmpty() const noexcept {
+            return updatedNodes.empty() && deletedNodes.empty() && updatedRoads.empty() && deletedRoads.empty();
+        }
+
+        std::vector<NodeUpdate> updatedNodes;
+        std::vector<uint64_t> deletedNodes;
+
+        std::vector<RoadUpdate> updatedRoads;
+        std::vector<uint64_t> deletedRoads;
+    };
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace AStarCities {
+
+    /*
+     * Read only memory mapping of a whole file.
+     */
+    class MappedFile {
+
+        public:
+
+            MappedFile(const std::string& filePath);
+            virtual ~MappedFile();
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            [[nodiscard]] bool isOpen() const noexcept { return data != nullptr; }
+
+            [[nodiscard]] const char* getData() const noexcept { return data; }
+            [[nodiscard]] std::size_t getSize() const noexcept { return size; }
+
+        private:
+
+            const char* data = nullptr;
+            std::size_t size = 0;
+
+#ifdef _WIN32
+            void* fileHandle = nullptr;
+            void* mappingHandle = nullptr;
+#else
+            int fileDescriptor = -1;
+#endif
+    };
+}
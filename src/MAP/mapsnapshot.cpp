@@ -0,0 +1,389 @@
+
+#include "mapsnapshot.h"
+#include "mappedfile.h"
+#include "map.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <type_traits>
+
+using namespace AStarCities;
+
+static constexpr std::array<char, 8> MAGIC = {'A', 'S', 'C', 'M', 'A', 'P', '\0', '\0'};
+
+struct Section {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct Header {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t fileSize;
+    uint64_t sourceHash;
+    uint64_t checksum;
+    uint32_t refWidth;
+    uint32_t refHeight;
+    double minLatitude;
+    double maxLatitude;
+    double minLongitude;
+    double maxLongitude;
+    Section nodeIds;
+    Section nodeLatitudes;
+    Section nodeLongitudes;
+    Section roads;
+    Section roadNodes;
+    Section intersections;
+    Section intersectionRoads;
+    Section connections;
+    Section networkIndices;
+    Section networkSizes;
+    Section buildings;
+    Section shapes;
+    Section shapeNodes;
+    Section names;
+    Section nameCharacters;
+    Section nameSlots;
+};
+
+// the end intersections and the length are stored, so the road network is not analysed again
+struct RoadRecord {
+    uint64_t id;
+    uint32_t type;
+    uint32_t name;
+    uint32_t firstNode;
+    uint32_t nodeCount;
+    uint32_t startIntersection;
+    uint32_t endIntersection;
+    double length;
+};
+
+struct IntersectionRecord {
+    uint32_t node;
+    uint32_t firstRoad;
+    uint32_t roadCount;
+    uint32_t firstConnection;
+    uint32_t connectionCount;
+};
+
+// the length of a connection is the length of its road
+struct ConnectionRecord {
+    uint32_t road;
+    uint32_t intersection;
+};
+
+// the first shape of a building is the outer shape
+struct BuildingRecord {
+    uint64_t id;
+    uint32_t type;
+    uint32_t firstShape;
+    uint32_t shapeCount;
+    uint32_t reserved;
+};
+
+// the node columns, the shapes and the road name pool with its hash table are stored as they are
+using NameRecord = StringPool::Entry;
+
+template <typename Records>
+static Section appendSection(std::vector<char>& file, const Records& records) {
+
+    using Record = typename Records::value_type;
+
+    static_assert(std::is_trivially_copyable_v<Record>);
+
+    // every section starts 8 byte aligned, so the tables without references are used from the mapped file without copying them
+    file.resize((file.size() + 7) & ~std::size_t(7));
+
+    const Section section = {file.size(), records.size()};
+    const char* data = reinterpret_cast<const char*>(records.data());
+    file.insert(file.end(), data, data + records.size() * sizeof(Record));
+    return section;
+}
+
+template <typename Record>
+static std::span<const Record> getSection(const MappedFile& file, const Section& section) {
+
+    static_assert(std::is_trivially_copyable_v<Record>);
+
+
+    if (section.offset % alignof(Record) != 0 ||
+        section.offset > file.getSize() ||
+        section.count > (file.getSize() - section.offset) / sizeof(Record))
+        return {};
+
+    return {reinterpret_cast<const Record*>(file.getData() + section.offset), section.count};
+}
+
+bool MapSnapshot::write(const Map& map, const std::string& filePath, uint64_t sourceHash) {
+
+    if (!map.networkFinder) {
+        std::cerr << "Snapshot - The road network of the map is not analysed" << std::endl;
+        return false;
+    }
+
+    // the sections are the storage of the map
+    std::vector<RoadRecord> roads;
+    roads.reserve(map.roads.size());
+    for (const Road& road : map.roads) {
+        roads.push_back({road.getId(), road.getType().getEnumValue(), road.name, road.firstNode, road.nodeCount,
+                         road.startIntersection, road.endIntersection, road.length});
+    }
+
+    std::vector<IntersectionRecord> intersections;
+    intersections.reserve(map.intersections.size());
+    for (const Intersection& intersection : map.intersections) {
+        intersections.push_back({intersection.node, intersection.firstRoad, intersection.roadCount,
+                                 intersection.firstConnection, intersection.connectionCount});
+    }
+
+    std::vector<ConnectionRecord> connections;
+    connections.reserve(map.connections.size());
+    for (const Intersection::Connection& connection : map.connections) {
+        connections.push_back({connection.road.getIndex(), connection.intersection.getIndex()});
+    }
+
+    std::vector<BuildingRecord> buildings;
+    buildings.reserve(map.buildings.size());
+    for (const Building& building : map.buildings) {
+        buildings.push_back({building.getId(), building.getType().getEnumValue(), building.firstShape, building.shapeCount, 0});
+    }
+
+    Header header{};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.headerSize = sizeof(Header);
+    header.sourceHash = sourceHash;
+    header.refWidth = map.refWidth;
+    header.refHeight = map.refHeight;
+    header.minLatitude = map.minLatitude;
+    header.maxLatitude = map.maxLatitude;
+    header.minLongitude = map.minLongitude;
+    header.maxLongitude = map.maxLongitude;
+
+    std::vector<char> file(sizeof(Header));
+    header.nodeIds           = appendSection(file, map.nodes.getIds());
+    header.nodeLatitudes     = appendSection(file, map.nodes.getRawLatitudes());
+    header.nodeLongitudes    = appendSection(file, map.nodes.getRawLongitudes());
+    header.roads             = appendSection(file, roads);
+    header.roadNodes         = appendSection(file, map.roadNodes);
+    header.intersections     = appendSection(file, intersections);
+    header.intersectionRoads = appendSection(file, map.intersectionRoads);
+    header.connections       = appendSection(file, connections);
+    header.networkIndices    = appendSection(file, map.networkFinder->getNetworkIndices());
+    header.networkSizes      = appendSection(file, map.networkFinder->getNetworkSizes());
+    header.buildings         = appendSection(file, buildings);
+    header.shapes            = appendSection(file, map.shapes);
+    header.shapeNodes        = appendSection(file, map.shapeNodes);
+    header.names             = appendSection(file, map.roadNames.getEntries());
+    header.nameCharacters    = appendSection(file, map.roadNames.getCharacters());
+    header.nameSlots         = appendSection(file, map.roadNames.getSlots());
+
+    header.fileSize = file.size();
+    header.checksum = hashData(file.data() + sizeof(Header), file.size() - sizeof(Header));
+    std::memcpy(file.data(), &header, sizeof(Header));
+
+    // write to a temporary file first, a running program might have mapped the old snapshot
+    const std::string tempFilePath = filePath + ".tmp";
+    {
+        std::ofstream fileStream(tempFilePath, std::ios::binary | std::ios::trunc);
+        fileStream.write(file.data(), static_cast<std::streamsize>(file.size()));
+        if (!fileStream) {
+            std::cerr << "Snapshot - Failed to write file " << tempFilePath << std::endl;
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempFilePath, filePath, error);
+    if (error) {
+        std::cerr << "Snapshot - Failed to write file " << filePath << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    std::cout << "Snapshot size:      " << static_cast<double>(file.size()) / (1024.0 * 1024.0) << " MB" << std::endl;
+    return true;
+}
+
+/*
+ * The node columns, the index tables, the shapes, the road names and the
+ * network labels are borrowed from the mapped file, they are only checked.
+ * Roads, intersections and buildings point to their map and connections
+ * reference roads and intersections, so these tables are built from their
+ * records. A borrowed table is copied when the map changes it.
+ */
+std::unique_ptr<Map> MapSnapshot::load(const std::string& filePath, uint64_t sourceHash, std::pmr::memory_resource* resource) {
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    // the file stays mapped as long as a table of the map or of a copy of the map is borrowed from it
+    const std::shared_ptr<const MappedFile> mappedFile = std::shared_ptr<const MappedFile>(new MappedFile(filePath));
+    const MappedFile& file = *mappedFile;
+    if (!file.isOpen() || file.getSize() < sizeof(Header))
+        return nullptr;
+
+    Header header;
+    std::memcpy(&header, file.getData(), sizeof(Header));
+
+    if (header.magic != MAGIC || header.version != VERSION || header.headerSize != sizeof(Header) || header.fileSize != file.getSize()) {
+        std::cout << "Snapshot - Unsupported snapshot version" << std::endl;
+        return nullptr;
+    }
+
+    if (header.sourceHash != sourceHash) {
+        std::cout << "Snapshot - Source file has changed" << std::endl;
+        return nullptr;
+    }
+
+    if (header.checksum != hashData(file.getData() + sizeof(Header), file.getSize() - sizeof(Header))) {
+        std::cerr << "Snapshot - Checksum mismatch in " << filePath << std::endl;
+        return nullptr;
+    }
+
+    const std::span<const uint64_t>           nodeIds           = getSection<uint64_t>(file, header.nodeIds);
+    const std::span<const int32_t>            nodeLatitudes     = getSection<int32_t>(file, header.nodeLatitudes);
+    const std::span<const int32_t>            nodeLongitudes    = getSection<int32_t>(file, header.nodeLongitudes);
+    const std::span<const RoadRecord>         roads             = getSection<RoadRecord>(file, header.roads);
+    const std::span<const uint32_t>           roadNodes         = getSection<uint32_t>(file, header.roadNodes);
+    const std::span<const IntersectionRecord> intersections     = getSection<IntersectionRecord>(file, header.intersections);
+    const std::span<const uint32_t>           intersectionRoads = getSection<uint32_t>(file, header.intersectionRoads);
+    const std::span<const ConnectionRecord>   connections       = getSection<ConnectionRecord>(file, header.connections);
+    const std::span<const uint32_t>           networkIndices    = getSection<uint32_t>(file, header.networkIndices);
+    const std::span<const uint32_t>           networkSizes      = getSection<uint32_t>(file, header.networkSizes);
+    const std::span<const BuildingRecord>     buildings         = getSection<BuildingRecord>(file, header.buildings);
+    const std::span<const Map::Shape>         shapes            = getSection<Map::Shape>(file, header.shapes);
+    const std::span<const uint32_t>           shapeNodes        = getSection<uint32_t>(file, header.shapeNodes);
+    const std::span<const NameRecord>         names             = getSection<NameRecord>(file, header.names);
+    const std::span<const char>               nameCharacters    = getSection<char>(file, header.nameCharacters);
+    const std::span<const StringPool::Id>     nameSlots         = getSection<StringPool::Id>(file, header.nameSlots);
+
+    const auto isValidRange = [](uint64_t first, uint64_t count, std::size_t size) { return first <= size && count <= size - first; };
+    const auto isValidIndex = [](uint32_t index, std::size_t size) { return index < size; };
+
+    std::unique_ptr<Map> map = std::unique_ptr<Map>(new Map(resource));
+    map->setReferenceResolution(header.refWidth, header.refHeight);
+    map->setGlobalBounds(header.minLatitude, header.maxLatitude, header.minLongitude, header.maxLongitude);
+
+    // all entities have to be sorted by id, as they are in the map
+    if (!map->nodes.borrow(nodeIds, nodeLatitudes, nodeLongitudes, mappedFile))
+        return nullptr;
+    if (!nodeIds.empty())
+        map->idHandler.updateUsedIds(nodeIds.back());
+
+    if (!std::ranges::all_of(roadNodes, [&](uint32_t index) { return isValidIndex(index, nodeIds.size()); }) ||
+        !std::ranges::all_of(shapeNodes, [&](uint32_t index) { return isValidIndex(index, nodeIds.size()); }) ||
+        !std::ranges::all_of(intersectionRoads, [&](uint32_t index) { return isValidIndex(index, roads.size()); }))
+        return nullptr;
+
+    if (!map->roadNames.borrow(names, nameCharacters, nameSlots, mappedFile))
+        return nullptr;
+
+    map->roadNodes.borrow(roadNodes, mappedFile);
+    map->roads.reserve(roads.size());
+    for (const RoadRecord& record : roads) {
+
+        if (record.name >= names.size() || !isValidRange(record.firstNode, record.nodeCount, roadNodes.size()) || record.nodeCount < 2 ||
+            !isValidIndex(record.startIntersection, intersections.size()) || !isValidIndex(record.endIntersection, intersections.size()) ||
+            (!map->roads.empty() && record.id <= map->roads.back().getId()))
+            return nullptr;
+
+        Road& road = map->roads.emplace_back(*map, record.id, record.name, RoadType(static_cast<RoadType::Type>(record.type)), record.firstNode, record.nodeCount);
+        road.startIntersection = record.startIntersection;
+        road.endIntersection = record.endIntersection;
+        road.length = record.length;
+        map->idHandler.updateUsedIds(record.id);
+    }
+
+    map->intersectionRoads.borrow(intersectionRoads, mappedFile);
+    map->intersections.reserve(intersections.size());
+    for (const IntersectionRecord& record : intersections) {
+
+        if (!isValidIndex(record.node, nodeIds.size()) || !isValidRange(record.firstRoad, record.roadCount, intersectionRoads.size()) ||
+            !isValidRange(record.firstConnection, record.connectionCount, connections.size()) ||
+            (!map->intersections.empty() && record.node <= map->intersections.back().node))
+            return nullptr;
+
+        Intersection& intersection = map->intersections.emplace_back(*map, record.node, record.firstRoad, record.roadCount);
+        intersection.firstConnection = record.firstConnection;
+        intersection.connectionCount = record.connectionCount;
+    }
+
+    // the connections reference the roads and intersections, so they are added after both tables are complete
+    map->connections.reserve(connections.size());
+    for (const ConnectionRecord& record : connections) {
+        if (!isValidIndex(record.road, roads.size()) || !isValidIndex(record.intersection, intersections.size()))
+            return nullptr;
+        map->connections.emplace_back(map->roads[record.road], map->intersections[record.intersection]);
+    }
+
+    if (!std::ranges::all_of(shapes, [&](const Map::Shape& shape) { return isValidRange(shape.firstNode, shape.nodeCount, shapeNodes.size()); }))
+        return nullptr;
+
+    map->shapeNodes.borrow(shapeNodes, mappedFile);
+    map->shapes.borrow(shapes, mappedFile);
+
+    map->buildings.reserve(buildings.size());
+    for (const BuildingRecord& record : buildings) {
+
+        if (record.shapeCount == 0 || !isValidRange(record.firstShape, record.shapeCount, shapes.size()) ||
+            (!map->buildings.empty() && record.id <= map->buildings.back().getId()))
+            return nullptr;
+
+        map->buildings.emplace_back(*map, record.id, BuildingType(static_cast<BuildingType::Type>(record.type)), record.firstShape, record.shapeCount);
+        map->idHandler.updateUsedIds(record.id);
+    }
+
+    if (networkIndices.size() != intersections.size() ||
+        !std::ranges::all_of(networkIndices, [&](uint32_t network) { return isValidIndex(network, networkSizes.size()); }))
+        return nullptr;
+
+    std::vector<uint32_t> sizes(networkSizes.size(), 0);
+    for (uint32_t network : networkIndices) {
+        sizes[network]++;
+    }
+    if (!std::ranges::equal(sizes, networkSizes))
+        return nullptr;
+
+    map->networkFinder = std::unique_ptr<NetworkFinder>(new NetworkFinder(*map, networkIndices, networkSizes, mappedFile));
+
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+    std::cout << "Snapshot load time: " << duration.count() << " s" << std::endl;
+
+    return map;
+}
+
+uint64_t MapSnapshot::hashFile(const std::string& filePath, uint64_t seed) {
+    const MappedFile file(filePath);
+    return hashData(file.getData(), file.getSize(), seed);
+}
+
+/*
+ * FNV-1a over 64 bit words with an additional shift to mix the high bits
+ * back into the low bits. Good enough to detect changed files.
+ */
+uint64_t MapSnapshot::hashData(const char* data, std::size_t size, uint64_t seed) {
+
+    constexpr uint64_t PRIME = 0x100000001B3;
+
+    uint64_t hash = seed ^ 0xCBF29CE484222325;
+
+    std::size_t position = 0;
+    for (; position + sizeof(uint64_t) <= size; position += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data + position, sizeof(uint64_t));
+        hash = (hash ^ word) * PRIME;
+        hash ^= hash >> 29;
+    }
+
+    for (; position < size; position++) {
+        hash = (hash ^ static_cast<uint8_t>(data[position])) * PRIME;
+    }
+
+    return hash ^ size;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+
+namespace AStarCities {
+
+    class Map;
+
+    /*
+     * Binary snapshot of an analysed map. All sections are flat arrays of
+     * fixed size records that refer to each other by index, the header
+     * holds their offsets relative to the start of the file. Loading maps
+     * the file into memory and the map uses the node columns, road nodes,
+     * intersection roads, shapes, shape nodes, road names and network labels
+     * in place, the mapping stays open as long as the map uses them. Roads,
+     * intersections and buildings hold a pointer to their map and connections
+     * reference roads and intersections, so they can not be used in place and
+     * are built from their records. The road ends and lengths, the connections
+     * and the network of every intersection are stored as well, so the map is
+     * not parsed or analysed again.
+     *
+     * The snapshot stores a hash of the source file. If the source changes,
+     * loading fails and the snapshot has to be written again.
+     */
+    class MapSnapshot {
+
+        public:
+
+            static constexpr uint32_t VERSION = 4;
+
+            [[nodiscard]] static bool write(const Map& map, const std::string& filePath, uint64_t sourceHash);
+
+            // returns nullptr if the snapshot is missing, damaged or was made from an other source,
+            // the tables that are not used in place are allocated from the memory resource
+            [[nodiscard]] static std::unique_ptr<Map> load(const std::string& filePath, uint64_t sourceHash,
+                                                           std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+            [[nodiscard]] static uint64_t hashFile(const std::string& filePath, uint64_t seed = 0);
+            [[nodiscard]] static uint64_t hashData(const char* data, std::size_t size, uint64_t seed = 0);
+
+    };
+}
@@ -0,0 +1,85 @@
+
+#include "memoryreport.h"
+
+#include <iomanip>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace AStarCities;
+
+static double toMegaBytes(std::size_t bytes) {
+    return static_cast<double>(bytes) / 1e6;
+}
+
+// the names are plain ascii, only quotes and backslashes are escaped
+static void writeJsonString(std::ostream& stream, const std::string& string) {
+    stream << '"';
+    for (char character : string) {
+        if (character == '"' || character == '\\')
+            stream << '\\';
+        stream << character;
+    }
+    stream << '"';
+}
+
+void MemoryReport::addStage(std::string name, std::vector<Usage> containers) {
+    stages.push_back({std::move(name), getPeakResidentSetSize(), std::move(containers)});
+}
+
+void MemoryReport::print(std::ostream& stream) const {
+
+    for (const Stage& stage : stages) {
+
+        stream << "Memory after " << stage.name << " - peak RSS: " << toMegaBytes(stage.peakResidentSetSize) << " MB" << std::endl;
+
+        for (const Usage& usage : stage.containers) {
+            stream << "    " << std::left << std::setw(22) << usage.name + ":" << std::right
+                   << std::setw(10) << usage.count << " elements " << std::setw(10) << toMegaBytes(usage.bytes) << " MB" << std::endl;
+        }
+    }
+}
+
+void MemoryReport::writeJson(std::ostream& stream) const {
+
+    stream << "{\n  \"stages\": [";
+
+    for (std::size_t ii = 0; ii < stages.size(); ii++) {
+
+        const Stage& stage = stages[ii];
+
+        stream << (ii == 0 ? "\n" : ",\n") << "    {\n      \"name\": ";
+        writeJsonString(stream, stage.name);
+        stream << ",\n      \"peakResidentSetSize\": " << stage.peakResidentSetSize << ",\n      \"containers\": [";
+
+        for (std::size_t jj = 0; jj < stage.containers.size(); jj++) {
+            const Usage& usage = stage.containers[jj];
+            stream << (jj == 0 ? "\n" : ",\n") << "        { \"name\": ";
+            writeJsonString(stream, usage.name);
+            stream << ", \"count\": " << usage.count << ", \"bytes\": " << usage.bytes << " }";
+        }
+
+        stream << (stage.containers.empty() ? "]\n    }" : "\n      ]\n    }");
+    }
+
+    stream << (stages.empty() ? "]\n}\n" : "\n  ]\n}\n");
+}
+
+std::size_t MemoryReport::getPeakResidentSetSize() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
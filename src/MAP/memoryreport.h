@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace AStarCities {
+
+    /*
+     * Memory used by the containers of a map and its parser after each stage
+     * of the pipeline, together with the peak resident set size of the process
+     * at that point. The bytes are the allocated capacity of the containers,
+     * the overhead of the allocator is not included.
+     */
+    class MemoryReport {
+
+        public:
+
+            struct Usage {
+                std::string name;
+                std::size_t count;
+                std::size_t bytes;
+            };
+
+            struct Stage {
+                std::string name;
+                std::size_t peakResidentSetSize;
+                std::vector<Usage> containers;
+            };
+
+            MemoryReport() = default;
+            virtual ~MemoryReport() = default;
+
+            // adds a stage with the current peak resident set size of the process
+            void addStage(std::string name, std::vector<Usage> containers = {});
+
+            [[nodiscard]] std::span<const Stage> getStages() const noexcept { return stages; }
+
+            void print(std::ostream& stream) const;
+            void writeJson(std::ostream& stream) const;
+
+            // 0 if the platform does not report it
+            [[nodiscard]] static std::size_t getPeakResidentSetSize();
+
+            template <typename Vector>
+            [[nodiscard]] static Usage measureVector(std::string name, const Vector& vector) {
+                return {std::move(name), vector.size(), vector.capacity() * sizeof(typename Vector::value_type)};
+            }
+
+            // a tree node holds the value, three pointers and the colour,
+            // getVector returns the vector stored in a value of the tree
+            template <typename Tree, typename GetVector>
+            [[nodiscard]] static Usage measureTree(std::string name, const Tree& tree, GetVector getVector) {
+                std::size_t bytes = tree.size() * (sizeof(typename Tree::value_type) + 4 * sizeof(void*));
+                for (const auto& [key, value] : tree) {
+                    const auto& vector = getVector(value);
+                    bytes += vector.capacity() * sizeof(typename std::remove_cvref_t<decltype(vector)>::value_type);
+                }
+                return {std::move(name), tree.size(), bytes};
+            }
+
+        private:
+
+            std::vector<Stage> stages;
+
+    };
+}
@@ -1,85 +1,291 @@
 
 #include "networkfinder.h"
 #include "map.h"
+#include "parallelfor.h"
+
+#include <array>
+#include <atomic>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <set>
 
 using namespace AStarCities;
 
-NetworkFinder::NetworkFinder(const Map& map) {
+NetworkFinder::NetworkFinder(const Map& map, uint32_t threadCount) :
+    map(map), threadCount(threadCount), networkIndices(map.getSharedMemoryResource()), networkSizes(map.getMemoryResource()) {}
 
-    for (const auto& [id, intersection] : map.getIntersections()) {
-        networkNodes.insert({id, NetworkNode(intersection)});
-    }
+NetworkFinder::NetworkFinder(const Map& map, const NetworkFinder& networks) :
+    NetworkFinder(map, networks.threadCount) {
+
+    networkIndices = networks.networkIndices;
+    networkSizes.assign(networks.networkSizes.begin(), networks.networkSizes.end());
 }
 
+NetworkFinder::NetworkFinder(const Map& map, std::span<const uint32_t> networkIndices, std::span<const uint32_t> networkSizes,
+                             const std::shared_ptr<const void>& lender) :
+    NetworkFinder(map) {
+
+    this->networkIndices.borrow(networkIndices, lender);
+    this->networkSizes.assign(networkSizes.begin(), networkSizes.end());
+}
+
+/*
+ * Every intersection is connected with both ends of its roads, the sets
+ * are joined in parallel. No recursion, so the stack size does not depend
+ * on the size of the map.
+ */
 void NetworkFinder::generateNetworks() {
 
-    // iterate over all intersections
-    for (auto& [id, intersection] : networkNodes) {
+    const std::span<const Intersection> intersections = map.getIntersections();
 
-        // check if the intersection is not allready part of a network
-        if (intersection.network != nullptr)
-            continue;
+    std::vector<uint32_t> parents(intersections.size());
+    std::iota(parents.begin(), parents.end(), 0);
 
-        Network& network = networks.emplace_back(Network());
-        getNetwork(intersection, network);
+    parallelFor(intersections.size(), threadCount, [&intersections, &parents](std::size_t begin, std::size_t end) {
+        for (std::size_t index = begin; index < end; index++) {
+            for (const Road& road : intersections[index].getRoads()) {
+                const auto& [startIntersection, endIntersection] = road.getIntersections();
+                unite(parents, static_cast<uint32_t>(index), startIntersection.getIndex());
+                unite(parents, static_cast<uint32_t>(index), endIntersection.getIndex());
+            }
+        }
+    });
+
+    // the root is the smallest index of a network, it is labeled first
+    networkIndices.assign(intersections.size(), 0);
+    networkSizes.clear();
+    const std::span<uint32_t> labels = networkIndices.edit();
+    for (uint32_t index = 0; index < intersections.size(); index++) {
+        const uint32_t root = findRoot(parents, index);
+        if (root == index) {
+            labels[index] = static_cast<uint32_t>(networkSizes.size());
+            networkSizes.push_back(0);
+        } else {
+            labels[index] = labels[root];
+        }
+        networkSizes[labels[index]]++;
     }
 }
 
-std::vector<NetworkFinder::RoadNetwork> NetworkFinder::getRoadNetworks() const {
-    std::vector<RoadNetwork> networks;
-    for (const Network& network : this->networks) {
-        auto& roadNetwork = networks.emplace_back(RoadNetwork());
-        for (std::reference_wrapper<const NetworkNode> node : network) {
-            for (std::reference_wrapper<const Road> road : node.get().intersection.getRoads()) {
-                roadNetwork.insert(road.get());
+uint32_t NetworkFinder::findRoot(std::vector<uint32_t>& parents, uint32_t index) {
+
+    while (true) {
+        const uint32_t parent = std::atomic_ref<uint32_t>(parents[index]).load(std::memory_order_relaxed);
+        if (parent == index)
+            return index;
+
+        // path halving, the grandparent is still in the same set
+        uint32_t expected = parent;
+        const uint32_t grandParent = std::atomic_ref<uint32_t>(parents[parent]).load(std::memory_order_relaxed);
+        std::atomic_ref<uint32_t>(parents[index]).compare_exchange_weak(expected, grandParent, std::memory_order_relaxed);
+        index = grandParent;
+    }
+}
+
+void NetworkFinder::unite(std::vector<uint32_t>& parents, uint32_t index1, uint32_t index2) {
+
+    while (true) {
+        uint32_t root1 = findRoot(parents, index1);
+        uint32_t root2 = findRoot(parents, index2);
+        if (root1 == root2)
+            return;
+
+        // the larger root is attached to the smaller one, fails if it is not a root anymore
+        if (root1 > root2)
+            std::swap(root1, root2);
+        uint32_t expected = root2;
+        if (std::atomic_ref<uint32_t>(parents[root2]).compare_exchange_strong(expected, root1, std::memory_order_relaxed))
+            return;
+    }
+}
+
+/*
+ * The remaining intersections keep their networks and every new intersection
+ * starts a network of its own. The networks at the ends of the added roads are
+ * joined first. Then a network can only be split where roads were removed, so
+ * the remaining intersections at the ends of removed roads are checked in pairs
+ * of nearby intersections, a side that is not connected anymore gets a new
+ * network. Only if a network was split, all its remaining ends are checked
+ * against one of them.
+ */
+void NetworkFinder::updateNetworks(std::span<const IntersectionIndex> intersectionIndices,
+                                   std::span<const std::pair<IntersectionIndex, IntersectionIndex>> removedRoadEnds, std::span<const RoadIndex> addedRoads) {
+
+    const std::span<const Intersection> intersections = map.getIntersections();
+
+    constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    std::pmr::vector<uint32_t> newNetworkIndices(intersections.size(), NONE, map.getMemoryResource());
+    for (IntersectionIndex index = 0; index < intersectionIndices.size(); index++) {
+        if (intersectionIndices[index] != Road::NO_INTERSECTION)
+            newNetworkIndices[intersectionIndices[index]] = networkIndices[index];
+        else
+            networkSizes[networkIndices[index]]--;
+    }
+    for (uint32_t& network : newNetworkIndices) {
+        if (network == NONE) {
+            network = static_cast<uint32_t>(networkSizes.size());
+            networkSizes.push_back(1);
+        }
+    }
+    networkIndices = std::move(newNetworkIndices);
+
+    for (RoadIndex road : addedRoads) {
+        const auto& [startIntersection, endIntersection] = map.getRoads()[road].getIntersections();
+        joinNetworks(startIntersection.getIndex(), endIntersection.getIndex());
+    }
+
+    // the ends of a removed road and the remaining ends around removed intersections were connected before
+    std::vector<std::pair<IntersectionIndex, IntersectionIndex>> endPairs;
+    std::map<IntersectionIndex, std::vector<IntersectionIndex>> removedIntersectionEnds;
+    for (const auto& [startIntersection, endIntersection] : removedRoadEnds) {
+        const IntersectionIndex start = intersectionIndices[startIntersection];
+        const IntersectionIndex end = intersectionIndices[endIntersection];
+        if (start != Road::NO_INTERSECTION && end != Road::NO_INTERSECTION)
+            endPairs.emplace_back(start, end);
+        if (start == Road::NO_INTERSECTION)
+            removedIntersectionEnds[startIntersection].push_back(endIntersection);
+        if (end == Road::NO_INTERSECTION)
+            removedIntersectionEnds[endIntersection].push_back(startIntersection);
+    }
+
+    std::set<IntersectionIndex> visitedRemoved;
+    for (const auto& [removed, ends] : removedIntersectionEnds) {
+        if (!visitedRemoved.insert(removed).second)
+            continue;
+        IntersectionIndex previous = Road::NO_INTERSECTION;
+        std::vector<IntersectionIndex> open = {removed};
+        while (!open.empty()) {
+            const IntersectionIndex index = open.back();
+            open.pop_back();
+            for (IntersectionIndex end : removedIntersectionEnds[index]) {
+                if (intersectionIndices[end] == Road::NO_INTERSECTION) {
+                    if (visitedRemoved.insert(end).second)
+                        open.push_back(end);
+                    continue;
+                }
+                if (previous != Road::NO_INTERSECTION)
+                    endPairs.emplace_back(previous, intersectionIndices[end]);
+                previous = intersectionIndices[end];
             }
         }
     }
-    return networks;
-}
 
-std::size_t NetworkFinder::getNetworkNodeCount(const RoadNetwork& network) {
+    std::vector<uint32_t> visits(intersections.size(), 0);
+    uint32_t visit = 0;
 
-    std::size_t nodeCount = 0;
+    // the separated side gets a new network, returns the intersection that is still in the network
+    const auto separate = [this, &visits, &visit](IntersectionIndex index1, IntersectionIndex index2) {
+        const std::vector<IntersectionIndex> side = findSeparatedSide(index1, index2, visits, visit);
+        if (side.empty())
+            return Road::NO_INTERSECTION;
+        const uint32_t network = networkIndices[index1];
+        const uint32_t newNetwork = static_cast<uint32_t>(networkSizes.size());
+        networkSizes.push_back(static_cast<uint32_t>(side.size()));
+        networkSizes[network] -= static_cast<uint32_t>(side.size());
+        const std::span<uint32_t> labels = networkIndices.edit();
+        for (IntersectionIndex index : side)
+            labels[index] = newNetwork;
+        return networkIndices[index1] == network ? index1 : index2;
+    };
 
-    for (const Road& road : network) {
-        nodeCount += road.getNodes().size();
+    std::set<uint32_t> splitNetworks;
+    for (const auto& [index1, index2] : endPairs) {
+        const uint32_t network = networkIndices[index1];
+        if (network == networkIndices[index2] && separate(index1, index2) != Road::NO_INTERSECTION)
+            splitNetworks.insert(network);
+    }
+
+    // pairs of nearby ends do not find a network split into more than two parts
+    for (uint32_t network : splitNetworks) {
+        IntersectionIndex first = Road::NO_INTERSECTION;
+        for (const auto& pair : endPairs) {
+            for (IntersectionIndex end : {pair.first, pair.second}) {
+                if (networkIndices[end] != network)
+                    continue;
+                if (first == Road::NO_INTERSECTION)
+                    first = end;
+                else if (const IntersectionIndex remaining = separate(first, end); remaining != Road::NO_INTERSECTION)
+                    first = remaining;
+            }
+        }
     }
 
-    return nodeCount;
 }
 
-// TODO: The recursive implementation might be a problem.
-//       For large maps the stack can become very large.
-//       It is necessary to increase the default stack size on compilation
-void NetworkFinder::getNetwork(NetworkNode& node, Network& network) {
+/*
+ * Breadth first search from both intersections at once, one intersection is
+ * expanded on each side in turn. The search stops when the sides meet or when
+ * one side has no intersections left, so it depends on the smaller side.
+ */
+std::vector<IntersectionIndex> NetworkFinder::findSeparatedSide(IntersectionIndex index1, IntersectionIndex index2, std::vector<uint32_t>& visits, uint32_t& visit) const {
 
-    // check if the intersection is allready part of the network
-    if (network.contains(node))
-        return;
+    if (index1 == index2)
+        return {};
 
-    // add this intersection to the network
-    network.insert(node);
-    node.network = &network;
-
-    // follow the roads
-    for (const Road& road : node.intersection.getRoads()) {
-        const auto& [start, end] = road.getIntersections();
-        NetworkNode* startNode = getNetworkNode(start);
-        NetworkNode* endNode = getNetworkNode(end);
-        if (*startNode != node) {
-            getNetwork(*startNode, network);
-        }
-        if (*endNode != node) {
-            getNetwork(*endNode, network);
+    const std::span<const Intersection> intersections = map.getIntersections();
+
+    // the visited intersections of a side are its queue
+    std::array<std::vector<IntersectionIndex>, 2> sides = {std::vector<IntersectionIndex>{index1}, std::vector<IntersectionIndex>{index2}};
+    std::array<std::size_t, 2> expanded = {0, 0};
+    std::array<uint32_t, 2> sideVisits;
+    for (std::size_t side = 0; side < 2; side++) {
+        sideVisits[side] = ++visit;
+        visits[sides[side].front()] = sideVisits[side];
+    }
+
+    while (true) {
+        for (std::size_t side = 0; side < 2; side++) {
+
+            if (expanded[side] == sides[side].size())
+                return sides[side];
+
+            const IntersectionIndex index = sides[side][expanded[side]++];
+            for (const Intersection::Connection& connection : intersections[index].getConnections()) {
+                const IntersectionIndex next = connection.intersection.getIndex();
+                if (visits[next] == sideVisits[1 - side])
+                    return {};
+                if (visits[next] != sideVisits[side]) {
+                    visits[next] = sideVisits[side];
+                    sides[side].push_back(next);
+                }
+            }
         }
     }
 }
 
-NetworkFinder::NetworkNode* NetworkFinder::getNetworkNode(const Intersection& intersection) {
-    if (auto nodeIter = networkNodes.find(intersection.getId()); nodeIter != networkNodes.end()) {
-        return &nodeIter->second;
-    } else {
-        return nullptr;
+void NetworkFinder::joinNetworks(IntersectionIndex index1, IntersectionIndex index2) {
+
+    uint32_t network1 = networkIndices[index1];
+    uint32_t network2 = networkIndices[index2];
+    if (network1 == network2)
+        return;
+
+    if (networkSizes[network1] < networkSizes[network2]) {
+        std::swap(index1, index2);
+        std::swap(network1, network2);
+    }
+
+    // before the removed roads are checked a network can be split, only the connected part is joined
+    const std::span<const Intersection> intersections = map.getIntersections();
+    const std::span<uint32_t> labels = networkIndices.edit();
+    std::vector<IntersectionIndex> open = {index2};
+    labels[index2] = network1;
+    uint32_t joined = 1;
+    while (!open.empty()) {
+        const IntersectionIndex index = open.back();
+        open.pop_back();
+        for (const Intersection::Connection& connection : intersections[index].getConnections()) {
+            const IntersectionIndex next = connection.intersection.getIndex();
+            if (labels[next] == network2) {
+                labels[next] = network1;
+                open.push_back(next);
+                joined++;
+            }
+        }
     }
+
+    networkSizes[network1] += joined;
+    networkSizes[network2] -= joined;
 }
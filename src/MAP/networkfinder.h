@@ -1,55 +1,79 @@
 #pragma once
 
 #include "intersection.h"
+#include "sharedvector.h"
 
-#include <set>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <utility>
 #include <vector>
-#include <map>
-#include <functional>
 
 namespace AStarCities {
 
     class Map;
 
+    /*
+     * Finds the connected road networks of a map with a union find over the
+     * intersection indices. Every intersection gets the index of its network,
+     * the networks are ordered by their intersection with the smallest id.
+     *
+     * After a change of the map only the networks around the changed roads are
+     * updated. Split networks are appended and joined networks keep their index
+     * with a size of 0, so the order by the smallest id is not kept.
+     */
     class NetworkFinder {
 
         public:
 
-            using RoadNetwork = std::set<std::reference_wrapper<const Road>, std::less<Road>>;
+            // a thread count of 0 uses all hardware threads, the networks use the memory resource of the map
+            NetworkFinder(const Map& map, uint32_t threadCount = 0);
 
-            NetworkFinder(const Map& map);
+            // shares the networks of the copied map until they are updated
+            NetworkFinder(const Map& map, const NetworkFinder& networks);
+
+            // takes the networks stored in a snapshot of the map, the network indices are borrowed from the lender
+            NetworkFinder(const Map& map, std::span<const uint32_t> networkIndices, std::span<const uint32_t> networkSizes,
+                          const std::shared_ptr<const void>& lender);
             virtual ~NetworkFinder() = default;
 
             void generateNetworks();
 
-            [[nodiscard]] std::vector<RoadNetwork> getRoadNetworks() const;
-
-            [[nodiscard]] static std::size_t getNetworkNodeCount(const RoadNetwork& network);
+            // intersection index before the change -> index after the change or Road::NO_INTERSECTION,
+            // the end intersections of the removed roads before and the indices of the added roads after the change
+            void updateNetworks(std::span<const IntersectionIndex> intersectionIndices,
+                                std::span<const std::pair<IntersectionIndex, IntersectionIndex>> removedRoadEnds, std::span<const RoadIndex> addedRoads);
 
-        private:
+            [[nodiscard]] std::size_t getNetworkCount() const noexcept { return networkSizes.size(); }
 
-            struct NetworkNode {
+            // intersection index -> network index
+            [[nodiscard]] std::span<const uint32_t> getNetworkIndices() const noexcept { return networkIndices; }
 
-                NetworkNode(const Intersection& intersection) :
-                    intersection(intersection) {};
+            // number of intersections of every network
+            [[nodiscard]] std::span<const uint32_t> getNetworkSizes() const noexcept { return networkSizes; }
 
-                virtual ~NetworkNode() = default;
+            [[nodiscard]] std::size_t getAllocatedBytes() const noexcept {
+                return (networkIndices.capacity() + networkSizes.capacity()) * sizeof(uint32_t);
+            }
 
-                bool operator<(const NetworkNode& node) const { return node.intersection.getId() < intersection.getId(); }
+        private:
 
-                bool operator!=(const NetworkNode& node) const { return node.intersection.getId() != intersection.getId(); }
+            // lock free, path halving and the root of a set is its smallest index
+            [[nodiscard]] static uint32_t findRoot(std::vector<uint32_t>& parents, uint32_t index);
+            static void unite(std::vector<uint32_t>& parents, uint32_t index1, uint32_t index2);
 
-                const Intersection& intersection;
-                std::set<std::reference_wrapper<const NetworkNode>, std::less<NetworkNode>> const* network = nullptr;
-            };
+            // the intersections of the side that is not connected with the other one, empty if both are connected
+            [[nodiscard]] std::vector<IntersectionIndex> findSeparatedSide(IntersectionIndex index1, IntersectionIndex index2, std::vector<uint32_t>& visits, uint32_t& visit) const;
 
-            using Network = std::set<std::reference_wrapper<const NetworkNode>, std::less<NetworkNode>>;
+            // the intersections of the smaller network connected with its intersection are added to the larger network
+            void joinNetworks(IntersectionIndex index1, IntersectionIndex index2);
 
-            void getNetwork(NetworkNode& node, Network& network);
+            const Map& map;
 
-            NetworkNode* getNetworkNode(const Intersection& intersection);
+            uint32_t threadCount;
 
-            std::map<uint64_t, NetworkNode> networkNodes;
-            std::vector<Network> networks;
+            SharedVector<uint32_t> networkIndices;
+            std::pmr::vector<uint32_t> networkSizes;
     };
 }
@@ -1,18 +1,32 @@
 
 #include "node.h"
+#include "map.h"
+#include "geodesic.h"
 
 #include <cmath>
 
 using namespace AStarCities;
 
+uint64_t Node::getId() const {
+    return map->nodes.getId(index);
+}
+
+std::pair<double, double> Node::getLocalPosition() const {
+    return map->getLocalPosition(index);
+}
+
+std::pair<double, double> Node::getGlobalPosition() const {
+    return {map->nodes.getLatitude(index), map->nodes.getLongitude(index)};
+}
+
 double Node::localDistance(const Node& node) const {
     const auto [x1, y1] = getLocalPosition();
     const auto [x2, y2] = node.getLocalPosition();
     return std::sqrt((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2));
 }
 
-double Node::globalDistance(const Node& node) const {
-    const auto [x1, y1] = getGlobalPosition();
-    const auto [x2, y2] = node.getGlobalPosition();
-    return std::sqrt((x1 - x2) * (x1 - x2) + (y1 - y2) * (y1 - y2));
+double Node::distance(const Node& node) const {
+    const auto [latitude1, longitude1] = getGlobalPosition();
+    const auto [latitude2, longitude2] = node.getGlobalPosition();
+    return geodesicDistance(latitude1, longitude1, latitude2, longitude2);
 }
@@ -1,39 +1,100 @@
 #pragma once
 
+#include "nodetable.h"
+
 #include <cstdint>
+#include <iterator>
+#include <span>
 #include <utility>
 
 namespace AStarCities {
 
+    class Map;
+
+    using NodeIndex = NodeTable::Index;
+
+    /*
+     * View of a node in the node table of a map. The table is sorted by id,
+     * so comparing the indices of two nodes compares their ids.
+     */
     class Node {
 
         public:
 
-            Node(uint64_t id, double latitude, double longitude) :
-                id (id), latitude(latitude), longitude(longitude) {};
-
-            virtual ~Node() = default;
+            Node(const Map& map, NodeIndex index) :
+                map(&map), index(index) {};
 
-            [[nodiscard]] uint64_t getId() const noexcept { return id; }
+            bool operator==(const Node& node) const { return index == node.index; }
 
-            [[nodiscard]] std::pair<double, double> getLocalPosition() const noexcept { return {posX, posY}; }
-            [[nodiscard]] std::pair<double, double> getGlobalPosition() const noexcept { return {latitude, longitude}; }
+            [[nodiscard]] NodeIndex getIndex() const noexcept { return index; }
+            [[nodiscard]] uint64_t getId() const;
 
-            void setLocalPosition(std::pair<double, double> pos) { posX = pos.first; posY = pos.second; }
+            [[nodiscard]] std::pair<double, double> getLocalPosition() const;
+            [[nodiscard]] std::pair<double, double> getGlobalPosition() const;
 
             [[nodiscard]] double localDistance(const Node& node) const;
-            [[nodiscard]] double globalDistance(const Node& node) const;
 
+            // distance on the earth in metres, see geodesicDistance
+            [[nodiscard]] double distance(const Node& node) const;
 
         private:
 
-            uint64_t id;
+            const Map* map;
+
+            NodeIndex index;
+
+    };
+
+    /*
+     * View of a range of node indices, like the nodes of a road or a building shape.
+     */
+    class NodeRange {
+
+        public:
+
+            class Iterator {
+
+                public:
+
+                    using value_type = Node;
+                    using difference_type = std::ptrdiff_t;
+
+                    Iterator() = default;
+                    Iterator(const Map* map, const NodeIndex* index) : map(map), index(index) {};
+
+                    bool operator==(const Iterator& iterator) const { return index == iterator.index; }
+
+                    Node operator*() const { return Node(*map, *index); }
+
+                    Iterator& operator++() { index++; return *this; }
+                    Iterator operator++(int) { Iterator iterator = *this; index++; return iterator; }
+
+                private:
+
+                    const Map* map = nullptr;
+                    const NodeIndex* index = nullptr;
+            };
+
+            NodeRange(const Map& map, std::span<const NodeIndex> indices) :
+                map(&map), indices(indices) {};
+
+            [[nodiscard]] std::size_t size() const noexcept { return indices.size(); }
+            [[nodiscard]] bool empty() const noexcept { return indices.empty(); }
+
+            [[nodiscard]] Node operator[](std::size_t position) const { return Node(*map, indices[position]); }
+            [[nodiscard]] Node front() const { return Node(*map, indices.front()); }
+            [[nodiscard]] Node back()  const { return Node(*map, indices.back()); }
+
+            [[nodiscard]] Iterator begin() const { return Iterator(map, indices.data()); }
+            [[nodiscard]] Iterator end()   const { return Iterator(map, indices.data() + indices.size()); }
+
+            [[nodiscard]] std::span<const NodeIndex> getIndices() const noexcept { return indices; }
+
+        private:
 
-            double latitude;
-            double longitude;
+            const Map* map;
 
-            double posX = 0;
-            double posY = 0;
+            std::span<const NodeIndex> indices;
 
     };
 }
@@ -0,0 +1,170 @@
+
+#include "nodetable.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <functional>
+
+using namespace AStarCities;
+
+void NodeTable::reserve(std::size_t count) {
+    ids.reserve(count);
+    latitudes.reserve(count);
+    longitudes.reserve(count);
+}
+
+void NodeTable::addNode(uint64_t id, double latitude, double longitude) {
+    addRawNode(id, static_cast<int32_t>(std::lround(latitude * SCALE)), static_cast<int32_t>(std::lround(longitude * SCALE)));
+}
+
+void NodeTable::addRawNode(uint64_t id, int32_t latitude, int32_t longitude) {
+
+    if (!ids.empty() && id <= ids.back())
+        sorted = false;
+
+    ids.push_back(id);
+    latitudes.push_back(latitude);
+    longitudes.push_back(longitude);
+}
+
+bool NodeTable::setPosition(Index index, double latitude, double longitude) {
+
+    const int32_t newLatitude = static_cast<int32_t>(std::lround(latitude * SCALE));
+    const int32_t newLongitude = static_cast<int32_t>(std::lround(longitude * SCALE));
+
+    if (latitudes[index] == newLatitude && longitudes[index] == newLongitude)
+        return false;
+
+    latitudes.edit()[index] = newLatitude;
+    longitudes.edit()[index] = newLongitude;
+    return true;
+}
+
+std::vector<NodeTable::Index> NodeTable::sortById() {
+
+    if (sorted)
+        return {};
+
+    // osm files are sorted by id, this is only the fallback for other files
+    std::vector<Index> order(ids.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](Index a, Index b) { return ids[a] < ids[b]; });
+
+    std::size_t uniqueCount = 0;
+    for (std::size_t ii = 0; ii < order.size(); ii++) {
+        if (ii == 0 || ids[order[ii]] != ids[order[ii - 1]])
+            uniqueCount++;
+    }
+
+    // the sorted tables use the same memory resource, so they can be moved in
+    std::pmr::vector<uint64_t> sortedIds(ids.getMemoryResource());
+    std::pmr::vector<int32_t> sortedLatitudes(latitudes.getMemoryResource());
+    std::pmr::vector<int32_t> sortedLongitudes(longitudes.getMemoryResource());
+    sortedIds.reserve(uniqueCount);
+    sortedLatitudes.reserve(uniqueCount);
+    sortedLongitudes.reserve(uniqueCount);
+
+    std::vector<Index> newIndices(order.size());
+
+    for (Index index : order) {
+        // keep only the first node of duplicated ids
+        if (!sortedIds.empty() && sortedIds.back() == ids[index]) {
+            newIndices[index] = static_cast<Index>(sortedIds.size() - 1);
+            continue;
+        }
+        newIndices[index] = static_cast<Index>(sortedIds.size());
+        sortedIds.push_back(ids[index]);
+        sortedLatitudes.push_back(latitudes[index]);
+        sortedLongitudes.push_back(longitudes[index]);
+    }
+
+    ids = std::move(sortedIds);
+    latitudes = std::move(sortedLatitudes);
+    longitudes = std::move(sortedLongitudes);
+
+    sorted = true;
+
+    return newIndices;
+}
+
+std::vector<NodeTable::Index> NodeTable::removeUnused(const std::vector<bool>& used) {
+
+    std::vector<Index> newIndices(ids.size(), NOT_FOUND);
+
+    const std::span<uint64_t> keptIds = ids.edit();
+    const std::span<int32_t> keptLatitudes = latitudes.edit();
+    const std::span<int32_t> keptLongitudes = longitudes.edit();
+
+    Index newIndex = 0;
+    for (Index index = 0; index < keptIds.size(); index++) {
+        if (!used[index])
+            continue;
+        keptIds[newIndex] = keptIds[index];
+        keptLatitudes[newIndex] = keptLatitudes[index];
+        keptLongitudes[newIndex] = keptLongitudes[index];
+        newIndices[index] = newIndex++;
+    }
+
+    ids.resize(newIndex);
+    latitudes.resize(newIndex);
+    longitudes.resize(newIndex);
+    ids.shrink_to_fit();
+    latitudes.shrink_to_fit();
+    longitudes.shrink_to_fit();
+
+    return newIndices;
+}
+
+bool NodeTable::borrow(std::span<const uint64_t> newIds, std::span<const int32_t> newLatitudes, std::span<const int32_t> newLongitudes,
+                       const std::shared_ptr<const void>& lender) {
+
+    if (newLatitudes.size() != newIds.size() || newLongitudes.size() != newIds.size() ||
+        std::adjacent_find(newIds.begin(), newIds.end(), std::greater_equal<uint64_t>()) != newIds.end())
+        return false;
+
+    ids.borrow(newIds, lender);
+    latitudes.borrow(newLatitudes, lender);
+    longitudes.borrow(newLongitudes, lender);
+    sorted = true;
+
+    return true;
+}
+
+/*
+ * Interpolation search: osm ids of an extract are close to uniformly
+ * distributed, so a few interpolation steps narrow the range down to a
+ * handful of elements. The rest is done by a binary search.
+ */
+NodeTable::Index NodeTable::find(uint64_t id) const {
+
+    std::size_t low = 0;
+    std::size_t high = ids.size();
+
+    for (int step = 0; step < 4 && high - low > 32; step++) {
+
+        const uint64_t lowId = ids[low];
+        const uint64_t highId = ids[high - 1];
+
+        if (id < lowId || id > highId)
+            return NOT_FOUND;
+
+        const double fraction = static_cast<double>(id - lowId) / static_cast<double>(highId - lowId + 1);
+        const std::size_t guess = low + static_cast<std::size_t>(fraction * static_cast<double>(high - low));
+
+        if (ids[guess] == id)
+            return static_cast<Index>(guess);
+        else if (ids[guess] < id)
+            low = guess + 1;
+        else
+            high = guess;
+    }
+
+    const auto begin = ids.begin() + static_cast<std::ptrdiff_t>(low);
+    const auto end = ids.begin() + static_cast<std::ptrdiff_t>(high);
+    const auto iter = std::lower_bound(begin, end, id);
+    if (iter == end || *iter != id)
+        return NOT_FOUND;
+
+    return static_cast<Index>(iter - ids.begin());
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "sharedvector.h"
+
+#include <cstdint>
+#include <vector>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <span>
+
+namespace AStarCities {
+
+    /*
+     * Table of raw osm nodes. Ids are kept in a sorted vector,
+     * coordinates in parallel arrays as fixed point values with the osm
+     * precision of 1e-7 degrees (16 bytes per node). Copies of the table
+     * share the columns until they are changed.
+     */
+    class NodeTable {
+
+        public:
+
+            using Index = uint32_t;
+
+            static constexpr Index NOT_FOUND = std::numeric_limits<Index>::max();
+
+            NodeTable(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+                ids(resource), latitudes(resource), longitudes(resource) {}
+
+            // the columns keep the resource alive
+            NodeTable(const std::shared_ptr<std::pmr::memory_resource>& resource) :
+                ids(resource), latitudes(resource), longitudes(resource) {}
+
+            virtual ~NodeTable() = default;
+
+            // a copy shares the columns, assigning keeps the memory resource of the table
+            NodeTable(const NodeTable&) = default;
+            NodeTable& operator=(const NodeTable&) = default;
+
+            void reserve(std::size_t count);
+
+            void addNode(uint64_t id, double latitude, double longitude);
+            void addRawNode(uint64_t id, int32_t latitude, int32_t longitude);
+
+            // returns true if the stored position has changed
+            bool setPosition(Index index, double latitude, double longitude);
+
+            // must be called after all nodes are added and before the first lookup,
+            // returns the new index of every old index or nothing if the table was sorted
+            std::vector<Index> sortById();
+
+            // removes the nodes that are not used, the order is kept,
+            // returns the new index of every old index or NOT_FOUND for removed nodes
+            std::vector<Index> removeUnused(const std::vector<bool>& used);
+
+            // uses the columns of a snapshot without copying them, the lender keeps them alive,
+            // returns false if the columns differ in size or the ids are not sorted
+            bool borrow(std::span<const uint64_t> ids, std::span<const int32_t> latitudes, std::span<const int32_t> longitudes,
+                        const std::shared_ptr<const void>& lender);
+
+            [[nodiscard]] Index find(uint64_t id) const;
+
+            [[nodiscard]] std::size_t size() const noexcept { return ids.size(); }
+
+            [[nodiscard]] std::size_t getAllocatedBytes() const noexcept {
+                return ids.capacity() * sizeof(uint64_t) + (latitudes.capacity() + longitudes.capacity()) * sizeof(int32_t);
+            }
+
+            [[nodiscard]] uint64_t getId(Index index) const { return ids[index]; }
+            [[nodiscard]] double getLatitude(Index index)  const { return static_cast<double>(latitudes[index])  / SCALE; }
+            [[nodiscard]] double getLongitude(Index index) const { return static_cast<double>(longitudes[index]) / SCALE; }
+
+            // fixed point coordinates in 1e-7 degrees
+            [[nodiscard]] int32_t getRawLatitude(Index index)  const { return latitudes[index]; }
+            [[nodiscard]] int32_t getRawLongitude(Index index) const { return longitudes[index]; }
+
+            [[nodiscard]] std::span<const uint64_t> getIds() const noexcept { return ids; }
+            [[nodiscard]] std::span<const int32_t> getRawLatitudes() const noexcept { return latitudes; }
+            [[nodiscard]] std::span<const int32_t> getRawLongitudes() const noexcept { return longitudes; }
+
+            // dividing by the scale gives the correctly rounded double of the decimal value
+            static constexpr double SCALE = 1e7;
+
+        private:
+
+            SharedVector<uint64_t> ids;
+            SharedVector<int32_t> latitudes;
+            SharedVector<int32_t> longitudes;
+
+            bool sorted = true;
+
+    };
+}
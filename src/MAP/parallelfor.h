@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace AStarCities {
+
+    // number of threads used for a thread count of 0
+    inline uint32_t getHardwareThreadCount() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /*
+     * Split the range [0, count) into one contiguous block per thread and call
+     * function(begin, end) for every block. The calling thread works on the
+     * first block. With one thread or a small range everything runs on the
+     * calling thread, so the result must not depend on the thread count.
+     */
+    template <typename Function>
+    void parallelFor(std::size_t count, uint32_t threadCount, Function function, std::size_t minBlockSize = 1024) {
+
+        if (threadCount == 0)
+            threadCount = getHardwareThreadCount();
+
+        const std::size_t blockCount = std::min<std::size_t>(threadCount, std::max<std::size_t>(1, count / minBlockSize));
+        if (blockCount <= 1) {
+            function(std::size_t(0), count);
+            return;
+        }
+
+        const std::size_t blockSize = (count + blockCount - 1) / blockCount;
+
+        std::vector<std::jthread> threads;
+        threads.reserve(blockCount - 1);
+        for (std::size_t begin = blockSize; begin < count; begin += blockSize) {
+            threads.emplace_back([&function, begin, end = std::min(count, begin + blockSize)]() { function(begin, end); });
+        }
+
+        function(std::size_t(0), std::min(count, blockSize));
+    }
+}
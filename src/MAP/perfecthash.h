@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+namespace AStarCities {
+
+    /*
+     * Perfect hash over a fixed set of strings, generated at compile time.
+     * The seed of the hash function is increased until no two keys share
+     * a slot. A lookup is one hash, one table access and one compare.
+     */
+    template <typename Value, std::size_t N>
+    class PerfectHash {
+
+        public:
+
+            using Entry = std::pair<std::string_view, Value>;
+
+            consteval PerfectHash(const std::array<Entry, N>& entries, Value notFound) :
+                entries(entries), notFound(notFound) {
+
+                while (!tryFill())
+                    seed++;
+            }
+
+            [[nodiscard]] constexpr Value find(std::string_view key) const {
+                const uint16_t slot = slots[hash(key, seed) & MASK];
+                if (slot != EMPTY && entries[slot].first == key)
+                    return entries[slot].second;
+                return notFound;
+            }
+
+        private:
+
+            static constexpr std::size_t SIZE = std::bit_ceil(N) * 16;
+            static constexpr std::size_t MASK = SIZE - 1;
+            static constexpr uint16_t EMPTY = UINT16_MAX;
+
+            static_assert(N < EMPTY, "Too many keys for perfect hash");
+
+            [[nodiscard]] static constexpr uint32_t hash(std::string_view key, uint32_t seed) {
+                // FNV-1a with seeded offset basis
+                uint32_t value = 2166136261u ^ (seed * 2654435769u);
+                for (char character : key) {
+                    value ^= static_cast<uint8_t>(character);
+                    value *= 16777619u;
+                }
+                return value ^ (value >> 15);
+            }
+
+            consteval bool tryFill() {
+                slots.fill(EMPTY);
+                for (std::size_t ii = 0; ii < N; ii++) {
+                    uint16_t& slot = slots[hash(entries[ii].first, seed) & MASK];
+                    if (slot != EMPTY)
+                        return false;
+                    slot = static_cast<uint16_t>(ii);
+                }
+                return true;
+            }
+
+            std::array<Entry, N> entries;
+            std::array<uint16_t, SIZE> slots{};
+
+            Value notFound;
+            uint32_t seed = 0;
+
+    };
+}
@@ -1,61 +1,130 @@
 #pragma once
 
 #include "roadtype.h"
+#include "node.h"
+#include "stringpool.h"
 
 #include <cstdint>
-#include <functional>
-#include <string>
+#include <limits>
+#include <span>
+#include <string_view>
 
 namespace AStarCities {
 
-    class Node;
+    class Map;
     class Intersection;
 
+    using RoadIndex = uint32_t;
+    using IntersectionIndex = uint32_t;
+
+    /*
+     * Road stored in a map. The nodes are a range in the road node buffer of the map
+     * and the intersections at both ends are indices into its intersections.
+     *
+     * Internally roads are identified by their index, the osm id is only used
+     * to read and write map data.
+     */
     class Road {
 
         public:
 
-            Road(uint64_t id, const std::string& name, RoadType type) : id(id), name(name), type(type) {};
+            static constexpr RoadIndex NO_ROAD = std::numeric_limits<RoadIndex>::max();
+            static constexpr IntersectionIndex NO_INTERSECTION = std::numeric_limits<IntersectionIndex>::max();
 
-            virtual ~Road() = default;
+            // the name is an id in the road name pool of the map
+            Road(const Map& map, uint64_t id, StringPool::Id name, RoadType type, uint32_t firstNode, uint32_t nodeCount) :
+                map(&map), id(id), name(name), type(type), firstNode(firstNode), nodeCount(nodeCount) {};
 
             bool operator<(const Road& road) const { return road.id < id; }
 
-            void setNodes(const std::vector<std::reference_wrapper<const Node>>& nodes);
-
-            void setEndPoint(Intersection* intersection);
+            [[nodiscard]] RoadIndex        getIndex()  const;
+            [[nodiscard]] uint64_t         getId()     const noexcept { return id; }
+            [[nodiscard]] std::string_view getName()   const;
+            [[nodiscard]] StringPool::Id   getNameId() const noexcept { return name; }
+            [[nodiscard]] RoadType         getType()   const noexcept { return type; }
 
-            [[nodiscard]] uint64_t    getId()   const noexcept { return id; }
-            [[nodiscard]] std::string getName() const noexcept { return name; }
-            [[nodiscard]] RoadType    getType() const noexcept { return type; }
+            [[nodiscard]] Node getStartNode() const { return getNodes().front(); }
+            [[nodiscard]] Node getEndNode()   const { return getNodes().back(); }
 
-            [[nodiscard]] const Node& getStartNode() const { return nodes.begin()->get(); }
-            [[nodiscard]] const Node& getEndNode() const { return (nodes.end() - 1)->get(); }
-
-            [[nodiscard]] double getGlobalLength() const { return globalLength; }
-            [[nodiscard]] double getLocalLength()  const { return localLength; }
+            // length in metres, set when the road network is analysed
+            [[nodiscard]] double getLength() const noexcept { return length; }
 
             [[nodiscard]] std::pair<const Intersection&, const Intersection&> getIntersections() const;
 
-            [[nodiscard]] const std::vector<std::reference_wrapper<const Node>>& getNodes() const { return nodes; }
+            [[nodiscard]] NodeRange getNodes() const;
 
         private:
 
-            [[nodiscard]] double calculateLength(bool global) const;
+            friend class Map;
+            friend class MapSnapshot;
+            friend class TopologyBuilder;
+
+            const Map* map;
 
             uint64_t id;
 
-            std::string name;
+            StringPool::Id name;
 
             RoadType type;
 
-            std::vector<std::reference_wrapper<const Node>> nodes;
+            uint32_t firstNode;
+            uint32_t nodeCount;
+
+            double length = 0;
+
+            IntersectionIndex startIntersection = NO_INTERSECTION;
+            IntersectionIndex endIntersection = NO_INTERSECTION;
+
+    };
+
+    /*
+     * View of a range of road indices, like the roads of an intersection.
+     */
+    class RoadRange {
+
+        public:
+
+            class Iterator {
+
+                public:
+
+                    using value_type = Road;
+                    using difference_type = std::ptrdiff_t;
+
+                    Iterator() = default;
+                    Iterator(const Road* roads, const RoadIndex* index) : roads(roads), index(index) {};
+
+                    bool operator==(const Iterator& iterator) const { return index == iterator.index; }
+
+                    const Road& operator*() const { return roads[*index]; }
+
+                    Iterator& operator++() { index++; return *this; }
+                    Iterator operator++(int) { Iterator iterator = *this; index++; return iterator; }
+
+                private:
+
+                    const Road* roads = nullptr;
+                    const RoadIndex* index = nullptr;
+            };
+
+            RoadRange(const Road* roads, std::span<const RoadIndex> indices) :
+                roads(roads), indices(indices) {};
+
+            [[nodiscard]] std::size_t size() const noexcept { return indices.size(); }
+            [[nodiscard]] bool empty() const noexcept { return indices.empty(); }
+
+            [[nodiscard]] const Road& operator[](std::size_t position) const { return roads[indices[position]]; }
+
+            [[nodiscard]] Iterator begin() const { return Iterator(roads, indices.data()); }
+            [[nodiscard]] Iterator end()   const { return Iterator(roads, indices.data() + indices.size()); }
+
+            [[nodiscard]] std::span<const RoadIndex> getIndices() const noexcept { return indices; }
+
+        private:
 
-            double localLength;
-            double globalLength;
+            const Road* roads;
 
-            Intersection* startIntersection = nullptr;
-            Intersection* endIntersection = nullptr;
+            std::span<const RoadIndex> indices;
 
     };
 }
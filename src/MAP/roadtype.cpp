@@ -1,9 +1,12 @@
 
 #include "roadtype.h"
+#include "perfecthash.h"
 
 using namespace AStarCities;
 
-const std::map<std::string, RoadType::Type> RoadType::typeNameMap = {
+using enum RoadType::Type;
+
+static constexpr auto typeNames = std::to_array<std::pair<std::string_view, RoadType::Type>>({
     // ===== ROADS =====
     { "motorway",       MOTORWAY       },
     { "trunk",          TRUNK          },
@@ -48,7 +51,9 @@ const std::map<std::string, RoadType::Type> RoadType::typeNameMap = {
     { "crossing",       CROSSING       },
     { "proposed",       PROPOSED       },
     { "razed",          RAZED          }
-};
+});
+
+static constexpr PerfectHash<RoadType::Type, typeNames.size()> typeNameHash(typeNames, UNKNOWN);
 
 const std::set<RoadType> RoadType::ROADS = {
     MOTORWAY, TRUNK, PRIMARY, SECONDARY, TERTIARY, UNCLASSIFIED, RESIDENTIAL
@@ -84,10 +89,4 @@ const std::set<RoadType>& RoadType::getAll() {
     return allTypes;
 }
 
-RoadType::RoadType(const std::string& type) {
-    if (auto find = typeNameMap.find(type); find != typeNameMap.end()) {
-        this->type = find->second;
-    } else {
-        this->type = UNKNOWN;
-    }
-}
+RoadType::RoadType(std::string_view type) : type(typeNameHash.find(type)) {}
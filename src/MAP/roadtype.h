@@ -1,8 +1,7 @@
 #pragma once
 
 #include <cstdint>
-#include <string>
-#include <map>
+#include <string_view>
 #include <set>
 
 namespace AStarCities {
@@ -69,7 +68,7 @@ namespace AStarCities {
 
             RoadType() = default;
 
-            RoadType(const std::string& type);
+            RoadType(std::string_view type);
 
             RoadType(Type type) : type(type) {}
 
@@ -86,8 +85,6 @@ namespace AStarCities {
 
             Type type = Type::UNKNOWN;
 
-            static const std::map<std::string, Type> typeNameMap;
-
             static std::set<RoadType> allTypes;
     };
 }
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace AStarCities {
+
+    /*
+     * Vector whose values are shared by its copies or borrowed from memory
+     * owned by someone else, like a mapped snapshot file. A copy gets values
+     * of its own when it is changed for the first time (copy on write), so
+     * unchanged tables cost nothing to copy.
+     *
+     * The values are only read through the const functions. Changes go through
+     * edit and the functions that change the size, these copy the values first
+     * if they are shared or borrowed. Shared values are never changed, so a copy
+     * can be read by other threads while another copy is changed. The same copy
+     * must not be changed and read at the same time.
+     *
+     * The values keep the memory resource they are allocated from alive, so
+     * an arena can be released when no vector uses values allocated from it.
+     */
+    template <typename T>
+    class SharedVector {
+
+        public:
+
+            using value_type = T;
+            using const_iterator = const T*;
+
+            // the resource is not owned, it must outlive the values allocated from it
+            SharedVector(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+                resource(std::shared_ptr<void>(), resource) {}
+
+            SharedVector(std::shared_ptr<std::pmr::memory_resource> resource) :
+                resource(std::move(resource)) {}
+
+            virtual ~SharedVector() = default;
+
+            SharedVector(const SharedVector& other) = default;
+
+            SharedVector(SharedVector&& other) noexcept :
+                resource(other.resource), storage(std::move(other.storage)), lender(std::move(other.lender)), values(std::exchange(other.values, {})) {}
+
+            // shares the values, the vector keeps its memory resource for later changes
+            SharedVector& operator=(const SharedVector& other) {
+                storage = other.storage;
+                lender = other.lender;
+                values = other.values;
+                return *this;
+            }
+
+            SharedVector& operator=(SharedVector&& other) noexcept {
+                storage = std::move(other.storage);
+                lender = std::move(other.lender);
+                values = std::exchange(other.values, {});
+                return *this;
+            }
+
+            // takes the values, they are moved if the vector uses the same memory resource
+            SharedVector& operator=(std::pmr::vector<T>&& newValues) {
+                setStorage(std::make_shared<Storage>(resource, std::move(newValues)));
+                return *this;
+            }
+
+            // uses the values without copying them, the lender keeps them alive as long as they are used
+            void borrow(std::span<const T> borrowedValues, std::shared_ptr<const void> valuesLender) {
+                storage.reset();
+                lender = std::move(valuesLender);
+                values = borrowedValues;
+            }
+
+            [[nodiscard]] bool isBorrowed() const noexcept { return lender != nullptr; }
+
+            // the resource of the values that are allocated by this vector
+            [[nodiscard]] std::pmr::memory_resource* getMemoryResource() const noexcept { return resource.get(); }
+
+            // the values that can be changed, they are copied first if they are shared or borrowed
+            [[nodiscard]] std::span<T> edit() {
+                makeUnique();
+                return storage->values;
+            }
+
+            // moves the values out if they are not shared, copies them otherwise, the vector is empty afterwards,
+            // the resource of the values must outlive them
+            [[nodiscard]] std::pmr::vector<T> take() {
+                makeUnique();
+                std::pmr::vector<T> taken = std::move(storage->values);
+                storage.reset();
+                values = {};
+                return taken;
+            }
+
+            [[nodiscard]] std::size_t size() const noexcept { return values.size(); }
+            [[nodiscard]] bool empty() const noexcept { return values.empty(); }
+
+            // borrowed values are not allocated
+            [[nodiscard]] std::size_t capacity() const noexcept { return storage ? storage->values.capacity() : 0; }
+
+            [[nodiscard]] const T* data() const noexcept { return values.data(); }
+            [[nodiscard]] const_iterator begin() const noexcept { return values.data(); }
+            [[nodiscard]] const_iterator end() const noexcept { return values.data() + values.size(); }
+
+            [[nodiscard]] const T& operator[](std::size_t index) const { return values[index]; }
+            [[nodiscard]] const T& front() const { return values.front(); }
+            [[nodiscard]] const T& back() const { return values.back(); }
+
+            void push_back(const T& value) {
+                makeUnique();
+                storage->values.push_back(value);
+                values = storage->values;
+            }
+
+            template <typename Iterator>
+            void insert(const_iterator position, Iterator first, Iterator last) {
+                const std::ptrdiff_t offset = position - begin();
+                makeUnique();
+                storage->values.insert(storage->values.begin() + offset, first, last);
+                values = storage->values;
+            }
+
+            void erase(const_iterator first, const_iterator last) {
+                const std::ptrdiff_t offset = first - begin();
+                const std::ptrdiff_t count = last - first;
+                makeUnique();
+                storage->values.erase(storage->values.begin() + offset, storage->values.begin() + offset + count);
+                values = storage->values;
+            }
+
+            void resize(std::size_t count, const T& value = T()) {
+                makeUnique();
+                storage->values.resize(count, value);
+                values = storage->values;
+            }
+
+            void reserve(std::size_t count) {
+                makeUnique();
+                storage->values.reserve(count);
+                values = storage->values;
+            }
+
+            void shrink_to_fit() {
+                makeUnique();
+                storage->values.shrink_to_fit();
+                values = storage->values;
+            }
+
+            // the old values are not copied
+            void assign(std::size_t count, const T& value) {
+                makeEmpty();
+                storage->values.assign(count, value);
+                values = storage->values;
+            }
+
+            template <typename Iterator>
+            void assign(Iterator first, Iterator last) {
+                makeEmpty();
+                storage->values.assign(first, last);
+                values = storage->values;
+            }
+
+            void clear() {
+                makeEmpty();
+                values = storage->values;
+            }
+
+        private:
+
+            // the values keep their resource alive, it is destroyed after them
+            struct Storage {
+
+                Storage(std::shared_ptr<std::pmr::memory_resource> resource, std::pmr::vector<T>&& newValues) :
+                    resource(std::move(resource)), values(std::move(newValues), this->resource.get()) {}
+
+                template <typename Iterator>
+                Storage(std::shared_ptr<std::pmr::memory_resource> resource, Iterator first, Iterator last) :
+                    resource(std::move(resource)), values(first, last, this->resource.get()) {}
+
+                std::shared_ptr<std::pmr::memory_resource> resource;
+                std::pmr::vector<T> values;
+            };
+
+            void setStorage(std::shared_ptr<Storage> newStorage) {
+                storage = std::move(newStorage);
+                lender.reset();
+                values = storage->values;
+            }
+
+            // the count of the last other copy is released with acquire release ordering,
+            // the fence orders its reads of the values before the following changes
+            [[nodiscard]] bool isUnique() const noexcept {
+                if (!storage || storage.use_count() != 1)
+                    return false;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return true;
+            }
+
+            void makeUnique() {
+                if (!isUnique())
+                    setStorage(std::make_shared<Storage>(resource, values.begin(), values.end()));
+            }
+
+            // unique values without content, the capacity is kept if the values were unique
+            void makeEmpty() {
+                if (isUnique())
+                    storage->values.clear();
+                else
+                    setStorage(std::make_shared<Storage>(resource, values.begin(), values.begin()));
+            }
+
+            std::shared_ptr<std::pmr::memory_resource> resource;
+
+            // the owned values, nullptr if the values are borrowed
+            std::shared_ptr<Storage> storage;
+            std::shared_ptr<const void> lender;
+
+            std::span<const T> values;
+
+    };
+}
@@ -0,0 +1,127 @@
+
+#include "stringpool.h"
+
+#include <algorithm>
+#include <bit>
+#include <functional>
+
+using namespace AStarCities;
+
+StringPool::StringPool(std::pmr::memory_resource* resource) :
+    characters(resource), entries(resource), slots(resource) {
+
+    slots.assign(16, EMPTY);
+}
+
+StringPool::StringPool(const std::shared_ptr<std::pmr::memory_resource>& resource) :
+    characters(resource), entries(resource), slots(resource) {
+
+    slots.assign(16, EMPTY);
+}
+
+StringPool::Id StringPool::add(std::string_view string) {
+
+    const std::size_t slot = findSlot(string);
+    if (slots[slot] != EMPTY)
+        return slots[slot];
+
+    const Id id = static_cast<Id>(entries.size());
+    entries.push_back({static_cast<uint32_t>(characters.size()), static_cast<uint32_t>(string.size())});
+    characters.insert(characters.end(), string.begin(), string.end());
+    slots.edit()[slot] = id;
+
+    if (entries.size() * 2 > slots.size())
+        rehash(slots.size() * 2);
+
+    return id;
+}
+
+std::string_view StringPool::get(Id id) const {
+    const Entry& entry = entries[id];
+    return std::string_view(characters.data() + entry.offset, entry.length);
+}
+
+bool StringPool::assign(std::span<const Entry> newEntries, std::span<const char> newCharacters) {
+
+    characters.assign(newCharacters.begin(), newCharacters.end());
+    entries.assign(newEntries.begin(), newEntries.end());
+
+    for (const Entry& entry : entries) {
+        if (entry.offset > characters.size() || entry.length > characters.size() - entry.offset)
+            return false;
+    }
+
+    slots.assign(std::bit_ceil(std::max<std::size_t>(16, entries.size() * 2)), EMPTY);
+    for (Id id = 0; id < entries.size(); id++) {
+        const std::size_t slot = findSlot(get(id));
+        if (slots[slot] != EMPTY)
+            return false;
+        slots.edit()[slot] = id;
+    }
+
+    return true;
+}
+
+/*
+ * The slots depend on the hash of the standard library, a snapshot written
+ * by a program built with another library does not pass the check.
+ */
+bool StringPool::borrow(std::span<const Entry> newEntries, std::span<const char> newCharacters, std::span<const Id> newSlots,
+                        const std::shared_ptr<const void>& lender) {
+
+    characters.borrow(newCharacters, lender);
+    entries.borrow(newEntries, lender);
+    slots.borrow(newSlots, lender);
+
+    return isValid();
+}
+
+// the slots are checked first, so that findSlot ends on an empty slot
+bool StringPool::isValid() const {
+
+    if (slots.size() < 16 || !std::has_single_bit(slots.size()) || entries.size() * 2 > slots.size())
+        return false;
+
+    std::size_t usedSlots = 0;
+    for (Id id : slots) {
+        if (id != EMPTY && id >= entries.size())
+            return false;
+        usedSlots += id != EMPTY ? 1 : 0;
+    }
+    if (usedSlots != entries.size())
+        return false;
+
+    for (const Entry& entry : entries) {
+        if (entry.offset > characters.size() || entry.length > characters.size() - entry.offset)
+            return false;
+    }
+
+    for (Id id = 0; id < entries.size(); id++) {
+        if (slots[findSlot(get(id))] != id)
+            return false;
+    }
+
+    return true;
+}
+
+// linear probing, returns the slot of the string or the empty slot where it belongs
+std::size_t StringPool::findSlot(std::string_view string) const {
+
+    const std::size_t mask = slots.size() - 1;
+
+    std::size_t slot = std::hash<std::string_view>()(string) & mask;
+    while (slots[slot] != EMPTY && get(slots[slot]) != string)
+        slot = (slot + 1) & mask;
+
+    return slot;
+}
+
+void StringPool::rehash(std::size_t slotCount) {
+
+    slots.assign(slotCount, EMPTY);
+
+    const std::span<Id> newSlots = slots.edit();
+    for (Id id = 0; id < entries.size(); id++) {
+        newSlots[findSlot(get(id))] = id;
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "sharedvector.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace AStarCities {
+
+    /*
+     * Stores every distinct string once and identifies it by a 32 bit id,
+     * so strings can be compared by their ids. The characters of all strings
+     * are kept in one buffer and the ids are found with an open addressing
+     * hash table over the ids. Copies of the pool share the buffers until a
+     * string is added.
+     */
+    class StringPool {
+
+        public:
+
+            using Id = uint32_t;
+
+            // offset and length of a string in the character buffer
+            struct Entry {
+                uint32_t offset;
+                uint32_t length;
+            };
+
+            StringPool(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+            // the buffers keep the resource alive
+            StringPool(const std::shared_ptr<std::pmr::memory_resource>& resource);
+
+            virtual ~StringPool() = default;
+
+            // a copy shares the buffers, assigning keeps the memory resource of the pool
+            StringPool(const StringPool&) = default;
+            StringPool& operator=(const StringPool&) = default;
+
+            // returns the id of the string, the string is added if it is not in the pool yet
+            Id add(std::string_view string);
+
+            [[nodiscard]] std::string_view get(Id id) const;
+
+            [[nodiscard]] std::size_t size() const noexcept { return entries.size(); }
+
+            [[nodiscard]] std::size_t getAllocatedBytes() const noexcept {
+                return characters.capacity() + entries.capacity() * sizeof(Entry) + slots.capacity() * sizeof(Id);
+            }
+
+            [[nodiscard]] std::span<const Entry> getEntries() const noexcept { return entries; }
+            [[nodiscard]] std::span<const char> getCharacters() const noexcept { return characters; }
+            [[nodiscard]] std::span<const Id> getSlots() const noexcept { return slots; }
+
+            // replaces the pool, the ids are the indices of the entries,
+            // returns false if an entry is out of range or a string is stored twice
+            bool assign(std::span<const Entry> entries, std::span<const char> characters);
+
+            // uses the buffers and the hash table of a snapshot without copying them, the lender keeps them alive,
+            // returns false if an entry is out of range or a string is not found in its slot
+            bool borrow(std::span<const Entry> entries, std::span<const char> characters, std::span<const Id> slots,
+                        const std::shared_ptr<const void>& lender);
+
+        private:
+
+            static constexpr Id EMPTY = std::numeric_limits<Id>::max();
+
+            [[nodiscard]] std::size_t findSlot(std::string_view string) const;
+            void rehash(std::size_t slotCount);
+
+            [[nodiscard]] bool isValid() const;
+
+            SharedVector<char> characters;
+            SharedVector<Entry> entries;
+
+            // slot -> id, the size is a power of two and at most half of the slots are used
+            SharedVector<Id> slots;
+
+    };
+}
@@ -0,0 +1,398 @@
+#include "topologybuilder.h"
+#include "map.h"
+#include "parallelfor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+
+using namespace AStarCities;
+
+TopologyBuilder::TopologyBuilder(Map& map, uint32_t threadCount) :
+    map(map), threadCount(threadCount), sourceRoads(map.getMemoryResource()), sourceRoadNodes(map.getMemoryResource()) {}
+
+void TopologyBuilder::build() {
+
+    // the pieces reference the nodes of the source roads, both use the memory resource of the map
+    sourceRoads = std::move(map.roads);
+    sourceRoadNodes = map.roadNodes.take();
+    map.roads.clear();
+
+    countNodes();
+    splitRoads();
+    findIntersections();
+    fuseRoads();
+    writeRoadNetwork();
+}
+
+std::map<uint64_t, std::vector<uint64_t>> TopologyBuilder::getRoadSources() const {
+
+    std::map<uint64_t, std::vector<uint64_t>> roadSources;
+
+    for (const TopologyRoad& road : roads) {
+        if (road.removed)
+            continue;
+        std::vector<uint64_t>& sources = roadSources.emplace_hint(roadSources.end(), road.id, std::vector<uint64_t>())->second;
+        forEachPiece(road, [this, &sources](uint32_t piece, bool) {
+            sources.push_back(sourceRoads[roads[piece].source].getId());
+        });
+    }
+
+    return roadSources;
+}
+
+void TopologyBuilder::countNodes() {
+
+    nodeIntersections.assign(map.nodes.size(), 0);
+
+    parallelFor(sourceRoads.size(), threadCount, [this](std::size_t begin, std::size_t end) {
+        for (const Road& road : std::span(sourceRoads).subspan(begin, end - begin)) {
+            for (uint32_t ii = road.firstNode; ii < road.firstNode + road.nodeCount; ii++)
+                increment(nodeIntersections[sourceRoadNodes[ii]]);
+        }
+    });
+}
+
+/*
+ * Roads are split on every inner node used more than once. The last part of
+ * a road keeps the id of the road and is stored at the index of the road,
+ * the other parts get new ids in the order of the roads, so the pieces are
+ * ordered by id and the ids do not depend on the thread count.
+ */
+void TopologyBuilder::splitRoads() {
+
+    const auto isSplitNode = [this](uint32_t node) { return nodeIntersections[sourceRoadNodes[node]] > 1; };
+
+    // road -> index of its first inner piece
+    std::vector<uint32_t> splitOffsets(sourceRoads.size() + 1, 0);
+    parallelFor(sourceRoads.size(), threadCount, [this, &isSplitNode, &splitOffsets](std::size_t begin, std::size_t end) {
+        for (std::size_t source = begin; source < end; source++) {
+            const Road& road = sourceRoads[source];
+            for (uint32_t ii = road.firstNode + 1; ii + 1 < road.firstNode + road.nodeCount; ii++) {
+                if (isSplitNode(ii))
+                    splitOffsets[source]++;
+            }
+        }
+    });
+    std::exclusive_scan(splitOffsets.begin(), splitOffsets.end(), splitOffsets.begin(), uint32_t(0));
+
+    const uint32_t splitCount = splitOffsets.back();
+    const uint64_t firstId = map.idHandler.getNewIds(splitCount);
+
+    pieces.resize(sourceRoads.size() + splitCount);
+    roads.resize(sourceRoads.size() + splitCount);
+
+    const auto setPiece = [this](uint32_t index, uint64_t id, RoadIndex source, uint32_t firstNode, uint32_t nodeCount) {
+        pieces[index] = Piece{firstNode, nodeCount};
+        roads[index] = TopologyRoad{id, source, sourceRoadNodes[firstNode], sourceRoadNodes[firstNode + nodeCount - 1], index, index};
+    };
+
+    parallelFor(sourceRoads.size(), threadCount, [&](std::size_t begin, std::size_t end) {
+        for (RoadIndex source = static_cast<RoadIndex>(begin); source < end; source++) {
+
+            const Road& road = sourceRoads[source];
+            const uint32_t lastNode = road.firstNode + road.nodeCount - 1;
+
+            uint32_t split = splitOffsets[source];
+            uint32_t lastIntersection = road.firstNode;
+            for (uint32_t ii = road.firstNode + 1; ii < lastNode; ii++) {
+                if (isSplitNode(ii)) {
+                    const uint32_t index = static_cast<uint32_t>(sourceRoads.size()) + split;
+                    setPiece(index, firstId + split, source, lastIntersection, ii - lastIntersection + 1);
+                    lastIntersection = ii;
+                    split++;
+                }
+            }
+
+            setPiece(source, road.getId(), source, lastIntersection, lastNode - lastIntersection + 1);
+        }
+    });
+}
+
+/*
+ * After the split only the ends of the pieces are shared, nodes used by more
+ * than one piece end are intersections. The roads of an intersection are
+ * sorted, so they are ordered by id like the pieces.
+ */
+void TopologyBuilder::findIntersections() {
+
+    std::ranges::fill(nodeIntersections, 0);
+    parallelFor(roads.size(), threadCount, [this](std::size_t begin, std::size_t end) {
+        for (const TopologyRoad& road : std::span(roads).subspan(begin, end - begin)) {
+            increment(nodeIntersections[road.startNode]);
+            increment(nodeIntersections[road.endNode]);
+        }
+    });
+
+    uint32_t roadCount = 0;
+    for (NodeIndex node = 0; node < nodeIntersections.size(); node++) {
+        if (nodeIntersections[node] > 1) {
+            const uint32_t roadsAtNode = nodeIntersections[node];
+            nodeIntersections[node] = static_cast<uint32_t>(intersectionNodes.size());
+            intersectionNodes.push_back(node);
+            intersectionOffsets.push_back(roadCount);
+            roadCount += roadsAtNode;
+        } else {
+            nodeIntersections[node] = NONE;
+        }
+    }
+
+    intersectionSizes.assign(intersectionNodes.size(), 0);
+    intersectionRoads.resize(roadCount);
+
+    parallelFor(roads.size(), threadCount, [this](std::size_t begin, std::size_t end) {
+        for (uint32_t road = static_cast<uint32_t>(begin); road < end; road++) {
+            for (NodeIndex node : {roads[road].startNode, roads[road].endNode}) {
+                if (const uint32_t intersection = nodeIntersections[node]; intersection != NONE)
+                    intersectionRoads[intersectionOffsets[intersection] + increment(intersectionSizes[intersection])] = road;
+            }
+        }
+    });
+
+    parallelFor(intersectionNodes.size(), threadCount, [this](std::size_t begin, std::size_t end) {
+        for (std::size_t intersection = begin; intersection < end; intersection++) {
+            const auto roadsBegin = intersectionRoads.begin() + intersectionOffsets[intersection];
+            std::sort(roadsBegin, roadsBegin + intersectionSizes[intersection]);
+        }
+    });
+}
+
+/*
+ * Remove intersections that have exactly two connected roads
+ */
+void TopologyBuilder::fuseRoads() {
+
+    for (uint32_t intersection = 0; intersection < intersectionNodes.size(); intersection++) {
+
+        if (intersectionSizes[intersection] != 2)
+            continue;
+
+        const uint32_t road1 = intersectionRoads[intersectionOffsets[intersection]];
+        const uint32_t road2 = intersectionRoads[intersectionOffsets[intersection] + 1];
+
+        if (road1 != road2 && canFuse(road1, road2)) {
+            fuseRoads(intersectionNodes[intersection], road1, road2);
+            intersectionSizes[intersection] = 0;
+        }
+    }
+}
+
+/*
+ * The roads are connected at the first matching pair of ends, checked in the
+ * same order as before, so the direction of the fused road does not change.
+ */
+void TopologyBuilder::fuseRoads(NodeIndex node, uint32_t road1, uint32_t road2) {
+
+    const TopologyRoad first = roads[road1];
+    const TopologyRoad second = roads[road2];
+
+    TopologyRoad road{map.idHandler.getNewId(), first.source, 0, 0, 0, 0};
+
+    if (first.startNode == second.startNode) {
+        linkPieces(first.startPiece, second.startPiece);
+        road.startNode = first.endNode;   road.startPiece = first.endPiece;
+        road.endNode = second.endNode;    road.endPiece = second.endPiece;
+    } else if (first.startNode == second.endNode) {
+        linkPieces(first.startPiece, second.endPiece);
+        road.startNode = first.endNode;   road.startPiece = first.endPiece;
+        road.endNode = second.startNode;  road.endPiece = second.startPiece;
+    } else if (first.endNode == second.startNode) {
+        linkPieces(first.endPiece, second.startPiece);
+        road.startNode = first.startNode; road.startPiece = first.startPiece;
+        road.endNode = second.endNode;    road.endPiece = second.endPiece;
+    } else if (first.endNode == second.endNode) {
+        linkPieces(first.endPiece, second.endPiece);
+        road.startNode = first.startNode; road.startPiece = first.startPiece;
+        road.endNode = second.startNode;  road.endPiece = second.startPiece;
+    } else {
+        std::cerr << "Map - Error: unable to connect roads: " << first.id << " and " << second.id << std::endl;
+        return;
+    }
+
+    const uint32_t newRoad = static_cast<uint32_t>(roads.size());
+    roads.push_back(road);
+
+    // replace the roads on their other intersections
+    replaceRoad(first.endNode == node ? first.startNode : first.endNode, road1, newRoad);
+    replaceRoad(second.endNode == node ? second.startNode : second.endNode, road2, newRoad);
+
+    roads[road1].removed = true;
+    roads[road2].removed = true;
+}
+
+/*
+ * The new road has the highest id, moving it to the back keeps the roads
+ * of the intersection ordered by id.
+ */
+void TopologyBuilder::replaceRoad(NodeIndex node, uint32_t oldRoad, uint32_t newRoad) {
+
+    const uint32_t intersection = nodeIntersections[node];
+    if (intersection == NONE)
+        return;
+
+    const auto begin = intersectionRoads.begin() + intersectionOffsets[intersection];
+    const auto end = begin + intersectionSizes[intersection];
+    const auto iterator = std::find(begin, end, oldRoad);
+    if (iterator == end)
+        return;
+
+    std::rotate(iterator, iterator + 1, end);
+    *(end - 1) = newRoad;
+}
+
+/*
+ * Every end of a remaining road is an intersection. The roads set at the
+ * ends are added after the roads that were already at the intersection.
+ */
+void TopologyBuilder::writeRoadNetwork() {
+
+    // node -> number of roads
+    parallelFor(nodeIntersections.size(), threadCount, [this](std::size_t begin, std::size_t end) {
+        for (std::size_t node = begin; node < end; node++) {
+            const uint32_t intersection = nodeIntersections[node];
+            nodeIntersections[node] = intersection != NONE ? intersectionSizes[intersection] : 0;
+        }
+    });
+
+    // the road indices follow the id order of the remaining roads
+    std::vector<uint32_t> remainingRoads;
+    for (uint32_t road = 0; road < roads.size(); road++) {
+        if (!roads[road].removed) {
+            roads[road].index = static_cast<RoadIndex>(remainingRoads.size());
+            remainingRoads.push_back(road);
+        }
+    }
+
+    // road -> index of its first node
+    std::vector<uint32_t> roadNodeOffsets(remainingRoads.size() + 1, 0);
+    parallelFor(remainingRoads.size(), threadCount, [this, &remainingRoads, &roadNodeOffsets](std::size_t begin, std::size_t end) {
+        for (std::size_t ii = begin; ii < end; ii++) {
+            const TopologyRoad& road = roads[remainingRoads[ii]];
+            increment(nodeIntersections[road.startNode]);
+            increment(nodeIntersections[road.endNode]);
+            // the first node of every following piece is the last node of the previous piece
+            forEachPiece(road, [this, &roadNodeOffsets, ii](uint32_t piece, bool) { roadNodeOffsets[ii] += pieces[piece].nodeCount - 1; });
+            roadNodeOffsets[ii]++;
+        }
+    });
+    std::exclusive_scan(roadNodeOffsets.begin(), roadNodeOffsets.end(), roadNodeOffsets.begin(), uint32_t(0));
+
+    // node -> index of the new intersection
+    map.intersections.clear();
+    std::vector<uint32_t> intersectionFill;
+    uint32_t intersectionRoadCount = 0;
+    for (NodeIndex node = 0; node < nodeIntersections.size(); node++) {
+        if (nodeIntersections[node] > 0) {
+            map.intersections.emplace_back(map, node, intersectionRoadCount, nodeIntersections[node]);
+            intersectionFill.push_back(intersectionRoadCount);
+            intersectionRoadCount += nodeIntersections[node];
+            nodeIntersections[node] = static_cast<uint32_t>(intersectionFill.size() - 1);
+        } else {
+            nodeIntersections[node] = NONE;
+        }
+    }
+
+    // the roads that were already at the intersections
+    // the tables of the map are written by all threads, so they are made editable first
+    map.intersectionRoads.assign(intersectionRoadCount, 0);
+    const std::span<RoadIndex> newIntersectionRoads = map.intersectionRoads.edit();
+    parallelFor(intersectionNodes.size(), threadCount, [this, &intersectionFill, newIntersectionRoads](std::size_t begin, std::size_t end) {
+        for (std::size_t intersection = begin; intersection < end; intersection++) {
+            if (intersectionSizes[intersection] == 0)
+                continue;
+            uint32_t& fill = intersectionFill[nodeIntersections[intersectionNodes[intersection]]];
+            const auto roadsBegin = intersectionRoads.begin() + intersectionOffsets[intersection];
+            for (auto iterator = roadsBegin; iterator != roadsBegin + intersectionSizes[intersection]; iterator++)
+                newIntersectionRoads[fill++] = roads[*iterator].index;
+        }
+    });
+    const std::vector<uint32_t> endRoadsBegin = intersectionFill;
+
+    map.roads.reserve(remainingRoads.size());
+    for (std::size_t ii = 0; ii < remainingRoads.size(); ii++) {
+        const TopologyRoad& road = roads[remainingRoads[ii]];
+        const Road& source = sourceRoads[road.source];
+        map.roads.emplace_back(map, road.id, source.name, source.type, roadNodeOffsets[ii], roadNodeOffsets[ii + 1] - roadNodeOffsets[ii]);
+    }
+
+    map.roadNodes.resize(roadNodeOffsets.back());
+    const std::span<NodeIndex> newRoadNodes = map.roadNodes.edit();
+    parallelFor(remainingRoads.size(), threadCount, [this, &remainingRoads, &intersectionFill, newRoadNodes, newIntersectionRoads](std::size_t begin, std::size_t end) {
+        for (std::size_t ii = begin; ii < end; ii++) {
+
+            const TopologyRoad& road = roads[remainingRoads[ii]];
+            Road& newRoad = map.roads[ii];
+
+            auto output = newRoadNodes.begin() + newRoad.firstNode;
+            forEachPiece(road, [this, &output, &newRoad, newRoadNodes](uint32_t index, bool reversed) {
+                const Piece& piece = pieces[index];
+                const auto begin = sourceRoadNodes.begin() + piece.firstNode;
+                const auto end = begin + piece.nodeCount;
+                const std::ptrdiff_t skip = output == newRoadNodes.begin() + newRoad.firstNode ? 0 : 1;
+                if (!reversed)
+                    output = std::copy(begin + skip, end, output);
+                else
+                    output = std::copy(std::make_reverse_iterator(end) + skip, std::make_reverse_iterator(begin), output);
+            });
+
+            newRoad.startIntersection = nodeIntersections[road.startNode];
+            newRoad.endIntersection = nodeIntersections[road.endNode];
+
+            newIntersectionRoads[increment(intersectionFill[newRoad.startIntersection])] = road.index;
+            newIntersectionRoads[increment(intersectionFill[newRoad.endIntersection])] = road.index;
+        }
+    });
+
+    // the roads set at the ends are ordered by id
+    parallelFor(endRoadsBegin.size(), threadCount, [&endRoadsBegin, &intersectionFill, newIntersectionRoads](std::size_t begin, std::size_t end) {
+        for (std::size_t intersection = begin; intersection < end; intersection++) {
+            std::sort(newIntersectionRoads.begin() + endRoadsBegin[intersection], newIntersectionRoads.begin() + intersectionFill[intersection]);
+        }
+    });
+}
+
+void TopologyBuilder::linkPieces(uint32_t piece1, uint32_t piece2) {
+    Piece& first = pieces[piece1];
+    Piece& second = pieces[piece2];
+    first.links[first.links[0] == NONE ? 0 : 1] = piece2;
+    second.links[second.links[0] == NONE ? 0 : 1] = piece1;
+}
+
+/*
+ * Walk the pieces of a road from its start node. A piece is reversed if
+ * it does not start at the end of the previous piece.
+ */
+template<typename Function>
+void TopologyBuilder::forEachPiece(const TopologyRoad& road, Function function) const {
+
+    NodeIndex node = road.startNode;
+    uint32_t previous = NONE;
+    uint32_t current = road.startPiece;
+
+    while (current != NONE) {
+
+        const Piece& piece = pieces[current];
+        const NodeIndex front = sourceRoadNodes[piece.firstNode];
+        const NodeIndex back = sourceRoadNodes[piece.firstNode + piece.nodeCount - 1];
+        const bool reversed = front != node;
+
+        function(current, reversed);
+
+        node = reversed ? front : back;
+        const uint32_t next = piece.links[0] != previous ? piece.links[0] : piece.links[1];
+        previous = current;
+        current = next;
+    }
+}
+
+uint32_t TopologyBuilder::increment(uint32_t& value) {
+    return std::atomic_ref<uint32_t>(value).fetch_add(1, std::memory_order_relaxed);
+}
+
+bool TopologyBuilder::canFuse(uint32_t road1, uint32_t road2) const {
+    const Road& first = sourceRoads[roads[road1].source];
+    const Road& second = sourceRoads[roads[road2].source];
+    return first.type == second.type && first.name == second.name;
+}
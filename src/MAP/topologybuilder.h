@@ -0,0 +1,100 @@
+#pragma once
+
+#include "node.h"
+#include "road.h"
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <vector>
+
+namespace AStarCities {
+
+    class Map;
+
+    /*
+     * Builds the analysed road network of a map in one pass over the road nodes.
+     * The roads are split on nodes used more than once and roads meeting at
+     * intersections with only two roads of the same name and type are fused.
+     *
+     * Split roads are ranges in the road node buffer of the map and fused roads
+     * are chains of these ranges, so no nodes are copied until the new road
+     * network is written back to the map.
+     */
+    class TopologyBuilder {
+
+        public:
+
+            // a thread count of 0 uses all hardware threads
+            TopologyBuilder(Map& map, uint32_t threadCount = 0);
+            virtual ~TopologyBuilder() = default;
+
+            // replaces the roads and intersections of the map
+            void build();
+
+            // analysed road id -> ids of the roads it is made of, valid after build
+            [[nodiscard]] std::map<uint64_t, std::vector<uint64_t>> getRoadSources() const;
+
+        private:
+
+            static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+            // range of nodes of a source road, linked to its neighbours in a fused road
+            struct Piece {
+                uint32_t firstNode;
+                uint32_t nodeCount;
+                uint32_t links[2] = {NONE, NONE};
+            };
+
+            // the first pieces are the split roads, fused roads are appended
+            struct TopologyRoad {
+                uint64_t id;
+                RoadIndex source;
+                NodeIndex startNode;
+                NodeIndex endNode;
+                uint32_t startPiece;
+                uint32_t endPiece;
+                bool removed = false;
+                RoadIndex index = NONE;
+            };
+
+            void countNodes();
+            void splitRoads();
+            void findIntersections();
+            void fuseRoads();
+            void fuseRoads(NodeIndex node, uint32_t road1, uint32_t road2);
+            void replaceRoad(NodeIndex node, uint32_t oldRoad, uint32_t newRoad);
+            void writeRoadNetwork();
+
+            void linkPieces(uint32_t piece1, uint32_t piece2);
+
+            template<typename Function>
+            void forEachPiece(const TopologyRoad& road, Function function) const;
+
+            // atomic increment, returns the previous value
+            static uint32_t increment(uint32_t& value);
+
+            [[nodiscard]] bool canFuse(uint32_t road1, uint32_t road2) const;
+
+            Map& map;
+
+            uint32_t threadCount;
+
+            std::pmr::vector<Road> sourceRoads;
+            std::pmr::vector<NodeIndex> sourceRoadNodes;
+
+            // node -> number of uses, later node -> intersection
+            std::vector<uint32_t> nodeIntersections;
+
+            std::vector<Piece> pieces;
+            std::vector<TopologyRoad> roads;
+
+            // roads of an intersection are a range in intersectionRoads
+            std::vector<NodeIndex> intersectionNodes;
+            std::vector<uint32_t> intersectionOffsets;
+            std::vector<uint32_t> intersectionSizes;
+            std::vector<uint32_t> intersectionRoads;
+
+    };
+}
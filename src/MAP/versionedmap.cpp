@@ -0,0 +1,23 @@
+
+#include "versionedmap.h"
+
+using namespace AStarCities;
+
+VersionedMap::VersionedMap(std::shared_ptr<const Map> map, ResourceFactory createResource) :
+    current(std::move(map)), createResource(std::move(createResource)) {}
+
+uint64_t VersionedMap::update(const std::function<void(Map&)>& function) {
+
+    const std::lock_guard<std::mutex> lock(updateMutex);
+
+    // only updates replace the current version, so it is not replaced while it is copied
+    std::shared_ptr<Map> next = current.load(std::memory_order_acquire)->clone(createResource ? createResource() : nullptr);
+    function(*next);
+
+    current.store(std::move(next), std::memory_order_release);
+    return version.fetch_add(1, std::memory_order_acq_rel) + 1;
+}
+
+uint64_t VersionedMap::applyChange(const MapChange& change) {
+    return update([&change](Map& map) { map.applyChange(change); });
+}
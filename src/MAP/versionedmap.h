@@ -0,0 +1,69 @@
+#pragma once
+
+#include "map.h"
+#include "mapchange.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+
+namespace AStarCities {
+
+    /*
+     * Versions of a map for readers running concurrently with updates. Every
+     * published version is immutable. A reader pins the current version and
+     * keeps using it until it releases it, so references to its entities stay
+     * valid. A version is freed with its last reader.
+     *
+     * An update changes a copy of the current version and publishes it with an
+     * atomic pointer swap, so readers never wait for an update. Updates are
+     * applied one after another. The copy shares the tables it does not change
+     * with the current version, only the roads, intersections, buildings and
+     * connections are copied for every version, they point to their map.
+     *
+     * Every version is allocated from a memory resource of its own. A table
+     * shared by later versions keeps its resource alive, so an arena is released
+     * once no version uses a table allocated from it. Tables are released by the
+     * thread dropping the last pin, so the resources must allow deallocations
+     * from any thread, like a monotonic buffer or a synchronized pool resource.
+     */
+    class VersionedMap {
+
+        public:
+
+            // creates the memory resource of a new version, nullptr uses the default resource
+            using ResourceFactory = std::function<std::shared_ptr<std::pmr::memory_resource>()>;
+
+            // the map must be the last copy of its source roads to apply changes
+            VersionedMap(std::shared_ptr<const Map> map, ResourceFactory createResource = {});
+            virtual ~VersionedMap() = default;
+
+            VersionedMap(const VersionedMap&) = delete;
+            VersionedMap& operator=(const VersionedMap&) = delete;
+
+            // the current version, stays valid as long as it is held
+            [[nodiscard]] std::shared_ptr<const Map> pin() const { return current.load(std::memory_order_acquire); }
+
+            // number of published updates, incremented after the new version is published
+            [[nodiscard]] uint64_t getVersion() const noexcept { return version.load(std::memory_order_acquire); }
+
+            // applies the update to a copy of the current version and publishes it,
+            // returns the number of the new version
+            uint64_t update(const std::function<void(Map&)>& function);
+
+            uint64_t applyChange(const MapChange& change);
+
+        private:
+
+            std::atomic<std::shared_ptr<const Map>> current;
+            std::atomic<uint64_t> version = 0;
+
+            ResourceFactory createResource;
+
+            std::mutex updateMutex;
+
+    };
+}
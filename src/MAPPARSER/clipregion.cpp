@@ -0,0 +1,82 @@
+
+#include "clipregion.h"
+
+#include <algorithm>
+
+using namespace AStarCities;
+
+ClipRegion::ClipRegion(double minlat, double maxlat, double minlon, double maxlon) :
+    minLatitude(minlat), maxLatitude(maxlat), minLongitude(minlon), maxLongitude(maxlon) {
+
+}
+
+ClipRegion::ClipRegion(const std::vector<std::pair<double, double>>& polygon) :
+    polygon(polygon), minLatitude(90), maxLatitude(-90), minLongitude(180), maxLongitude(-180) {
+
+    for (const auto& [lat, lon] : polygon) {
+        minLatitude  = std::min(minLatitude,  lat);
+        maxLatitude  = std::max(maxLatitude,  lat);
+        minLongitude = std::min(minLongitude, lon);
+        maxLongitude = std::max(maxLongitude, lon);
+    }
+}
+
+bool ClipRegion::contains(double lat, double lon) const {
+
+    if (lat < minLatitude || lat > maxLatitude || lon < minLongitude || lon > maxLongitude)
+        return false;
+
+    return polygon.empty() || polygonContains(lat, lon);
+}
+
+bool ClipRegion::containsWithMargin(double lat, double lon) const {
+
+    if (lat < minLatitude  - margin || lat > maxLatitude  + margin ||
+        lon < minLongitude - margin || lon > maxLongitude + margin)
+        return false;
+
+    return polygon.empty() || polygonContains(lat, lon) || polygonEdgeWithinMargin(lat, lon);
+}
+
+/*
+ * Even odd rule: count the polygon edges crossed by a ray from the point
+ * in direction of increasing longitude.
+ */
+bool ClipRegion::polygonContains(double lat, double lon) const {
+
+    bool inside = false;
+
+    for (std::size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+        const auto [lat1, lon1] = polygon[i];
+        const auto [lat2, lon2] = polygon[j];
+        if ((lat1 > lat) != (lat2 > lat)) {
+            const double crossingLon = lon1 + (lat - lat1) / (lat2 - lat1) * (lon2 - lon1);
+            if (lon < crossingLon)
+                inside = !inside;
+        }
+    }
+
+    return inside;
+}
+
+/*
+ * Distance to the closest point of every polygon edge, measured in
+ * degrees in both directions like the margin around the box.
+ */
+bool ClipRegion::polygonEdgeWithinMargin(double lat, double lon) const {
+
+    for (std::size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+        const auto [lat1, lon1] = polygon[i];
+        const auto [lat2, lon2] = polygon[j];
+        const double edgeLat = lat2 - lat1;
+        const double edgeLon = lon2 - lon1;
+        const double edgeLength = edgeLat * edgeLat + edgeLon * edgeLon;
+        const double position = edgeLength > 0 ? std::clamp(((lat - lat1) * edgeLat + (lon - lon1) * edgeLon) / edgeLength, 0.0, 1.0) : 0.0;
+        const double distanceLat = lat - (lat1 + position * edgeLat);
+        const double distanceLon = lon - (lon1 + position * edgeLon);
+        if (distanceLat * distanceLat + distanceLon * distanceLon <= margin * margin)
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+namespace AStarCities {
+
+    /*
+     * Region of interest for the map parser, either a bounding box or a
+     * polygon of (latitude, longitude) points. Nodes within the margin
+     * around the box or the polygon are kept as well, most ways crossing
+     * the border end at one of them. Their first nodes outside beyond the
+     * margin are read by the parser in a second pass.
+     */
+    class ClipRegion {
+
+        public:
+
+            ClipRegion(double minlat, double maxlat, double minlon, double maxlon);
+            ClipRegion(const std::vector<std::pair<double, double>>& polygon);
+            virtual ~ClipRegion() = default;
+
+            // margin in degrees, the default of 0.01 is roughly one kilometer
+            void setMargin(double margin) { this->margin = margin; }
+
+            [[nodiscard]] bool contains(double lat, double lon) const;
+            [[nodiscard]] bool containsWithMargin(double lat, double lon) const;
+
+            [[nodiscard]] double getMinLatitude()  const noexcept { return minLatitude;  }
+            [[nodiscard]] double getMaxLatitude()  const noexcept { return maxLatitude;  }
+            [[nodiscard]] double getMinLongitude() const noexcept { return minLongitude; }
+            [[nodiscard]] double getMaxLongitude() const noexcept { return maxLongitude; }
+
+        private:
+
+            [[nodiscard]] bool polygonContains(double lat, double lon) const;
+            [[nodiscard]] bool polygonEdgeWithinMargin(double lat, double lon) const;
+
+            std::vector<std::pair<double, double>> polygon;
+
+            double minLatitude;
+            double maxLatitude;
+            double minLongitude;
+            double maxLongitude;
+
+            double margin = 0.01;
+
+    };
+}
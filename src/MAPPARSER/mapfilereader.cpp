@@ -0,0 +1,194 @@
+
+#include "mapfilereader.h"
+
+#include <zlib.h>
+#include <bzlib.h>
+
+#include <array>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using namespace AStarCities;
+
+MapFileReader::MapFileReader(const std::string& filePath, std::size_t chunkSize, std::size_t maxQueuedChunks) :
+    filePath(filePath), chunkSize(chunkSize), maxQueuedChunks(maxQueuedChunks) {
+
+    thread = std::thread(&MapFileReader::run, this);
+}
+
+MapFileReader::~MapFileReader() {
+
+    {
+        std::lock_guard lock(mutex);
+        stopped = true;
+    }
+    spaceAvailable.notify_all();
+
+    if (thread.joinable())
+        thread.join();
+}
+
+MapFileReader::Compression MapFileReader::detectCompression(const std::string& filePath) {
+
+    std::ifstream fileStream(filePath, std::ios::binary);
+
+    std::array<char, 3> magic{};
+    fileStream.read(magic.data(), magic.size());
+
+    if (fileStream.gcount() >= 2 && magic[0] == '\x1F' && magic[1] == '\x8B')
+        return Compression::GZIP;
+    if (fileStream.gcount() == 3 && magic[0] == 'B' && magic[1] == 'Z' && magic[2] == 'h')
+        return Compression::BZIP2;
+
+    return Compression::NONE;
+}
+
+bool MapFileReader::readChunk(std::string& chunk) {
+
+    std::unique_lock lock(mutex);
+    chunkAvailable.wait(lock, [this] { return finished || !chunks.empty(); });
+
+    if (chunks.empty())
+        return false;
+
+    chunk = std::move(chunks.front());
+    chunks.pop_front();
+
+    spaceAvailable.notify_one();
+    return true;
+}
+
+void MapFileReader::run() {
+
+    switch (detectCompression(filePath)) {
+        case Compression::NONE:
+            readPlain();
+            break;
+        case Compression::GZIP:
+            readGzip();
+            break;
+        case Compression::BZIP2:
+            readBzip2();
+            break;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        finished = true;
+    }
+    chunkAvailable.notify_all();
+}
+
+void MapFileReader::readPlain() {
+
+    std::ifstream fileStream(filePath, std::ios::binary);
+    if (!fileStream.is_open()) {
+        setError("Failed to read file " + filePath);
+        return;
+    }
+
+    while (fileStream) {
+        std::string chunk(chunkSize, '\0');
+        fileStream.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        chunk.resize(static_cast<std::size_t>(fileStream.gcount()));
+        if (chunk.empty() || !pushChunk(std::move(chunk)))
+            break;
+    }
+}
+
+void MapFileReader::readGzip() {
+
+    gzFile file = gzopen(filePath.c_str(), "rb");
+    if (file == nullptr) {
+        setError("Failed to read file " + filePath);
+        return;
+    }
+
+    gzbuffer(file, 1 << 20);
+
+    while (true) {
+        std::string chunk(chunkSize, '\0');
+        const int bytes = gzread(file, chunk.data(), static_cast<unsigned int>(chunk.size()));
+        if (bytes < 0) {
+            setError("Failed to decompress gzip file " + filePath);
+            break;
+        }
+        chunk.resize(static_cast<std::size_t>(bytes));
+        if (chunk.empty() || !pushChunk(std::move(chunk)))
+            break;
+    }
+
+    gzclose(file);
+}
+
+void MapFileReader::readBzip2() {
+
+    FILE* file = std::fopen(filePath.c_str(), "rb");
+    if (file == nullptr) {
+        setError("Failed to read file " + filePath);
+        return;
+    }
+
+    int bzError = BZ_OK;
+    BZFILE* bzFile = BZ2_bzReadOpen(&bzError, file, 0, 0, nullptr, 0);
+
+    while (bzFile != nullptr && bzError == BZ_OK) {
+
+        std::string chunk(chunkSize, '\0');
+        const int bytes = BZ2_bzRead(&bzError, bzFile, chunk.data(), static_cast<int>(chunk.size()));
+        if (bzError != BZ_OK && bzError != BZ_STREAM_END) {
+            setError("Failed to decompress bzip2 file " + filePath);
+            break;
+        }
+
+        chunk.resize(static_cast<std::size_t>(bytes));
+        if (!chunk.empty() && !pushChunk(std::move(chunk)))
+            break;
+
+        if (bzError == BZ_STREAM_END) {
+
+            // files from parallel compressors consist of multiple streams
+            void* unused = nullptr;
+            int unusedCount = 0;
+            BZ2_bzReadGetUnused(&bzError, bzFile, &unused, &unusedCount);
+            std::string rest(static_cast<const char*>(unused), static_cast<std::size_t>(unusedCount));
+
+            BZ2_bzReadClose(&bzError, bzFile);
+            bzFile = nullptr;
+
+            if (rest.empty()) {
+                const int next = std::fgetc(file);
+                if (next == EOF)
+                    break;
+                std::ungetc(next, file);
+            }
+
+            bzFile = BZ2_bzReadOpen(&bzError, file, 0, 0, rest.data(), static_cast<int>(rest.size()));
+        }
+    }
+
+    if (bzFile != nullptr)
+        BZ2_bzReadClose(&bzError, bzFile);
+
+    std::fclose(file);
+}
+
+bool MapFileReader::pushChunk(std::string&& chunk) {
+
+    std::unique_lock lock(mutex);
+    spaceAvailable.wait(lock, [this] { return stopped || chunks.size() < maxQueuedChunks; });
+
+    if (stopped)
+        return false;
+
+    chunks.push_back(std::move(chunk));
+
+    chunkAvailable.notify_one();
+    return true;
+}
+
+void MapFileReader::setError(const std::string& message) {
+    std::cerr << "Parser - " << message << std::endl;
+    error = true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace AStarCities {
+
+    /*
+     * Reads a map file on its own thread and passes it on in chunks through
+     * a bounded queue. Gzip and bzip2 compressed files are decompressed on
+     * the fly, so reading, decompression and parsing run at the same time.
+     */
+    class MapFileReader {
+
+        public:
+
+            enum class Compression {
+                NONE,
+                GZIP,
+                BZIP2
+            };
+
+            MapFileReader(const std::string& filePath, std::size_t chunkSize = 4 << 20, std::size_t maxQueuedChunks = 8);
+            virtual ~MapFileReader();
+
+            // blocks until the next chunk is available, returns false at the end of the file
+            [[nodiscard]] bool readChunk(std::string& chunk);
+
+            [[nodiscard]] bool hasError() const { return error; }
+
+            [[nodiscard]] static Compression detectCompression(const std::string& filePath);
+
+        private:
+
+            void run();
+
+            void readPlain();
+            void readGzip();
+            void readBzip2();
+
+            [[nodiscard]] bool pushChunk(std::string&& chunk);
+
+            void setError(const std::string& message);
+
+            const std::string filePath;
+            const std::size_t chunkSize;
+            const std::size_t maxQueuedChunks;
+
+            std::mutex mutex;
+            std::condition_variable chunkAvailable;
+            std::condition_variable spaceAvailable;
+
+            std::deque<std::string> chunks;
+
+            bool finished = false;
+            bool stopped = false;
+
+            std::atomic<bool> error = false;
+
+            std::thread thread;
+    };
+}
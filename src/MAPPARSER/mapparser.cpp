@@ -1,28 +1,61 @@
 
 #include "mapparser.h"
 
+#include "MAP/perfecthash.h"
+
+#include "mapfilereader.h"
+
 #include "pugixml.hpp"
 
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <chrono>
 #include <array>
 #include <algorithm>
 #include <set>
+#include <string_view>
 
 using namespace AStarCities;
 
+enum TagKey : uint32_t {
+    UNKNOWN_KEY = 0,
+    HIGHWAY,
+    BUILDING,
+    NAME,
+    AREA
+};
+
+static constexpr PerfectHash<TagKey, 4> tagKeyHash({{
+    { "highway",  HIGHWAY  },
+    { "building", BUILDING },
+    { "name",     NAME     },
+    { "area",     AREA     }
+}}, UNKNOWN_KEY);
+
 std::string MapParser::loadFromFile(const std::string& filePath) const {
 
-    std::ifstream fileStream(filePath);
-    if (!fileStream.is_open()) {
-        std::cerr << "Parser - Failed to read file " << filePath << std::endl;
-        return "";
-    }
+    MapFileReader reader(filePath);
+
+    std::string mapData;
+    std::string chunk;
+    while (reader.readChunk(chunk))
+        mapData += chunk;
 
-    std::ostringstream stringStream;
-    stringStream << fileStream.rdbuf();
-    return stringStream.str();
+    return reader.hasError() ? "" : mapData;
+}
+
+std::vector<MemoryReport::Usage> MapParser::getMemoryUsage() const {
+
+    std::size_t clippedRoadBytes = clippedRoadPieces.capacity() * sizeof(RoadPiece);
+    for (const RoadPiece& piece : clippedRoadPieces)
+        clippedRoadBytes += piece.nodeIds.capacity() * sizeof(uint64_t) + piece.name.capacity();
+
+    return {
+        {"all nodes", allNodes.size(), allNodes.getAllocatedBytes()},
+        MemoryReport::measureTree("other ways", otherWays, [](const std::vector<NodeTable::Index>& nodes) -> const std::vector<NodeTable::Index>& { return nodes; }),
+        {"inside nodes", insideNodes.size(), insideNodes.capacity() / 8},
+        {"clipped road pieces", clippedRoadPieces.size(), clippedRoadBytes},
+        MemoryReport::measureVector("boundary node ids", boundaryNodeIds)
+    };
 }
 
 void MapParser::parseRoadTypes(const std::set<RoadType> types) {
@@ -31,128 +64,461 @@ void MapParser::parseRoadTypes(const std::set<RoadType> types) {
 
 void MapParser::parseMap(const std::string& mapData, uint32_t refWidth, uint32_t refHeight) {
 
-    map = std::shared_ptr<Map>(new Map());
-    map->setReferenceResolution(refWidth, refHeight);
+    createMap(refWidth, refHeight);
 
-    pugi::xml_document doc;
-    pugi::xml_parse_result result = doc.load_string(mapData.c_str());
-    if (!result) {
+    const auto startTime = std::chrono::steady_clock::now();
+
+    bool success = false;
+    if (xmlBackend == XmlBackend::OSM_TOKENIZER) {
+        OsmTokenizer tokenizer(mapData);
+        success = parseWithTokenizer(tokenizer);
+    } else {
+        success = parseWithPugixml(mapData);
+    }
+
+    if (!success) {
         std::cerr << "Parser - Failed to parse xml" << std::endl;
         return;
     }
 
-    parseGlobalBounds(doc);
-
-    parseNodes(doc);
+    if (!boundaryNodeIds.empty()) {
+        OsmTokenizer tokenizer(mapData);
+        parseBoundaryNodes(tokenizer);
+    }
 
-    parseRoadsAndBuildings(doc);
+    addClippedRoadPieces();
+    map->sortById();
 
-    std::cout << "Map node count:     " << map->getNodes().size() << std::endl;
-    std::cout << "Map road count:     " << map->getRoads().size() << std::endl;
-    std::cout << "Map building count: " << map->getBuildings().size() << std::endl;
+    printStatistics(mapData.size(), std::chrono::steady_clock::now() - startTime);
 }
 
-void MapParser::parseGlobalBounds(const pugi::xml_document& xml) {
-    pugi::xml_node boundsNode = xml.child("osm").child("bounds");
-    if (!boundsNode) {
-        guessBoundings = true;
+/*
+ * With the tokenizer the file is parsed while it is still being read and
+ * decompressed on the reader thread. Pugixml needs the complete document.
+ */
+void MapParser::parseFile(const std::string& filePath, uint32_t refWidth, uint32_t refHeight) {
+
+    if (xmlBackend != XmlBackend::OSM_TOKENIZER) {
+        parseMap(loadFromFile(filePath), refWidth, refHeight);
         return;
     }
-    const double minlat = boundsNode.attribute("minlat").as_double();
-    const double minlon = boundsNode.attribute("minlon").as_double();
-    const double maxlat = boundsNode.attribute("maxlat").as_double();
-    const double maxlon = boundsNode.attribute("maxlon").as_double();
-    map->setGlobalBounds(minlat, maxlat, minlon, maxlon);
+
+    createMap(refWidth, refHeight);
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    MapFileReader reader(filePath);
+    OsmTokenizer tokenizer([&reader](std::string& chunk) { return reader.readChunk(chunk); });
+
+    const bool success = parseWithTokenizer(tokenizer);
+
+    if (!success || reader.hasError()) {
+        std::cerr << "Parser - Failed to parse xml" << std::endl;
+        return;
+    }
+
+    // the file is read a second time, only up to the first way
+    if (!boundaryNodeIds.empty()) {
+        MapFileReader boundaryReader(filePath);
+        OsmTokenizer boundaryTokenizer([&boundaryReader](std::string& chunk) { return boundaryReader.readChunk(chunk); });
+        parseBoundaryNodes(boundaryTokenizer);
+    }
+
+    addClippedRoadPieces();
+    map->sortById();
+
+    printStatistics(tokenizer.getInputSize(), std::chrono::steady_clock::now() - startTime);
+}
+
+/*
+ * Ways that are no longer roads after a modification are removed from the
+ * map. Only the roads are updated, buildings and relations are ignored.
+ */
+MapChange MapParser::parseChangeFile(const std::string& filePath) {
+
+    MapChange change;
+
+    MapFileReader reader(filePath);
+    OsmTokenizer tokenizer([&reader](std::string& chunk) { return reader.readChunk(chunk); });
+
+    OsmTokenizer::Element action = OsmTokenizer::Element::MODIFY;
+
+    for (OsmTokenizer::Element element = tokenizer.next(); element != OsmTokenizer::Element::END; element = tokenizer.next()) {
+        switch (element) {
+            case OsmTokenizer::Element::CREATE:
+            case OsmTokenizer::Element::MODIFY:
+            case OsmTokenizer::Element::DELETE:
+                action = element;
+                break;
+            case OsmTokenizer::Element::NODE:
+                if (action == OsmTokenizer::Element::DELETE)
+                    change.deletedNodes.push_back(tokenizer.getId());
+                else
+                    change.updatedNodes.push_back({tokenizer.getId(), tokenizer.getLatitude(), tokenizer.getLongitude()});
+                break;
+            case OsmTokenizer::Element::WAY: {
+                const Tags tags = getTags(tokenizer.getTags());
+                if (action != OsmTokenizer::Element::DELETE && checkIfWayIsHighway(tags) && allowedRoadTypes.contains(RoadType(tags.highway))) {
+                    change.updatedRoads.push_back({tokenizer.getId(), std::string(tags.name), RoadType(tags.highway), tokenizer.getNodeRefs()});
+                } else {
+                    change.deletedRoads.push_back(tokenizer.getId());
+                }
+                break;
+            }
+            case OsmTokenizer::Element::BOUNDS:
+            case OsmTokenizer::Element::RELATION:
+            case OsmTokenizer::Element::END:
+                break;
+        }
+    }
+
+    if (tokenizer.hasNegativeId())
+        std::cerr << "Parser - Negative ids are not supported" << std::endl;
+    // a part of a change set is not applied, it might leave the road network inconsistent
+    if (tokenizer.hasError() || reader.hasError()) {
+        std::cerr << "Parser - Failed to parse change file " << filePath << std::endl;
+        return MapChange();
+    }
+
+    std::cout << "Change node count:  " << change.updatedNodes.size() << " updated, " << change.deletedNodes.size() << " deleted" << std::endl;
+    std::cout << "Change road count:  " << change.updatedRoads.size() << " updated, " << change.deletedRoads.size() << " deleted" << std::endl;
+
+    return change;
+}
+
+void MapParser::createMap(uint32_t refWidth, uint32_t refHeight) {
+    map = std::shared_ptr<Map>(new Map(memoryResource));
+    map->setReferenceResolution(refWidth, refHeight);
+
+    if (clipRegion) {
+        guessBoundings = false;
+        map->setGlobalBounds(clipRegion->getMinLatitude(), clipRegion->getMaxLatitude(),
+                             clipRegion->getMinLongitude(), clipRegion->getMaxLongitude());
+    }
+}
+
+void MapParser::printStatistics(std::size_t inputSize, std::chrono::duration<double> duration) const {
+
+    const double megaBytes = static_cast<double>(inputSize) / (1024.0 * 1024.0);
+
+    std::cout << "Map parse time:     " << duration.count() << " s (" << megaBytes / duration.count() << " MB/s)" << std::endl;
+    std::cout << "Map node count:     " << map->getNodeCount() << std::endl;
+    std::cout << "Map road count:     " << map->getRoads().size() << std::endl;
+    std::cout << "Map building count: " << map->getBuildings().size() << std::endl;
 }
 
-void MapParser::parseNodes(const pugi::xml_document& xml) {
-    for (pugi::xml_node node : xml.child("osm").children("node")) {
+bool MapParser::parseWithPugixml(const std::string& mapData) {
+
+    pugi::xml_document doc;
+    pugi::xml_parse_result result = doc.load_string(mapData.c_str());
+    if (!result)
+        return false;
+
+    const pugi::xml_node osmNode = doc.child("osm");
 
+    if (pugi::xml_node boundsNode = osmNode.child("bounds")) {
+        const double minlat = boundsNode.attribute("minlat").as_double();
+        const double minlon = boundsNode.attribute("minlon").as_double();
+        const double maxlat = boundsNode.attribute("maxlat").as_double();
+        const double maxlon = boundsNode.attribute("maxlon").as_double();
+        parseGlobalBounds(minlat, maxlat, minlon, maxlon);
+    }
+
+    for (pugi::xml_node node : osmNode.children("node")) {
+        if (isNegativeId(node.attribute("id")))
+            return false;
         const uint64_t id = node.attribute("id").as_ullong();
         const double lat = node.attribute("lat").as_double();
         const double lon = node.attribute("lon").as_double();
+        parseNode(id, lat, lon);
+    }
 
-        if (lat < minLat) minLat = lat;
-        else if (lat > maxLat) maxLat = lat;
-        if (lon < minLon) minLon = lon;
-        else if (lon > maxLon) maxLon = lon;
+    finishNodes();
 
-        allNodes.insert({id, Node(id, lat, lon)});
+    Way way;
+    for (const pugi::xml_node& node : osmNode.children("way")) {
+        if (isNegativeId(node.attribute("id")))
+            return false;
+        way.id = node.attribute("id").as_ullong();
+        way.tags = getTags(node);
+        way.nodeRefs.clear();
+        for (pugi::xml_node refNode : node.children("nd")) {
+            if (isNegativeId(refNode.attribute("ref")))
+                return false;
+            way.nodeRefs.push_back(refNode.attribute("ref").as_ullong());
+        }
+        parseWay(way);
     }
 
-    if (guessBoundings) {
-        map->setGlobalBounds(minLat, maxLat, minLon, maxLon);
+    if (!parseBuildingsEnabled)
+        return true;
+
+    Relation relation;
+    for (const pugi::xml_node& node : osmNode.children("relation")) {
+        if (isNegativeId(node.attribute("id")))
+            return false;
+        relation.id = node.attribute("id").as_ullong();
+        relation.tags = getTags(node);
+        relation.members.clear();
+        for (const pugi::xml_node& memberNode : node.children("member")) {
+            if (isNegativeId(memberNode.attribute("ref")))
+                return false;
+            relation.members.push_back({
+                memberNode.attribute("type").as_string(),
+                memberNode.attribute("ref").as_ullong(),
+                memberNode.attribute("role").as_string()
+            });
+        }
+        parseRelation(relation);
     }
 
-    std::cout << "All nodes count: " << allNodes.size() << std::endl;
+    return true;
 }
 
-void MapParser::parseRoadsAndBuildings(const pugi::xml_document& xml) {
-
-    for (const pugi::xml_node& node : xml.child("osm").children("way")) {
-        if (parseRoadsEnabled && checkIfXmlNodeIsHighway(node)) {
-            parseRoad(node);
-        } else if (parseBuildingsEnabled && checkIfXmlNodeIsBuilding(node)) {
-            parseBuilding(node);
-        } else if (parseBuildingsEnabled){
-            parseOtherWay(node);
+/*
+ * The tokenizer streams the elements in document order. Osm files contain
+ * all nodes before the ways and all ways before the relations.
+ */
+bool MapParser::parseWithTokenizer(OsmTokenizer& tokenizer) {
+
+    Way way;
+    Relation relation;
+
+    for (OsmTokenizer::Element element = tokenizer.next(); element != OsmTokenizer::Element::END; element = tokenizer.next()) {
+        switch (element) {
+            case OsmTokenizer::Element::BOUNDS: {
+                const OsmTokenizer::Bounds& bounds = tokenizer.getBounds();
+                parseGlobalBounds(bounds.minLatitude, bounds.maxLatitude, bounds.minLongitude, bounds.maxLongitude);
+                break;
+            }
+            case OsmTokenizer::Element::NODE:
+                parseNode(tokenizer.getId(), tokenizer.getLatitude(), tokenizer.getLongitude());
+                break;
+            case OsmTokenizer::Element::WAY:
+                finishNodes();
+                way.id = tokenizer.getId();
+                way.tags = getTags(tokenizer.getTags());
+                way.nodeRefs.assign(tokenizer.getNodeRefs().begin(), tokenizer.getNodeRefs().end());
+                parseWay(way);
+                break;
+            case OsmTokenizer::Element::RELATION:
+                finishNodes();
+                if (!parseBuildingsEnabled)
+                    break;
+                relation.id = tokenizer.getId();
+                relation.tags = getTags(tokenizer.getTags());
+                relation.members.assign(tokenizer.getMembers().begin(), tokenizer.getMembers().end());
+                parseRelation(relation);
+                break;
+            case OsmTokenizer::Element::CREATE:
+            case OsmTokenizer::Element::MODIFY:
+            case OsmTokenizer::Element::DELETE:
+            case OsmTokenizer::Element::END:
+                break;
         }
     }
 
-    if (!parseBuildingsEnabled)
+    finishNodes();
+
+    if (tokenizer.hasNegativeId())
+        std::cerr << "Parser - Negative ids are not supported" << std::endl;
+
+    return !tokenizer.hasError();
+}
+
+/*
+ * Pugixml converts negative ids to large unsigned numbers, the tokenizer
+ * rejects them. Both backends report them as an error.
+ */
+bool MapParser::isNegativeId(const pugi::xml_attribute& attribute) {
+
+    std::string_view value = attribute.as_string();
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t' || value.front() == '\n' || value.front() == '\r'))
+        value.remove_prefix(1);
+
+    if (value.empty() || value.front() != '-')
+        return false;
+
+    std::cerr << "Parser - Negative ids are not supported" << std::endl;
+    return true;
+}
+
+void MapParser::parseGlobalBounds(double minlat, double maxlat, double minlon, double maxlon) {
+
+    if (clipRegion)
         return;
 
-    for (const pugi::xml_node& node : xml.child("osm").children("relation")) {
-        if (checkIfXmlNodeIsBuilding(node)) {
-            if (checkIfBuildingHasMultipleOuterNodes(node)) {
-                if (checkIfBuildingHasNoInnerNodes(node)) {
-                    parseMultipleBuildings(node);
-                } else {
-                    std::cerr << "Parser - Building has multiple outer shapes and inner shapes - " << node.attribute("id").as_ullong() << std::endl;
-                }
+    guessBoundings = false;
+    map->setGlobalBounds(minlat, maxlat, minlon, maxlon);
+}
+
+void MapParser::parseNode(uint64_t id, double lat, double lon) {
+
+    if (clipRegion && !clipRegion->containsWithMargin(lat, lon))
+        return;
+
+    if (lat < minLat) minLat = lat;
+    else if (lat > maxLat) maxLat = lat;
+    if (lon < minLon) minLon = lon;
+    else if (lon > maxLon) maxLon = lon;
+
+    allNodes.addNode(id, lat, lon);
+}
+
+void MapParser::finishNodes() {
+
+    if (nodesFinished)
+        return;
+
+    nodesFinished = true;
+
+    allNodes.sortById();
+
+    if (guessBoundings) {
+        map->setGlobalBounds(minLat, maxLat, minLon, maxLon);
+    }
+
+    if (clipRegion) {
+        insideNodes.resize(allNodes.size());
+        for (NodeTable::Index index = 0; index < allNodes.size(); index++) {
+            insideNodes[index] = clipRegion->contains(allNodes.getLatitude(index), allNodes.getLongitude(index));
+        }
+    }
+
+    std::cout << "All nodes count: " << allNodes.size() << std::endl;
+}
+
+void MapParser::parseWay(const Way& way) {
+    if (parseRoadsEnabled && checkIfWayIsHighway(way.tags)) {
+        parseRoad(way);
+    } else if (parseBuildingsEnabled && checkIfWayIsBuilding(way.tags)) {
+        parseBuilding(way);
+    } else if (parseBuildingsEnabled){
+        parseOtherWay(way);
+    }
+}
+
+void MapParser::parseRelation(const Relation& relation) {
+    if (checkIfWayIsBuilding(relation.tags)) {
+        if (checkIfBuildingHasMultipleOuterNodes(relation)) {
+            if (checkIfBuildingHasNoInnerNodes(relation)) {
+                parseMultipleBuildings(relation);
             } else {
-                parseComplexBuilding(node);
+                std::cerr << "Parser - Building has multiple outer shapes and inner shapes - " << relation.id << std::endl;
             }
+        } else {
+            parseComplexBuilding(relation);
         }
     }
 }
 
-void MapParser::parseRoad(const pugi::xml_node& node) {
+void MapParser::parseRoad(const Way& way) {
 
-    const uint64_t id = node.attribute("id").as_ullong();
-    const RoadType type = getRoadType(node);
+    const RoadType type(way.tags.highway);
 
     if (allowedRoadTypes.contains(type)) {
-        Road road = Road(id, getRoadName(node), type);
-        road.setNodes(getNodesFromWay(node));
-        map->addRoad(road);
+        if (clipRegion) {
+            parseClippedRoad(way, type);
+            return;
+        }
+        map->addRoad(way.id, way.tags.name, type, map->addNodes(allNodes, getNodesFromWay(way)));
     }
 }
 
-void MapParser::parseBuilding(const pugi::xml_node& node) {
+/*
+ * A road crossing the border of the clip region is split into the parts
+ * inside the region. Each part is continued up to the first node outside.
+ * Nodes beyond the margin are not stored while the nodes are parsed, the
+ * pieces are kept until these nodes are read in a second pass.
+ */
+void MapParser::parseClippedRoad(const Way& way, RoadType type) {
 
-    const uint64_t id = node.attribute("id").as_ullong();
-    const BuildingType type = getBuildingType(node);
+    bool firstPiece = true;
+
+    for (std::vector<uint64_t>& piece : clipWay(way)) {
+
+        for (uint64_t nodeId : {piece.front(), piece.back()}) {
+            if (allNodes.find(nodeId) == NodeTable::NOT_FOUND)
+                boundaryNodeIds.push_back(nodeId);
+        }
+
+        // further pieces get new ids once the ids of all ways are known
+        clippedRoadPieces.push_back({firstPiece ? way.id : 0, std::string(way.tags.name), type, std::move(piece)});
+        firstPiece = false;
+    }
+}
+
+/*
+ * Osm files contain all nodes before the first way, the second pass stops
+ * there. The node indices of the ways are not valid afterwards, the pieces
+ * reference their nodes by id.
+ */
+void MapParser::parseBoundaryNodes(OsmTokenizer& tokenizer) {
+
+    std::ranges::sort(boundaryNodeIds);
+    boundaryNodeIds.erase(std::ranges::unique(boundaryNodeIds).begin(), boundaryNodeIds.end());
+
+    for (OsmTokenizer::Element element = tokenizer.next(); element != OsmTokenizer::Element::END; element = tokenizer.next()) {
+        if (element == OsmTokenizer::Element::WAY || element == OsmTokenizer::Element::RELATION)
+            break;
+        if (element == OsmTokenizer::Element::NODE && std::ranges::binary_search(boundaryNodeIds, tokenizer.getId()))
+            allNodes.addNode(tokenizer.getId(), tokenizer.getLatitude(), tokenizer.getLongitude());
+    }
+
+    allNodes.sortById();
+    insideNodes.clear();
+    otherWays.clear();
+
+    std::cout << "Boundary node count: " << boundaryNodeIds.size() << std::endl;
+}
 
-    Building building = Building(id, type);
+void MapParser::addClippedRoadPieces() {
 
-    building.setNodes(getNodesFromWay(node));
+    // the first pieces keep the ids of their ways, the ids of all ways must be used before new ids are given
+    std::ranges::stable_partition(clippedRoadPieces, [](const RoadPiece& piece) { return piece.id != 0; });
+
+    for (const RoadPiece& piece : clippedRoadPieces) {
+
+        std::vector<NodeTable::Index> nodes;
+        nodes.reserve(piece.nodeIds.size());
+        for (uint64_t nodeId : piece.nodeIds) {
+            if (const NodeTable::Index index = allNodes.find(nodeId); index != NodeTable::NOT_FOUND)
+                nodes.push_back(index);
+        }
+
+        // a boundary node can be missing from the file like any other node
+        if (nodes.size() < 2)
+            continue;
+
+        map->addRoad(piece.id != 0 ? piece.id : map->getNewId(), piece.name, piece.type, map->addNodes(allNodes, nodes));
+    }
+
+    clippedRoadPieces.clear();
+    boundaryNodeIds.clear();
+}
+
+void MapParser::parseBuilding(const Way& way) {
+
+    if (clipRegion && !checkIfWayIsInClipRegion(way))
+        return;
+
+    const BuildingType type(way.tags.building);
+
+    const std::vector<NodeTable::Index> nodes = getNodesFromWay(way);
 
     // some buildings can also be the inner shape of an other building
-    const auto [iterator, success] = otherWays.insert({building.getId(), building.getNodes()});
+    const auto [iterator, success] = otherWays.insert({way.id, nodes});
     if (!success)
         std::cerr << "Parser - Failed to save building as other way id: " << iterator->first << std::endl;
 
-    map->addBuilding(building);
+    map->addBuilding(way.id, type, map->addNodes(allNodes, nodes));
 }
 
-void MapParser::parseMultipleBuildings(const pugi::xml_node& xml) {
+void MapParser::parseMultipleBuildings(const Relation& relation) {
 
-    for (const pugi::xml_node& node : xml) {
-        const std::string& type = node.attribute("type").as_string();
-        const std::string& role = node.attribute("role").as_string();
-        const uint64_t refId = node.attribute("ref").as_ullong();
-        if (type == "way" && role == "outer") {
+    for (const OsmTokenizer::Member& member : relation.members) {
+        const uint64_t refId = member.ref;
+        if (member.type == "way" && member.role == "outer") {
             if (auto search = otherWays.find(refId); search != otherWays.end()) {
 
             } else {
@@ -162,145 +528,195 @@ void MapParser::parseMultipleBuildings(const pugi::xml_node& xml) {
     }
 }
 
-void MapParser::parseComplexBuilding(const pugi::xml_node& node) {
-
-    const uint64_t id = node.attribute("id").as_ullong();
-    const BuildingType type = getBuildingType(node);
+void MapParser::parseComplexBuilding(const Relation& relation) {
 
-    Building building = Building(id, type);
+    const BuildingType type(relation.tags.building);
 
-    bool outerNodeFound = false;
+    // the nodes are only added to the map if the building is valid
+    const std::vector<NodeTable::Index>* outerShape = nullptr;
+    std::vector<std::reference_wrapper<const std::vector<NodeTable::Index>>> innerShapes;
 
-    for (const pugi::xml_node& refNode : node.children("member")) {
-        const std::string type = refNode.attribute("type").as_string();
-        if (type == "way") {
+    for (const OsmTokenizer::Member& member : relation.members) {
+        if (member.type == "way") {
 
-            uint64_t refId = refNode.attribute("ref").as_ullong();
+            uint64_t refId = member.ref;
             auto wayIterator = otherWays.find(refId);
 
             if (wayIterator != otherWays.end()) {
-                const std::string role = refNode.attribute("role").as_string();
-                if (role == "outer" && outerNodeFound == false) {
-                    building.setNodes(wayIterator->second);
-                    outerNodeFound = true;
+                const std::string_view role = member.role;
+                if (role == "outer" && outerShape == nullptr) {
+                    outerShape = &wayIterator->second;
                 } else if (role == "inner") {
-                    building.addInnerShapeNodes(wayIterator->second);
-                } else if (outerNodeFound == true) {
-                    std::cerr << "Parser - Building (" << building.getId() << ") has multiple outer shapes." << std::endl;
+                    innerShapes.push_back(wayIterator->second);
+                } else if (outerShape != nullptr) {
+                    std::cerr << "Parser - Building (" << relation.id << ") has multiple outer shapes." << std::endl;
                     return;
                 } else {
                     std::cerr << "Parser - Unknown reference node (" << refId << ") role: " << role << std::endl;
                     return;
                 }
             } else {
-                std::cerr << "Parser - Unable to find other way with id: " << refId << std::endl;
+                // ways outside of the clip region are not stored
+                if (!clipRegion)
+                    std::cerr << "Parser - Unable to find other way with id: " << refId << std::endl;
                 return;
             }
         }
     }
 
-    if (outerNodeFound == false) {
-        std::cerr << " Parser - Building has no outer shape id : " << building.getId() << std::endl;
+    if (outerShape == nullptr) {
+        std::cerr << " Parser - Building has no outer shape id : " << relation.id << std::endl;
         return;
     }
 
-    map->addBuilding(building);
+    std::vector<std::vector<NodeIndex>> innerShapeNodes;
+    for (const std::vector<NodeTable::Index>& shape : innerShapes) {
+        innerShapeNodes.push_back(map->addNodes(allNodes, shape));
+    }
+
+    map->addBuilding(relation.id, type, map->addNodes(allNodes, *outerShape), innerShapeNodes);
 }
 
-void MapParser::parseOtherWay(const pugi::xml_node& node) {
+void MapParser::parseOtherWay(const Way& way) {
 
-    uint64_t wayId = node.attribute("id").as_ullong();
+    if (clipRegion && !checkIfWayIsInClipRegion(way))
+        return;
 
-    const auto [iterator, success] = otherWays.insert({wayId, getNodesFromWay(node)});
+    uint64_t wayId = way.id;
+
+    const auto [iterator, success] = otherWays.insert({wayId, getNodesFromWay(way)});
     if (!success) {
         std::cerr << "Failed to insert new unknown way - id: " << wayId << std::endl;
     }
 
 }
 
-std::string MapParser::getRoadName(const pugi::xml_node& roadNode) const {
-    pugi::xml_node nameNode = getXmlNodeByKeyAttribute(roadNode, "name");
-    if (!nameNode)
-        return "";
-    else
-        return nameNode.attribute("v").as_string();
+/*
+ * Closed shapes can't be cut, so buildings and other ways are only kept
+ * if they touch the clip region and all of their nodes are known.
+ */
+bool MapParser::checkIfWayIsInClipRegion(const Way& way) const {
+
+    bool touchesRegion = false;
+
+    for (const uint64_t nodeId : way.nodeRefs) {
+        const NodeTable::Index index = allNodes.find(nodeId);
+        if (index == NodeTable::NOT_FOUND)
+            return false;
+        touchesRegion = touchesRegion || insideNodes[index];
+    }
+
+    return touchesRegion;
 }
 
-RoadType MapParser::getRoadType(const pugi::xml_node& roadNode) const {
-    pugi::xml_node typeNode = getXmlNodeByKeyAttribute(roadNode, "highway");
-    if (!typeNode)
-        return RoadType();
-    else
-        return RoadType(typeNode.attribute("v").as_string());
+std::vector<std::vector<uint64_t>> MapParser::clipWay(const Way& way) const {
+
+    std::vector<std::vector<uint64_t>> pieces;
+    std::vector<uint64_t> piece;
+
+    for (std::size_t ii = 0; ii < way.nodeRefs.size(); ii++) {
+
+        // nodes beyond the margin of the clip region are not stored and are outside
+        const uint64_t nodeId = way.nodeRefs[ii];
+        const NodeTable::Index index = allNodes.find(nodeId);
+        const bool inside = index != NodeTable::NOT_FOUND && insideNodes[index];
+
+        if (inside) {
+            if (piece.empty() && ii > 0)
+                piece.push_back(way.nodeRefs[ii - 1]);
+            piece.push_back(nodeId);
+        } else if (!piece.empty()) {
+            piece.push_back(nodeId);
+            pieces.push_back(std::move(piece));
+            piece.clear();
+        }
+    }
+
+    if (piece.size() > 1)
+        pieces.push_back(std::move(piece));
+
+    return pieces;
 }
 
-bool MapParser::checkIfXmlNodeIsHighway(const pugi::xml_node& wayNode) const {
+bool MapParser::checkIfWayIsHighway(const Tags& tags) const {
 
-    pugi::xml_node highwayTypeNode = getXmlNodeByKeyAttribute(wayNode, "highway");
-    if (!highwayTypeNode)
+    if (tags.highway.empty())
         return false;
 
-    pugi::xml_node areaNode = getXmlNodeByKeyAttribute(wayNode, "area");
-    if (areaNode) {
-        std::string areaValue = areaNode.attribute("v").as_string();
-        if (areaValue == "yes")
-            return false;
-    }
+    if (tags.area == "yes")
+        return false;
 
-    const std::string highwayType = highwayTypeNode.attribute("v").as_string();
-    RoadType type{highwayType};
+    RoadType type(tags.highway);
     if (type == RoadType::UNKNOWN) {
-        std::cout << "Unknown road type: " << highwayType << std::endl;
+        std::cout << "Unknown road type: " << tags.highway << std::endl;
     }
     return type != RoadType::UNKNOWN;
 }
 
-bool MapParser::checkIfXmlNodeIsBuilding(const pugi::xml_node& buildingNode) const {
+bool MapParser::checkIfWayIsBuilding(const Tags& tags) const {
 
-    pugi::xml_node buildingTypeNode = getXmlNodeByKeyAttribute(buildingNode, "building");
-    if (!buildingTypeNode)
+    if (tags.building.empty())
         return false;
 
-    const std::string buildingType = buildingTypeNode.attribute("v").as_string();
-    BuildingType type(buildingType);
+    BuildingType type(tags.building);
     if (type == BuildingType::UNKNOWN) {
-        std::cout << "Unknown building type: " << buildingType << std::endl;
+        std::cout << "Unknown building type: " << tags.building << std::endl;
     }
     return type != BuildingType::UNKNOWN;
 }
 
-std::vector<std::reference_wrapper<const Node>> MapParser::getNodesFromWay(const pugi::xml_node& xmlNode) const {
-    std::vector<std::reference_wrapper<const Node>> nodes;
-    for (pugi::xml_node node: xmlNode.children("nd")) {
-        const uint64_t nodeId = node.attribute("ref").as_ullong();
-        auto nodeIterator = allNodes.find(nodeId);
-        if (nodeIterator != allNodes.end()) {
-            nodes.push_back(nodeIterator->second);
+std::vector<NodeTable::Index> MapParser::getNodesFromWay(const Way& way) const {
+    std::vector<NodeTable::Index> nodes;
+    nodes.reserve(way.nodeRefs.size());
+    for (const uint64_t nodeId : way.nodeRefs) {
+        const NodeTable::Index index = allNodes.find(nodeId);
+        if (index != NodeTable::NOT_FOUND) {
+            nodes.push_back(index);
         } else {
-            std::cerr << "Parser - Error: Unable to find node '" << nodeId << "' in xml Node: " << xmlNode.attribute("id").as_string() << std::endl;
+            std::cerr << "Parser - Error: Unable to find node '" << nodeId << "' in xml Node: " << way.id << std::endl;
         }
     }
     return nodes;
 }
 
-pugi::xml_node MapParser::getXmlNodeByKeyAttribute(const pugi::xml_node& node, const std::string& key) const {
+/*
+ * Collect all needed tag values of a way or relation in a single pass
+ * over its tags. Keys are classified by a compile time perfect hash,
+ * the values point directly into the xml document.
+ */
+MapParser::Tags MapParser::getTags(const pugi::xml_node& node) {
+    Tags tags;
     for (pugi::xml_node tagNode : node.children("tag")) {
-        const std::string keyAttr = tagNode.attribute("k").as_string();
-        if (keyAttr == key) {
-            return tagNode;
-        }
+        addTag(tags, tagNode.attribute("k").as_string(), tagNode.attribute("v").as_string());
+    }
+    return tags;
+}
+
+MapParser::Tags MapParser::getTags(const std::vector<OsmTokenizer::Tag>& tagList) {
+    Tags tags;
+    for (const OsmTokenizer::Tag& tag : tagList) {
+        addTag(tags, tag.key, tag.value);
     }
-    return pugi::xml_node();
+    return tags;
 }
 
-bool MapParser::checkIfBuildingHasMultipleOuterNodes(const pugi::xml_node& xml) const {
+void MapParser::addTag(Tags& tags, std::string_view key, std::string_view value) {
+    switch (tagKeyHash.find(key)) {
+        case HIGHWAY:  if (tags.highway.empty())  tags.highway  = value; break;
+        case BUILDING: if (tags.building.empty()) tags.building = value; break;
+        case NAME:     if (tags.name.empty())     tags.name     = value; break;
+        case AREA:     if (tags.area.empty())     tags.area     = value; break;
+        case UNKNOWN_KEY:
+            break;
+    }
+}
+
+bool MapParser::checkIfBuildingHasMultipleOuterNodes(const Relation& relation) const {
 
     int outerShapeCount = 0;
 
-    for (const pugi::xml_node& node : xml.children("member")) {
-        const std::string type = node.attribute("type").as_string();
-        const std::string role = node.attribute("role").as_string();
-        if (type == "way" && role == "outer") {
+    for (const OsmTokenizer::Member& member : relation.members) {
+        if (member.type == "way" && member.role == "outer") {
             outerShapeCount++;
         }
     }
@@ -308,23 +724,13 @@ bool MapParser::checkIfBuildingHasMultipleOuterNodes(const pugi::xml_node& xml)
     return outerShapeCount > 1;
 }
 
-bool MapParser::checkIfBuildingHasNoInnerNodes(const pugi::xml_node& xml) const {
+bool MapParser::checkIfBuildingHasNoInnerNodes(const Relation& relation) const {
 
-    for (const pugi::xml_node& node : xml.children("member")) {
-        const std::string type = node.attribute("type").as_string();
-        const std::string role = node.attribute("role").as_string();
-        if (type == "way" && role == "inner") {
+    for (const OsmTokenizer::Member& member : relation.members) {
+        if (member.type == "way" && member.role == "inner") {
             return false;
         }
     }
 
     return true;
 }
-
-BuildingType MapParser::getBuildingType(const pugi::xml_node& node) const {
-    pugi::xml_node typeNode = getXmlNodeByKeyAttribute(node, "building");
-    if (!typeNode)
-        return BuildingType();
-    else
-        return BuildingType(typeNode.attribute("v").as_string());
-}
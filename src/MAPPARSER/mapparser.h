@@ -2,15 +2,27 @@
 
 #include "MAP/map.h"
 #include "MAP/node.h"
+#include "MAP/nodetable.h"
 #include "MAP/RoadType.h"
 #include "MAP/BuildingType.h"
+#include "MAP/mapchange.h"
+#include "MAP/memoryreport.h"
+
+#include "osmtokenizer.h"
+#include "clipregion.h"
 
 #include <string>
+#include <string_view>
+#include <vector>
 #include <map>
 #include <set>
 #include <memory>
+#include <memory_resource>
+#include <chrono>
+#include <optional>
 
 namespace pugi {
+    class xml_attribute;
     class xml_node;
     class xml_document;
 }
@@ -21,58 +33,137 @@ namespace AStarCities {
 
         public:
 
-            MapParser() = default;
+            enum class XmlBackend {
+                PUGIXML,
+                OSM_TOKENIZER
+            };
+
+            // the parsed map and the node table of the parser are allocated from the memory resource
+            MapParser(std::pmr::memory_resource* resource = std::pmr::get_default_resource()) :
+                memoryResource(resource), allNodes(resource) {}
             virtual ~MapParser() = default;
 
             [[nodiscard]] std::string loadFromFile(const std::string& filePath) const;
 
             void parseMap(const std::string& mapData, uint32_t refWidth = 1600, uint32_t reHeight = 900);
 
+            // reads .osm, .osm.gz and .osm.bz2 files
+            void parseFile(const std::string& filePath, uint32_t refWidth = 1600, uint32_t reHeight = 900);
+
+            // reads the node and road changes of .osc, .osc.gz and .osc.bz2 files,
+            // the change is empty if the file could not be read completely
+            [[nodiscard]] MapChange parseChangeFile(const std::string& filePath);
+
             std::shared_ptr<Map> getMap() const { return map; }
 
+            // allocated bytes and element count of the containers of the parser, without the map
+            [[nodiscard]] std::vector<MemoryReport::Usage> getMemoryUsage() const;
+
             void parseRoads(bool parseRoads) { this->parseRoadsEnabled = parseRoads; }
             void parseBuildings(bool parseBuildings) { this->parseBuildingsEnabled = parseBuildings; }
 
             void parseRoadTypes(const std::set<RoadType> types);
 
-        private:
-
-            void parseGlobalBounds(const pugi::xml_document& xml);
+            void setXmlBackend(XmlBackend backend) { xmlBackend = backend; }
 
-            void parseNodes(const pugi::xml_document& xml);
+            // only parse the nodes and ways within the region
+            void setClipRegion(const ClipRegion& region) { clipRegion = region; }
 
-            void parseRoadsAndBuildings(const pugi::xml_document& xml);
+        private:
 
-            void parseRoad(const pugi::xml_node& node);
-            [[nodiscard]] bool checkIfXmlNodeIsHighway(const pugi::xml_node& wayNode) const;
+            // values of the way and relation tags needed by the parser
+            struct Tags {
+                std::string_view highway;
+                std::string_view building;
+                std::string_view name;
+                std::string_view area;
+            };
+
+            struct Way {
+                uint64_t id = 0;
+                Tags tags;
+                std::vector<uint64_t> nodeRefs;
+            };
+
+            struct Relation {
+                uint64_t id = 0;
+                Tags tags;
+                std::vector<OsmTokenizer::Member> members;
+            };
+
+            // part of a clipped road, added once the nodes beyond the margin are read,
+            // every part except the first gets a new id
+            struct RoadPiece {
+                uint64_t id;
+                std::string name;
+                RoadType type;
+                std::vector<uint64_t> nodeIds;
+            };
+
+            [[nodiscard]] bool parseWithPugixml(const std::string& mapData);
+            [[nodiscard]] bool parseWithTokenizer(OsmTokenizer& tokenizer);
+
+            [[nodiscard]] static bool isNegativeId(const pugi::xml_attribute& attribute);
+
+            void createMap(uint32_t refWidth, uint32_t refHeight);
+            void printStatistics(std::size_t inputSize, std::chrono::duration<double> duration) const;
+
+            void parseGlobalBounds(double minlat, double maxlat, double minlon, double maxlon);
+
+            void parseNode(uint64_t id, double lat, double lon);
+            void finishNodes();
+
+            void parseWay(const Way& way);
+            void parseRelation(const Relation& relation);
+
+            void parseRoad(const Way& way);
+            void parseClippedRoad(const Way& way, RoadType type);
+            void parseBoundaryNodes(OsmTokenizer& tokenizer);
+            void addClippedRoadPieces();
+            [[nodiscard]] bool checkIfWayIsHighway(const Tags& tags) const;
             [[nodiscard]] bool checkHighwayType(const std::string& highwayType) const;
-            [[nodiscard]] std::string getRoadName(const pugi::xml_node& roadNode) const;
-            [[nodiscard]] RoadType getRoadType(const pugi::xml_node& roadNode) const;
 
-            void parseBuilding(const pugi::xml_node& xml);
-            void parseMultipleBuildings(const pugi::xml_node& xml);
-            void parseComplexBuilding(const pugi::xml_node& xml);
-            [[nodiscard]] bool checkIfXmlNodeIsBuilding(const pugi::xml_node& buildingNode) const;
-            [[nodiscard]] bool checkIfBuildingHasMultipleOuterNodes(const pugi::xml_node& xml) const;
-            [[nodiscard]] bool checkIfBuildingHasNoInnerNodes(const pugi::xml_node& xml) const;
-            [[nodiscard]] BuildingType getBuildingType(const pugi::xml_node& buildingNode) const;
+            void parseBuilding(const Way& way);
+            void parseMultipleBuildings(const Relation& relation);
+            void parseComplexBuilding(const Relation& relation);
+            [[nodiscard]] bool checkIfWayIsBuilding(const Tags& tags) const;
+            [[nodiscard]] bool checkIfBuildingHasMultipleOuterNodes(const Relation& relation) const;
+            [[nodiscard]] bool checkIfBuildingHasNoInnerNodes(const Relation& relation) const;
+
+            void parseOtherWay(const Way& way);
+
+            [[nodiscard]] bool checkIfWayIsInClipRegion(const Way& way) const;
+            // node ids of the parts inside the clip region, each continued up to the first node outside
+            [[nodiscard]] std::vector<std::vector<uint64_t>> clipWay(const Way& way) const;
 
-            void parseOtherWay(const pugi::xml_node& xml);
+            [[nodiscard]] std::vector<NodeTable::Index> getNodesFromWay(const Way& way) const;
 
-            [[nodiscard]] std::vector<std::reference_wrapper<const Node>> getNodesFromWay(const pugi::xml_node& xmlNode) const;
+            [[nodiscard]] static Tags getTags(const pugi::xml_node& node);
+            [[nodiscard]] static Tags getTags(const std::vector<OsmTokenizer::Tag>& tagList);
+            static void addTag(Tags& tags, std::string_view key, std::string_view value);
 
-            [[nodiscard]] pugi::xml_node getXmlNodeByKeyAttribute(const pugi::xml_node& node, const std::string& key) const;
+            std::pmr::memory_resource* memoryResource;
 
             std::shared_ptr<Map> map;
 
-            std::map<uint64_t, Node> allNodes;
+            NodeTable allNodes;
 
-            std::map<uint64_t, std::vector<std::reference_wrapper<const Node>>> otherWays;
+            std::map<uint64_t, std::vector<NodeTable::Index>> otherWays;
+
+            std::optional<ClipRegion> clipRegion;
+            std::vector<bool> insideNodes;
+            std::vector<RoadPiece> clippedRoadPieces;
+
+            // first nodes outside of clipped roads that are beyond the margin of the clip region
+            std::vector<uint64_t> boundaryNodeIds;
 
             std::set<RoadType> allowedRoadTypes;
             std::set<BuildingType> allowedBuildingTypes;
 
-            bool guessBoundings = false;
+            XmlBackend xmlBackend = XmlBackend::PUGIXML;
+
+            bool guessBoundings = true;
+            bool nodesFinished = false;
 
             bool parseRoadsEnabled = true;
             bool parseBuildingsEnabled = true;
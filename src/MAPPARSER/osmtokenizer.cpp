@@ -0,0 +1,575 @@
+
+#include "osmtokenizer.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace AStarCities;
+
+static bool isSpace(char character) {
+    return character == ' ' || character == '\t' || character == '\n' || character == '\r';
+}
+
+static bool isDigit(char character) {
+    return character >= '0' && character <= '9';
+}
+
+/*
+ * Find the first occurrence of a character. Blocks of 32 (AVX2) or
+ * 16 (SSE2) bytes are compared at once, the rest is done byte by byte.
+ */
+static const char* findChar(const char* pos, const char* end, char character) {
+
+#if defined(__AVX2__)
+    const __m256i needle = _mm256_set1_epi8(character);
+    while (end - pos >= 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos));
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+        if (mask != 0)
+            return pos + std::countr_zero(mask);
+        pos += 32;
+    }
+#elif defined(__SSE2__)
+    const __m128i needle = _mm_set1_epi8(character);
+    while (end - pos >= 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+        const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+        if (mask != 0)
+            return pos + std::countr_zero(mask);
+        pos += 16;
+    }
+#endif
+
+    while (pos < end && *pos != character)
+        pos++;
+
+    return pos;
+}
+
+/*
+ * SWAR digit parsing: check and convert eight ascii digits with a few
+ * 64 bit operations. The first character is the most significant digit.
+ */
+static bool isEightDigits(uint64_t chunk) {
+    return ((chunk & 0xF0F0F0F0F0F0F0F0) | (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) == 0x3333333333333333;
+}
+
+static uint64_t parseEightDigits(uint64_t chunk) {
+    chunk = ((chunk & 0x0F0F0F0F0F0F0F0F) * 2561) >> 8;
+    chunk = ((chunk & 0x00FF00FF00FF00FF) * 6553601) >> 16;
+    return ((chunk & 0x0000FFFF0000FFFF) * 42949672960001) >> 32;
+}
+
+static void appendUtf8(std::string& string, uint32_t codePoint) {
+    if (codePoint < 0x80) {
+        string.push_back(static_cast<char>(codePoint));
+    } else if (codePoint < 0x800) {
+        string.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+        string.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else if (codePoint < 0x10000) {
+        string.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+        string.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        string.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    } else {
+        string.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+        string.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+        string.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        string.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+    }
+}
+
+uint64_t OsmTokenizer::parseUnsigned(std::string_view value) {
+
+    uint64_t result = 0;
+    std::size_t ii = 0;
+
+    if constexpr (std::endian::native == std::endian::little) {
+        while (value.size() - ii >= 8) {
+            uint64_t chunk;
+            std::memcpy(&chunk, value.data() + ii, sizeof(chunk));
+            if (!isEightDigits(chunk))
+                break;
+            result = result * 100000000 + parseEightDigits(chunk);
+            ii += 8;
+        }
+    }
+
+    for (; ii < value.size() && isDigit(value[ii]); ii++)
+        result = result * 10 + static_cast<uint64_t>(value[ii] - '0');
+
+    return result;
+}
+
+/*
+ * Coordinates are parsed as fixed point numbers with the seven decimal
+ * places of the osm precision. The division by 1e7 is correctly rounded,
+ * so the result is the same as from a full floating point parser.
+ */
+double OsmTokenizer::parseCoordinate(std::string_view value) {
+
+    bool negative = false;
+    if (!value.empty() && (value.front() == '-' || value.front() == '+')) {
+        negative = value.front() == '-';
+        value.remove_prefix(1);
+    }
+
+    const std::size_t dot = value.find('.');
+    const uint64_t integer = parseUnsigned(value.substr(0, dot));
+
+    uint64_t fraction = 0;
+    int digits = 0;
+
+    if (dot != std::string_view::npos) {
+        std::size_t ii = dot + 1;
+        for (; ii < value.size() && digits < 7 && isDigit(value[ii]); ii++, digits++)
+            fraction = fraction * 10 + static_cast<uint64_t>(value[ii] - '0');
+
+        // more precision than osm provides, round to the last digit
+        if (ii < value.size() && digits == 7 && isDigit(value[ii]) && value[ii] >= '5')
+            fraction++;
+    }
+
+    for (; digits < 7; digits++)
+        fraction *= 10;
+
+    const double result = static_cast<double>(integer * 10000000 + fraction) / 1e7;
+    return negative ? -result : result;
+}
+
+OsmTokenizer::Element OsmTokenizer::next() {
+
+    while (true) {
+
+        const std::size_t elementStart = static_cast<std::size_t>(position - data.data());
+
+        const Element element = parseNext();
+        if (!incomplete)
+            return element;
+
+        // the element continues in the next chunk, parse it again with more data
+        incomplete = false;
+        refill(elementStart);
+    }
+}
+
+void OsmTokenizer::refill(std::size_t keepFrom) {
+
+    buffer.erase(0, keepFrom);
+
+    if (reader(chunk)) {
+        buffer.append(chunk);
+        inputSize += chunk.size();
+    } else {
+        inputFinished = true;
+    }
+
+    data = buffer;
+    position = buffer.data();
+}
+
+OsmTokenizer::Element OsmTokenizer::parseNext() {
+
+    const char* end = data.data() + data.size();
+
+    while (!error && !incomplete) {
+
+        position = findChar(position, end, '<');
+        if (end - position < 2) {
+            incomplete = !inputFinished;
+            return Element::END;
+        }
+        position++;
+
+        if (*position == '?' || *position == '!') {
+            if (!skipSpecial())
+                return Element::END;
+            continue;
+        }
+
+        // closing tags of containers (osm) are ignored
+        if (*position == '/') {
+            position = findChar(position, end, '>');
+            continue;
+        }
+
+        const std::string_view name = readName();
+        bool selfClosing = false;
+
+        decodedValues.clear();
+
+        if (name == "node") {
+
+            id = 0;
+            latitude = 0;
+            longitude = 0;
+
+            const bool success = parseAttributes(selfClosing, [this](std::string_view key, std::string_view value) {
+                if (key == "id")
+                    id = parseId(value);
+                else if (key == "lat")
+                    latitude = parseCoordinate(value);
+                else if (key == "lon")
+                    longitude = parseCoordinate(value);
+            });
+
+            if (!success || (!selfClosing && !parseChildren(Element::NODE)))
+                return Element::END;
+
+            if (negativeId) {
+                error = true;
+                return Element::END;
+            }
+
+            return Element::NODE;
+
+        } else if (name == "way" || name == "relation") {
+
+            const Element element = name == "way" ? Element::WAY : Element::RELATION;
+
+            id = 0;
+            nodeRefs.clear();
+            tags.clear();
+            members.clear();
+
+            const bool success = parseAttributes(selfClosing, [this](std::string_view key, std::string_view value) {
+                if (key == "id")
+                    id = parseId(value);
+            });
+
+            if (!success || (!selfClosing && !parseChildren(element)))
+                return Element::END;
+
+            if (negativeId) {
+                error = true;
+                return Element::END;
+            }
+
+            return element;
+
+        } else if (name == "bounds") {
+
+            const bool success = parseAttributes(selfClosing, [this](std::string_view key, std::string_view value) {
+                double* target = nullptr;
+                if (key == "minlat")
+                    target = &bounds.minLatitude;
+                else if (key == "maxlat")
+                    target = &bounds.maxLatitude;
+                else if (key == "minlon")
+                    target = &bounds.minLongitude;
+                else if (key == "maxlon")
+                    target = &bounds.maxLongitude;
+                if (target != nullptr)
+                    std::from_chars(value.data(), value.data() + value.size(), *target);
+            });
+
+            if (!success)
+                return Element::END;
+
+            return Element::BOUNDS;
+
+        } else if (name == "create" || name == "modify" || name == "delete") {
+
+            // sections of osm change files, the changed elements follow as top level elements
+            const Element element = name == "create" ? Element::CREATE : name == "modify" ? Element::MODIFY : Element::DELETE;
+
+            if (!parseAttributes(selfClosing, [](std::string_view, std::string_view) {}))
+                return Element::END;
+
+            if (!selfClosing)
+                return element;
+
+        } else {
+
+            // unknown elements are skipped, their children are handled as top level elements
+            if (!parseAttributes(selfClosing, [](std::string_view, std::string_view) {}))
+                return Element::END;
+        }
+    }
+
+    return Element::END;
+}
+
+bool OsmTokenizer::parseChildren(Element element) {
+
+    const char* end = data.data() + data.size();
+
+    int depth = 0;
+
+    while (true) {
+
+        position = findChar(position, end, '<');
+        if (end - position < 2) {
+            setError();
+            return false;
+        }
+        position++;
+
+        if (*position == '/') {
+            position = findChar(position, end, '>');
+            if (position == end) {
+                setError();
+                return false;
+            }
+            position++;
+            if (depth == 0)
+                return true;
+            depth--;
+            continue;
+        }
+
+        if (*position == '?' || *position == '!') {
+            if (!skipSpecial())
+                return false;
+            continue;
+        }
+
+        const std::string_view name = readName();
+        bool selfClosing = false;
+        bool success = false;
+
+        if (name == "nd" && element == Element::WAY) {
+
+            success = parseAttributes(selfClosing, [this](std::string_view key, std::string_view value) {
+                if (key == "ref")
+                    nodeRefs.push_back(parseId(value));
+            });
+
+        } else if (name == "tag" && element != Element::NODE) {
+
+            Tag tag;
+            success = parseAttributes(selfClosing, [this, &tag](std::string_view key, std::string_view value) {
+                if (key == "k")
+                    tag.key = decode(value);
+                else if (key == "v")
+                    tag.value = decode(value);
+            });
+            tags.push_back(tag);
+
+        } else if (name == "member" && element == Element::RELATION) {
+
+            Member member{{}, 0, {}};
+            success = parseAttributes(selfClosing, [this, &member](std::string_view key, std::string_view value) {
+                if (key == "type")
+                    member.type = decode(value);
+                else if (key == "ref")
+                    member.ref = parseId(value);
+                else if (key == "role")
+                    member.role = decode(value);
+            });
+            members.push_back(member);
+
+        } else {
+            success = parseAttributes(selfClosing, [](std::string_view, std::string_view) {});
+        }
+
+        if (!success)
+            return false;
+
+        if (!selfClosing)
+            depth++;
+    }
+}
+
+template <typename Callback>
+bool OsmTokenizer::parseAttributes(bool& selfClosing, Callback callback) {
+
+    const char* end = data.data() + data.size();
+
+    while (true) {
+
+        while (position < end && isSpace(*position))
+            position++;
+
+        if (position == end) {
+            setError();
+            return false;
+        }
+
+        if (*position == '>') {
+            position++;
+            selfClosing = false;
+            return true;
+        }
+
+        if (*position == '/') {
+            position++;
+            if (position == end || *position != '>') {
+                setError();
+                return false;
+            }
+            position++;
+            selfClosing = true;
+            return true;
+        }
+
+        const char* nameStart = position;
+        const char* equal = findChar(position, end, '=');
+        if (equal == end) {
+            setError();
+            return false;
+        }
+
+        const char* nameEnd = equal;
+        while (nameEnd > nameStart && isSpace(*(nameEnd - 1)))
+            nameEnd--;
+
+        position = equal + 1;
+        while (position < end && isSpace(*position))
+            position++;
+
+        if (position == end || (*position != '"' && *position != '\'')) {
+            setError();
+            return false;
+        }
+
+        const char* valueStart = position + 1;
+        const char* valueEnd = findChar(valueStart, end, *position);
+        if (valueEnd == end) {
+            setError();
+            return false;
+        }
+
+        callback(std::string_view(nameStart, static_cast<std::size_t>(nameEnd - nameStart)),
+                 std::string_view(valueStart, static_cast<std::size_t>(valueEnd - valueStart)));
+
+        position = valueEnd + 1;
+    }
+}
+
+bool OsmTokenizer::skipSpecial() {
+
+    const std::string_view rest(position, static_cast<std::size_t>(data.data() + data.size() - position));
+
+    std::size_t close = std::string_view::npos;
+    std::size_t closeLength = 1;
+
+    if (rest.starts_with("!--")) {
+        close = rest.find("-->");
+        closeLength = 3;
+    } else if (rest.starts_with("![CDATA[")) {
+        close = rest.find("]]>");
+        closeLength = 3;
+    } else {
+        close = rest.find('>');
+    }
+
+    if (close == std::string_view::npos) {
+        setError();
+        return false;
+    }
+
+    position += close + closeLength;
+    return true;
+}
+
+std::string_view OsmTokenizer::readName() {
+
+    const char* end = data.data() + data.size();
+    const char* start = position;
+
+    while (position < end && !isSpace(*position) && *position != '/' && *position != '>')
+        position++;
+
+    return std::string_view(start, static_cast<std::size_t>(position - start));
+}
+
+/*
+ * Resolve escaped characters and normalise whitespace of attribute values
+ * the same way pugixml does with its default parse options.
+ */
+std::string_view OsmTokenizer::decode(std::string_view value) {
+
+    const bool plain = std::none_of(value.begin(), value.end(), [](char character) {
+        return character == '&' || character == '\t' || character == '\n' || character == '\r';
+    });
+
+    if (plain)
+        return value;
+
+    std::string& decoded = decodedValues.emplace_back();
+    decoded.reserve(value.size());
+
+    for (std::size_t ii = 0; ii < value.size(); ii++) {
+
+        const char character = value[ii];
+
+        if (character == '\r') {
+            decoded.push_back(' ');
+            if (ii + 1 < value.size() && value[ii + 1] == '\n')
+                ii++;
+        } else if (character == '\t' || character == '\n') {
+            decoded.push_back(' ');
+        } else if (character == '&') {
+
+            const std::size_t semicolon = value.find(';', ii);
+            if (semicolon == std::string_view::npos) {
+                decoded.push_back(character);
+                continue;
+            }
+
+            const std::string_view entity = value.substr(ii + 1, semicolon - ii - 1);
+
+            if (entity == "amp") {
+                decoded.push_back('&');
+            } else if (entity == "lt") {
+                decoded.push_back('<');
+            } else if (entity == "gt") {
+                decoded.push_back('>');
+            } else if (entity == "quot") {
+                decoded.push_back('"');
+            } else if (entity == "apos") {
+                decoded.push_back('\'');
+            } else if (entity.size() > 1 && entity.front() == '#') {
+                const bool hex = entity[1] == 'x';
+                const std::string_view digits = entity.substr(hex ? 2 : 1);
+                uint32_t codePoint = 0;
+                const auto [end, errorCode] = std::from_chars(digits.data(), digits.data() + digits.size(), codePoint, hex ? 16 : 10);
+                if (errorCode != std::errc() || end != digits.data() + digits.size()) {
+                    decoded.push_back(character);
+                    continue;
+                }
+                appendUtf8(decoded, codePoint);
+            } else {
+                decoded.push_back(character);
+                continue;
+            }
+
+            ii = semicolon;
+
+        } else {
+            decoded.push_back(character);
+        }
+    }
+
+    return decoded;
+}
+
+/*
+ * The element is still parsed to the end, a negative id is only reported
+ * once the element is complete and not parsed again with the next chunk.
+ */
+uint64_t OsmTokenizer::parseId(std::string_view value) {
+    if (!value.empty() && value.front() == '-')
+        negativeId = true;
+    return parseUnsigned(value);
+}
+
+/*
+ * Reaching the end of the data in the middle of an element is only an
+ * error if there is no more input. Otherwise the element is incomplete.
+ */
+void OsmTokenizer::setError() {
+    if (inputFinished)
+        error = true;
+    else
+        incomplete = true;
+    position = data.data() + data.size();
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace AStarCities {
+
+    /*
+     * Specialised tokenizer for osm xml files. It only understands the
+     * elements needed by the map parser (bounds, node, way, relation with
+     * their nd, tag and member children and the create, modify and delete
+     * sections of osm change files) and skips everything else.
+     * Delimiters are searched with SSE2/AVX2 if available, numbers are
+     * parsed eight digits at a time.
+     *
+     * The input is either one complete buffer or a sequence of chunks from
+     * a reader. Elements that are cut at the end of a chunk are parsed again
+     * once the next chunk is appended.
+     */
+    class OsmTokenizer {
+
+        public:
+
+            enum class Element {
+                END,
+                BOUNDS,
+                NODE,
+                WAY,
+                RELATION,
+                CREATE,
+                MODIFY,
+                DELETE
+            };
+
+            struct Tag {
+                std::string_view key;
+                std::string_view value;
+            };
+
+            struct Member {
+                std::string_view type;
+                uint64_t ref;
+                std::string_view role;
+            };
+
+            struct Bounds {
+                double minLatitude = 0;
+                double maxLatitude = 0;
+                double minLongitude = 0;
+                double maxLongitude = 0;
+            };
+
+            // fills the chunk with the next part of the input, returns false at the end of the input
+            using ChunkReader = std::function<bool(std::string& chunk)>;
+
+            OsmTokenizer(std::string_view data) : data(data), position(data.data()), inputSize(data.size()) {}
+            OsmTokenizer(ChunkReader reader) : data(), position(nullptr), reader(reader), inputFinished(false) {}
+            virtual ~OsmTokenizer() = default;
+
+            // advance to the next known top level element
+            [[nodiscard]] Element next();
+
+            [[nodiscard]] bool hasError() const noexcept { return error; }
+
+            // negative ids of elements that were never uploaded are not supported, they stop the tokenizer with an error
+            [[nodiscard]] bool hasNegativeId() const noexcept { return negativeId; }
+
+            [[nodiscard]] std::size_t getInputSize() const noexcept { return inputSize; }
+
+            [[nodiscard]] uint64_t getId()        const noexcept { return id; }
+            [[nodiscard]] double   getLatitude()  const noexcept { return latitude; }
+            [[nodiscard]] double   getLongitude() const noexcept { return longitude; }
+
+            [[nodiscard]] const Bounds&                getBounds()   const noexcept { return bounds; }
+            [[nodiscard]] const std::vector<uint64_t>& getNodeRefs() const noexcept { return nodeRefs; }
+            [[nodiscard]] const std::vector<Tag>&      getTags()     const noexcept { return tags; }
+            [[nodiscard]] const std::vector<Member>&   getMembers()  const noexcept { return members; }
+
+            [[nodiscard]] static uint64_t parseUnsigned(std::string_view value);
+            [[nodiscard]] static double parseCoordinate(std::string_view value);
+
+        private:
+
+            [[nodiscard]] Element parseNext();
+
+            void refill(std::size_t keepFrom);
+
+            [[nodiscard]] bool skipSpecial();
+            [[nodiscard]] std::string_view readName();
+
+            template <typename Callback>
+            [[nodiscard]] bool parseAttributes(bool& selfClosing, Callback callback);
+
+            [[nodiscard]] bool parseChildren(Element element);
+
+            [[nodiscard]] std::string_view decode(std::string_view value);
+
+            [[nodiscard]] uint64_t parseId(std::string_view value);
+
+            void setError();
+
+            std::string_view data;
+            const char* position;
+
+            std::string buffer;
+            std::string chunk;
+
+            ChunkReader reader;
+
+            std::size_t inputSize = 0;
+
+            bool inputFinished = true;
+            bool incomplete = false;
+            bool error = false;
+            bool negativeId = false;
+
+            uint64_t id = 0;
+            double latitude = 0;
+            double longitude = 0;
+
+            Bounds bounds;
+
+            std::vector<uint64_t> nodeRefs;
+            std::vector<Tag> tags;
+            std::vector<Member> members;
+
+            // values with escaped characters, only valid for the current element
+            std::deque<std::string> decodedValues;
+    };
+}
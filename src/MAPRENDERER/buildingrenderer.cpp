@@ -2,71 +2,270 @@
 #include "buildingrenderer.h"
 
 #include "MAP/node.h"
-#include "MAP/building.h"
+#include "MAP/mappedfile.h"
+#include "MAP/mapsnapshot.h"
+#include "MAP/parallelfor.h"
 
 #include "SFML/Graphics/RenderTarget.hpp"
+#include "SFML/Graphics/PrimitiveType.hpp"
 #include "SFML/Graphics/Transform.hpp"
 
 #include "mapbox/earcut.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <numeric>
 
 using namespace AStarCities;
 
-BuildingRenderer::BuildingRenderer(const Building& building, sf::Color color) :
-    building(building) {
+static constexpr std::array<char, 8> CACHE_MAGIC = {'A', 'S', 'C', 'M', 'E', 'S', 'H', '\0'};
 
-    generateShape(color);
-}
+// followed by the index count of every building and then all indices
+struct CacheHeader {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t mapHash;
+    uint64_t checksum;
+    uint64_t buildingCount;
+    uint64_t indexCount;
+};
+
+/*
+ * The buildings are ordered by the grid cell containing the center of their
+ * bounding box and by color within a cell.
+ */
+void BuildingRenderer::setBuildings(std::span<const Building> buildings, const std::map<BuildingType, sf::Color>& colors, const sf::FloatRect& area,
+                                    const std::string& cachePath, uint64_t mapHash) {
+
+    ranges.clear();
+    vertices.clear();
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    Triangles triangles;
+    if (cachePath.empty() || !loadCache(cachePath, mapHash, buildings, triangles)) {
+        triangles = tessellate(buildings);
+        if (!cachePath.empty() && !writeCache(cachePath, mapHash, triangles))
+            std::cerr << "Renderer WARNING: Failed to write building cache: " << cachePath << std::endl;
+    }
+
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
+    std::cout << "Building mesh time: " << duration.count() << " s" << std::endl;
+
+    std::vector<std::vector<sf::Vector2f>> points(buildings.size());
+    std::vector<sf::FloatRect> bounds(buildings.size());
+    parallelFor(buildings.size(), 0, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t index = begin; index < end; index++) {
+            float minX = std::numeric_limits<float>::max();
+            float minY = std::numeric_limits<float>::max();
+            float maxX = std::numeric_limits<float>::lowest();
+            float maxY = std::numeric_limits<float>::lowest();
+            for (const auto& shape : getShapes(buildings[index])) {
+                for (const auto& [posX, posY] : shape) {
+                    const sf::Vector2f& point = points[index].emplace_back(static_cast<float>(posX), static_cast<float>(posY));
+                    minX = std::min(minX, point.x);
+                    minY = std::min(minY, point.y);
+                    maxX = std::max(maxX, point.x);
+                    maxY = std::max(maxY, point.y);
+                }
+            }
+            bounds[index] = sf::FloatRect(minX, minY, maxX - minX, maxY - minY);
+        }
+    }, 256);
+
+    grid.reset(area, buildings.size());
+    for (uint32_t index = 0; index < buildings.size(); index++) {
+        grid.insert(index, bounds[index]);
+    }
+
+    std::vector<uint32_t> order(buildings.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(order, {}, [&](uint32_t building) {
+        const sf::FloatRect& box = bounds[building];
+        return std::pair(grid.getCell(box.left + box.width / 2, box.top + box.height / 2), colors.at(buildings[building].getType()).toInteger());
+    });
+
+    std::size_t vertexCount = 0;
+    for (const std::vector<uint32_t>& indices : triangles) {
+        vertexCount += indices.size();
+    }
+    vertices.reserve(vertexCount);
 
-void BuildingRenderer::draw(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::Transform& transform) {
-    renderTarget->draw(shape, transform);
-    for (const auto& shape : innerShapes)
-        renderTarget->draw(shape, transform);
+    ranges.assign(buildings.size(), {0, 0});
+    for (uint32_t index : order) {
+
+        const sf::Color color = colors.at(buildings[index].getType());
+        ranges[index] = {static_cast<uint32_t>(vertices.size()), static_cast<uint32_t>(triangles[index].size())};
+
+        for (uint32_t point : triangles[index]) {
+            vertices.push_back(sf::Vertex(points[index][point], color));
+        }
+    }
+
+    useBuffer = sf::VertexBuffer::isAvailable() && buffer.create(vertices.size()) && buffer.update(vertices.data());
 }
 
-void BuildingRenderer::generateShape(sf::Color color) {
+void BuildingRenderer::draw(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::Transform& transform, const sf::FloatRect& visibleArea) {
+
+    sf::RenderStates renderStates;
+    renderStates.transform = transform;
+
+    grid.query(visibleArea, visibleBuildings);
 
-    std::vector<std::vector<std::array<double, 2>>> points;
+    visibleRanges.clear();
+    for (uint32_t building : visibleBuildings) {
+        visibleRanges.push_back(ranges[building]);
+    }
+    std::ranges::sort(visibleRanges, {}, &VertexRange::firstVertex);
 
-    // first add outer shape
-    points.push_back({});
-    const std::vector<std::reference_wrapper<const Node>>& nodes = building.getNodes();
-    for (std::size_t ii = 0; ii < nodes.size() - 1; ii++) {
-        const auto [posX, posY] = nodes.at(ii).get().getLocalPosition();
-        points.at(0).push_back({posX, posY});
+    // buildings following each other in the mesh are drawn together
+    VertexRange range = {0, 0};
+    for (const VertexRange& visibleRange : visibleRanges) {
+        if (visibleRange.firstVertex != range.firstVertex + range.vertexCount) {
+            drawRange(*renderTarget, range, renderStates);
+            range = visibleRange;
+        } else {
+            range.vertexCount += visibleRange.vertexCount;
+        }
     }
+    drawRange(*renderTarget, range, renderStates);
+}
+
+void BuildingRenderer::drawRange(sf::RenderTarget& renderTarget, const VertexRange& range, const sf::RenderStates& renderStates) const {
+
+    if (range.vertexCount == 0)
+        return;
+
+    // without vertex buffer support the vertices are drawn from the cpu
+    if (useBuffer)
+        renderTarget.draw(buffer, range.firstVertex, range.vertexCount, renderStates);
+    else
+        renderTarget.draw(vertices.data() + range.firstVertex, range.vertexCount, sf::PrimitiveType::Triangles, renderStates);
+}
 
-    // add optional inner shapes
-    for (const std::vector<std::reference_wrapper<const Node>>& shape : building.getInnerShapeNodes()) {
-        points.push_back({});
-        std::vector<std::array<double, 2>> innerShape;
-        for (std::size_t ii = 0; ii < shape.size() - 1; ii++) {
-            const auto [posX, posY] = shape.at(ii).get().getLocalPosition();
-            points.back().push_back({posX, posY});
+std::vector<std::vector<std::array<double, 2>>> BuildingRenderer::getShapes(const Building& building) {
+
+    std::vector<std::vector<std::array<double, 2>>> shapes(building.getInnerShapeCount() + 1);
+
+    for (std::size_t shapeIndex = 0; shapeIndex < shapes.size(); shapeIndex++) {
+        const NodeRange nodes = shapeIndex == 0 ? building.getNodes() : building.getInnerShapeNodes(shapeIndex - 1);
+        for (std::size_t ii = 0; ii + 1 < nodes.size(); ii++) {
+            const auto [posX, posY] = nodes[ii].getLocalPosition();
+            shapes[shapeIndex].push_back({posX, posY});
         }
     }
 
-    // run tessellation
-    std::vector<uint32_t> indices = mapbox::earcut<uint32_t>(points);
+    return shapes;
+}
 
-    shape.resize(indices.size());
-    shape.setPrimitiveType(sf::PrimitiveType::Triangles);
+std::size_t BuildingRenderer::getPointCount(const Building& building) {
 
-    // create vertex array
-    for (std::size_t ii = 0; ii < indices.size(); ii++) {
+    std::size_t count = 0;
+    for (std::size_t shapeIndex = 0; shapeIndex <= building.getInnerShapeCount(); shapeIndex++) {
+        const NodeRange nodes = shapeIndex == 0 ? building.getNodes() : building.getInnerShapeNodes(shapeIndex - 1);
+        count += nodes.size() > 0 ? nodes.size() - 1 : 0;
+    }
+    return count;
+}
+
+BuildingRenderer::Triangles BuildingRenderer::tessellate(std::span<const Building> buildings) {
 
-        std::size_t indexX = 0;
-        std::size_t indexY = indices.at(ii);
+    Triangles triangles(buildings.size());
 
-        while (indexY >= points.at(indexX).size()) {
-            indexY -= points.at(indexX).size();
-            indexX++;
+    // every building is tessellated on its own, so the blocks do not share any state
+    parallelFor(buildings.size(), 0, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t index = begin; index < end; index++) {
+            triangles[index] = mapbox::earcut<uint32_t>(getShapes(buildings[index]));
         }
+    }, 64);
+
+    return triangles;
+}
+
+bool BuildingRenderer::loadCache(const std::string& filePath, uint64_t mapHash, std::span<const Building> buildings, Triangles& triangles) {
+
+    const MappedFile file(filePath);
+    if (!file.isOpen() || file.getSize() < sizeof(CacheHeader))
+        return false;
+
+    CacheHeader header;
+    std::memcpy(&header, file.getData(), sizeof(CacheHeader));
+
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.headerSize != sizeof(CacheHeader) ||
+        header.mapHash != mapHash || header.buildingCount != buildings.size()) {
+        std::cout << "Renderer - Building cache is outdated" << std::endl;
+        return false;
+    }
+
+    const std::size_t payloadSize = file.getSize() - sizeof(CacheHeader);
+    if (header.indexCount > payloadSize / sizeof(uint32_t) ||
+        payloadSize != (header.buildingCount + header.indexCount) * sizeof(uint32_t) ||
+        header.checksum != MapSnapshot::hashData(file.getData() + sizeof(CacheHeader), payloadSize)) {
+        std::cerr << "Renderer WARNING: Damaged building cache: " << filePath << std::endl;
+        return false;
+    }
+
+    const char* counts = file.getData() + sizeof(CacheHeader);
+    const char* indices = counts + header.buildingCount * sizeof(uint32_t);
+    const char* indicesEnd = file.getData() + file.getSize();
+
+    triangles.assign(buildings.size(), {});
+    for (std::size_t building = 0; building < buildings.size(); building++) {
+
+        uint32_t count;
+        std::memcpy(&count, counts + building * sizeof(uint32_t), sizeof(uint32_t));
+        if (count % 3 != 0 || count > static_cast<std::size_t>(indicesEnd - indices) / sizeof(uint32_t))
+            return false;
+
+        triangles[building].resize(count);
+        std::memcpy(triangles[building].data(), indices, count * sizeof(uint32_t));
+        indices += count * sizeof(uint32_t);
+
+        const std::size_t pointCount = getPointCount(buildings[building]);
+        if (!std::ranges::all_of(triangles[building], [pointCount](uint32_t point) { return point < pointCount; }))
+            return false;
+    }
+
+    return indices == indicesEnd;
+}
+
+bool BuildingRenderer::writeCache(const std::string& filePath, uint64_t mapHash, const Triangles& triangles) {
+
+    std::vector<uint32_t> payload;
+    payload.reserve(triangles.size());
+    for (const std::vector<uint32_t>& indices : triangles) {
+        payload.push_back(static_cast<uint32_t>(indices.size()));
+    }
+    for (const std::vector<uint32_t>& indices : triangles) {
+        payload.insert(payload.end(), indices.begin(), indices.end());
+    }
+
+    CacheHeader header{};
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.headerSize = sizeof(CacheHeader);
+    header.mapHash = mapHash;
+    header.buildingCount = triangles.size();
+    header.indexCount = payload.size() - triangles.size();
+    header.checksum = MapSnapshot::hashData(reinterpret_cast<const char*>(payload.data()), payload.size() * sizeof(uint32_t));
 
-        const auto [posX, posY] = points.at(indexX).at(indexY);
-        shape[ii].position = sf::Vector2f(static_cast<float>(posX), static_cast<float>(posY));
-        shape[ii].color = color;
+    // write to a temporary file first, as the map snapshot does
+    const std::string tempFilePath = filePath + ".tmp";
+    {
+        std::ofstream fileStream(tempFilePath, std::ios::binary | std::ios::trunc);
+        fileStream.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+        fileStream.write(reinterpret_cast<const char*>(payload.data()), static_cast<std::streamsize>(payload.size() * sizeof(uint32_t)));
+        if (!fileStream)
+            return false;
     }
 
+    std::error_code error;
+    std::filesystem::rename(tempFilePath, filePath, error);
+    return !error;
 }
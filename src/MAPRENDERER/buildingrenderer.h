@@ -1,38 +1,87 @@
 #pragma once
 
 #include "MAP/buildingtype.h"
+#include "MAP/building.h"
 
-#include "SFML/Graphics/VertexArray.hpp"
-#include "SFML/Graphics/ConvexShape.hpp"
+#include "spatialgrid.h"
 
+#include "SFML/Graphics/VertexBuffer.hpp"
+#include "SFML/Graphics/Vertex.hpp"
+#include "SFML/Graphics/Color.hpp"
+
+#include <array>
+#include <map>
 #include <memory>
+#include <span>
+#include <string>
+#include <vector>
 
 namespace sf {
     class RenderTarget;
+    class RenderStates;
     class Transform;
 }
 
 namespace AStarCities {
 
-    class Building;
-
+    /*
+     * Draws all buildings of a map from one triangle mesh. The buildings are
+     * tessellated in parallel, the triangles of every building are a range
+     * of the mesh. The buildings are ordered by grid cell and color, so the
+     * visible buildings are drawn with a few calls.
+     *
+     * The triangles only depend on the shapes of the buildings. They can be
+     * cached in a file next to the map, the cache stores the hash of the map
+     * and is written again if the map changes.
+     */
     class BuildingRenderer {
 
         public:
 
-            BuildingRenderer(const Building& building, sf::Color color = sf::Color(0, 0, 0));
+            BuildingRenderer() = default;
             virtual ~BuildingRenderer() = default;
 
-            void draw(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::Transform& transform);
+            // the area is the local area of the map, without a cache path the buildings are always tessellated
+            void setBuildings(std::span<const Building> buildings, const std::map<BuildingType, sf::Color>& colors, const sf::FloatRect& area,
+                              const std::string& cachePath = "", uint64_t mapHash = 0);
+
+            // the visible area is in local coordinates
+            void draw(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::Transform& transform, const sf::FloatRect& visibleArea);
+
+            static constexpr uint32_t CACHE_VERSION = 1;
 
         private:
 
-            void generateShape(sf::Color color);
+            struct VertexRange {
+                uint32_t firstVertex;
+                uint32_t vertexCount;
+            };
+
+            // building -> triangle corners as indices into the points of all its shapes
+            using Triangles = std::vector<std::vector<uint32_t>>;
+
+            // the outer shape followed by the inner shapes, without the closing nodes
+            [[nodiscard]] static std::vector<std::vector<std::array<double, 2>>> getShapes(const Building& building);
+            [[nodiscard]] static std::size_t getPointCount(const Building& building);
+            [[nodiscard]] static Triangles tessellate(std::span<const Building> buildings);
+
+            [[nodiscard]] static bool loadCache(const std::string& filePath, uint64_t mapHash, std::span<const Building> buildings, Triangles& triangles);
+            [[nodiscard]] static bool writeCache(const std::string& filePath, uint64_t mapHash, const Triangles& triangles);
+
+            void drawRange(sf::RenderTarget& renderTarget, const VertexRange& range, const sf::RenderStates& renderStates) const;
+
+            // building index -> vertices
+            std::vector<VertexRange> ranges;
+
+            std::vector<sf::Vertex> vertices;
 
-            const Building& building;
+            SpatialGrid grid;
 
-            sf::VertexArray shape;
+            // reused by every draw
+            std::vector<uint32_t> visibleBuildings;
+            std::vector<VertexRange> visibleRanges;
 
-            std::vector<sf::ConvexShape> innerShapes;
+            sf::VertexBuffer buffer{sf::PrimitiveType::Triangles, sf::VertexBuffer::Static};
+            bool useBuffer = false;
     };
 }
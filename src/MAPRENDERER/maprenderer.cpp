@@ -2,6 +2,7 @@
 #include "maprenderer.h"
 
 #include "MAP/map.h"
+#include "MAP/versionedmap.h"
 
 #include "SOLVER/solver.h"
 
@@ -9,7 +10,11 @@
 #include "SFML/Window/Event.hpp"
 #include "SFML/Graphics/RenderWindow.hpp"
 #include "SFML/Graphics/Sprite.hpp"
+#include "SFML/Graphics/View.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <iostream>
 
 using namespace AStarCities;
@@ -21,6 +26,11 @@ MapRenderer::MapRenderer() {
         roadColorMap.insert({type, sf::Color(0, 0, 0)});
     }
 
+    // minor roads are hidden when zoomed out
+    setRoadMinimumZoom(RoadType::PATHS, 0.5f);
+    setRoadMinimumZoom(RoadType::OTHER, 0.5f);
+    setRoadMinimumZoom({RoadType::SERVICE, RoadType::TRACK}, 0.25f);
+
     // init building color map
     for (BuildingType type : BuildingType::getAll()) {
         buildingColorMap.insert({type, sf::Color(128, 128, 128)});
@@ -41,28 +51,56 @@ void MapRenderer::openWindow(uint32_t width, uint32_t height) {
     window->display();
 }
 
-void MapRenderer::setMap(std::shared_ptr<Map> map) {
+void MapRenderer::setMap(std::shared_ptr<const Map> map) {
 
     this->map = map;
 
-    std::map<uint64_t, std::pair<uint32_t, std::reference_wrapper<const Node>>> nodeIndexMap;
+    updateMap();
 
-    for (const auto& pair : map->getRoads()) {
-        const Road& road = pair.second;
-        roads.insert({road.getId(), RoadRenderer(road, roadColorMap[road.getType()])});
-    }
+    const float translateX = (static_cast<float>(map->getLocalWidth()) - static_cast<float>(resWidth)) / 2;
+    const float translateY = (static_cast<float>(map->getLocalHeight()) - static_cast<float>(resHeight)) / 2;
+
+    globalTransform.translate(sf::Vector2f(-translateX, -translateY));
+}
+
+void MapRenderer::setVersionedMap(std::shared_ptr<const VersionedMap> versionedMap) {
 
-    for (const auto& pair : map->getBuildings()) {
-        const Building& building = pair.second;
-        buildings.push_back(BuildingRenderer(building, buildingColorMap[building.getType()]));
+    // the version is read first, the pinned map is at least as new
+    this->versionedMap = versionedMap;
+    mapVersion = versionedMap->getVersion();
+
+    setMap(versionedMap->pin());
+}
+
+/*
+ * The indices of the roads and intersections change with the map, so the
+ * white roads are dropped and a running solver is replaced by a new one.
+ */
+void MapRenderer::updateMap() {
+
+    const sf::FloatRect area(0, 0, static_cast<float>(map->getLocalWidth()), static_cast<float>(map->getLocalHeight()));
+
+    roads.setRoads(map->getRoads(), roadColorMap, roadMinimumZoomMap, area);
+
+    buildings.setBuildings(map->getBuildings(), buildingColorMap, area, buildingCachePath, buildingCacheHash);
+
+    const std::span<const Intersection> intersections = map->getIntersections();
+    intersectionGrid.reset(area, intersections.size());
+    for (const Intersection& intersection : intersections) {
+        const auto [posX, posY] = intersection.getPosition();
+        intersectionGrid.insert(intersection.getIndex(), sf::FloatRect(static_cast<float>(posX) - INTERSECTION_MARKER_SIZE, static_cast<float>(posY) - INTERSECTION_MARKER_SIZE,
+                                                                       2 * INTERSECTION_MARKER_SIZE, 2 * INTERSECTION_MARKER_SIZE));
     }
 
     createBoundingBox(static_cast<float>(map->getLocalWidth()), static_cast<float>(map->getLocalHeight()));
 
-    const float translateX = (static_cast<float>(map->getLocalWidth()) - static_cast<float>(resWidth)) / 2;
-    const float translateY = (static_cast<float>(map->getLocalHeight()) - static_cast<float>(resHeight)) / 2;
+    whiteRoads.clear();
+    staticLayerValid = false;
 
-    globalTransform.translate(sf::Vector2f(-translateX, -translateY));
+    if (solver) {
+        const auto& [start, end] = Solver::selectStartAndEndIntersection(map);
+        setSolver(std::shared_ptr<Solver>(new Solver(map, start, end)));
+    }
 }
 
 void MapRenderer::setSolver(std::shared_ptr<Solver> solver) {
@@ -85,6 +123,21 @@ void MapRenderer::setRoadColor(const std::set<RoadType>& types, sf::Color color)
     }
 }
 
+void MapRenderer::setBuildingCache(const std::string& filePath, uint64_t mapHash) {
+    buildingCachePath = filePath;
+    buildingCacheHash = mapHash;
+}
+
+void MapRenderer::setRoadMinimumZoom(RoadType type, float minimumZoom) {
+    roadMinimumZoomMap[type] = minimumZoom;
+}
+
+void MapRenderer::setRoadMinimumZoom(const std::set<RoadType>& types, float minimumZoom) {
+    for (RoadType type : types) {
+        setRoadMinimumZoom(type, minimumZoom);
+    }
+}
+
 void MapRenderer::setBuildingColor(BuildingType type, sf::Color color) {
     if (auto find = buildingColorMap.find(type); find != buildingColorMap.end()) {
         find->second = color;
@@ -114,6 +167,12 @@ void MapRenderer::runSimulation() {
 
         handleEvents();
 
+        if (versionedMap && versionedMap->getVersion() != mapVersion) {
+            mapVersion = versionedMap->getVersion();
+            map = versionedMap->pin();
+            updateMap();
+        }
+
         drawMap();
 
         animateSolution();
@@ -131,9 +190,9 @@ void MapRenderer::animateSolution() {
         // wait for a few seconds before running a new path
         if (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - timer) >= std::chrono::seconds(8)) {
             //resetWhiteRoads();
+            // the routing graph is shared with the finished solver while the map is unchanged
             const auto& [start, end] = Solver::selectStartAndEndIntersection(map);
-            std::shared_ptr<Solver> solver = std::shared_ptr<Solver>(new Solver(map, start, end));
-            setSolver(solver);
+            setSolver(std::shared_ptr<Solver>(new Solver(map, solver->getRoutingGraph(), start, end)));
         }
     } else {
         // wait a short time before starting animation
@@ -151,15 +210,15 @@ void MapRenderer::doSolutionStep() {
     std::size_t doSteps = 1 + (solver->getOpenListSize() / 15);
     for (std::size_t ii = 0; ii < doSteps; ii++) {
 
-        Road const* road = nullptr;
-        while (road == nullptr && !solver->isDone()) {
-            road = solver->doSubStep();
+        // an edge of the routing graph can be made of several roads
+        RoadRange edgeRoads(nullptr, {});
+        while (edgeRoads.empty() && !solver->isDone()) {
+            edgeRoads = solver->doSubStep();
         }
 
-        if (road != nullptr) {
-            RoadRenderer& roadRenderer = roads.find(road->getId())->second;
-            roadRenderer.setColor(255);
-            whiteRoads.insert(roadRenderer);
+        for (const Road& road : edgeRoads) {
+            roads.setColor(road.getIndex(), 255);
+            whiteRoads.insert(road.getIndex());
         }
     }
 
@@ -169,9 +228,8 @@ void MapRenderer::doSolutionStep() {
         timer = std::chrono::steady_clock::now();
 
         for (const Road& road : solver->getSolution()) {
-            RoadRenderer& roadRenderer = roads.find(road.getId())->second;
-            roadRenderer.setColor(3000);
-            whiteRoads.insert(roadRenderer);
+            roads.setColor(road.getIndex(), 3000);
+            whiteRoads.insert(road.getIndex());
         }
     }
 }
@@ -210,9 +268,15 @@ void MapRenderer::handleKeyPress(const sf::Event& event) {
         case sf::Keyboard::R:
         case sf::Keyboard::S:
             showRoads = !showRoads;
+            staticLayerValid = false;
             break;
         case sf::Keyboard::B:
             showBuildings = !showBuildings;
+            staticLayerValid = false;
+            break;
+        case sf::Keyboard::U:
+            if (mapUpdate)
+                mapUpdate();
             break;
         default:
             break;
@@ -239,6 +303,8 @@ void MapRenderer::handleMouseWheel(const sf::Event& event) {
             globalTransform.scale(sf::Vector2f(zoomOut, zoomOut), mouseVector);
             zoom *= zoomOut;
         }
+
+        staticLayerValid = false;
     }
 }
 
@@ -261,80 +327,192 @@ void MapRenderer::handleMouseMove(const sf::Event& event) {
     const float y = static_cast<float>(event.mouseMove.y - oldY) / zoom;
 
     globalTransform.translate(sf::Vector2f(x, y));
+    staticLayerValid = false;
 
     oldX = event.mouseMove.x;
     oldY = event.mouseMove.y;
 }
 
+sf::FloatRect MapRenderer::getVisibleArea() const {
+    const sf::Vector2u size = window->getSize();
+    return globalTransform.getInverse().transformRect(sf::FloatRect(0, 0, static_cast<float>(size.x), static_cast<float>(size.y)));
+}
+
 void MapRenderer::drawMap() {
 
-    window->clear(backgroundColor);
+    const sf::FloatRect visibleArea = getVisibleArea();
+
+    if (updateStaticLayer(visibleArea)) {
+        window->draw(sf::Sprite(staticLayer->getTexture()));
+        if (showRoads)
+            roads.draw(window, globalTransform, whiteRoads, zoom);
+    } else {
+        // without a render texture every layer is drawn every frame
+        window->clear(backgroundColor);
+        drawStaticLayers(window, visibleArea);
+    }
+
+    if (solver) {
+        drawInterchange(window, solver->getStart());
+        drawInterchange(window, solver->getEnd());
+    }
+
+    window->display();
+}
+
+/*
+ * The white roads are part of the static layer with the color they had when
+ * it was drawn. They are drawn again on top of it in every frame, and their
+ * part of the static layer is drawn again once they have faded.
+ */
+void MapRenderer::drawStaticLayers(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::FloatRect& area) {
 
     if (showRoads) {
-        for (const auto& [id, road] : roads) {
-            road.draw(window, globalTransform);
-        }
+        roads.draw(renderTarget, globalTransform, area, zoom);
     }
 
     if (showBuildings) {
-        for (BuildingRenderer& building : buildings) {
-            building.draw(window, globalTransform);
-        }
+        buildings.draw(renderTarget, globalTransform, area);
     }
 
     if (showBoundingBox) {
-        window->draw(&boundingBox[0], boundingBox.size(), sf::PrimitiveType::LineStrip, globalTransform);
+        renderTarget->draw(&boundingBox[0], boundingBox.size(), sf::PrimitiveType::LineStrip, globalTransform);
     }
 
     if (showInterchanges) {
-        drawInterchanges();
+        drawInterchanges(renderTarget, area);
     }
+}
 
-    if (solver) {
-        drawInterchange(solver->getStart());
-        drawInterchange(solver->getEnd());
+bool MapRenderer::updateStaticLayer(const sf::FloatRect& visibleArea) {
+
+    if (!useStaticLayer)
+        return false;
+
+    // the layer has the size of the view of the window, so it is drawn without scaling
+    if (!staticLayer || staticLayer->getSize().x != resWidth || staticLayer->getSize().y != resHeight) {
+        staticLayer = std::shared_ptr<sf::RenderTexture>(new sf::RenderTexture());
+        if (!staticLayer->create(resWidth, resHeight)) {
+            std::cerr << "Renderer WARNING: Failed to create static layer texture" << std::endl;
+            useStaticLayer = false;
+            return false;
+        }
+        staticLayerValid = false;
     }
 
-    window->display();
+    if (!staticLayerValid) {
+        staticLayer->clear(backgroundColor);
+        drawStaticLayers(staticLayer, visibleArea);
+        staticLayer->display();
+        staticLayerValid = true;
+    } else if (staticLayerDirtyArea) {
+        redrawStaticLayer(*staticLayerDirtyArea);
+        staticLayer->display();
+    }
+
+    staticLayerDirtyArea.reset();
+    return true;
 }
 
-void MapRenderer::drawInterchanges() {
-    for (const auto& [id, intersection] : map->getIntersections()) {
-        drawInterchange(intersection);
+void MapRenderer::redrawStaticLayer(const sf::FloatRect& area) {
+
+    const float width = static_cast<float>(staticLayer->getSize().x);
+    const float height = static_cast<float>(staticLayer->getSize().y);
+
+    // whole pixels, with one more pixel around the area for the lines on its border
+    const sf::FloatRect pixelArea = globalTransform.transformRect(area);
+    const float left   = std::max(0.0f, std::floor(pixelArea.left) - 1);
+    const float top    = std::max(0.0f, std::floor(pixelArea.top) - 1);
+    const float right  = std::min(width, std::ceil(pixelArea.left + pixelArea.width) + 1);
+    const float bottom = std::min(height, std::ceil(pixelArea.top + pixelArea.height) + 1);
+
+    if (right <= left || bottom <= top)
+        return;
+
+    const sf::FloatRect pixels(left, top, right - left, bottom - top);
+
+    // the view draws like the default view, but only to the pixels of the area
+    sf::View view(pixels);
+    view.setViewport(sf::FloatRect(left / width, top / height, pixels.width / width, pixels.height / height));
+    staticLayer->setView(view);
+
+    const std::array<sf::Vertex, 4> background = {
+        sf::Vertex(sf::Vector2f(left,  top),    backgroundColor),
+        sf::Vertex(sf::Vector2f(right, top),    backgroundColor),
+        sf::Vertex(sf::Vector2f(left,  bottom), backgroundColor),
+        sf::Vertex(sf::Vector2f(right, bottom), backgroundColor)
+    };
+    staticLayer->draw(background.data(), background.size(), sf::PrimitiveType::TriangleStrip);
+
+    // items close to the area can cover some of its pixels
+    sf::FloatRect drawArea = globalTransform.getInverse().transformRect(pixels);
+    const float margin = INTERSECTION_MARKER_SIZE + 1 / zoom;
+    drawArea = sf::FloatRect(drawArea.left - margin, drawArea.top - margin, drawArea.width + 2 * margin, drawArea.height + 2 * margin);
+
+    drawStaticLayers(staticLayer, drawArea);
+
+    staticLayer->setView(staticLayer->getDefaultView());
+}
+
+void MapRenderer::markStaticLayerDirty(const sf::FloatRect& area) {
+
+    if (!staticLayerDirtyArea) {
+        staticLayerDirtyArea = area;
+        return;
     }
+
+    const sf::FloatRect& dirtyArea = *staticLayerDirtyArea;
+    const float left   = std::min(dirtyArea.left, area.left);
+    const float top    = std::min(dirtyArea.top, area.top);
+    const float right  = std::max(dirtyArea.left + dirtyArea.width, area.left + area.width);
+    const float bottom = std::max(dirtyArea.top + dirtyArea.height, area.top + area.height);
+    staticLayerDirtyArea = sf::FloatRect(left, top, right - left, bottom - top);
 }
 
-void MapRenderer::drawInterchange(const Intersection& intersection) {
+void MapRenderer::drawInterchanges(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::FloatRect& visibleArea) {
+    intersectionGrid.query(visibleArea, visibleItems);
+    for (uint32_t intersection : visibleItems) {
+        drawInterchange(renderTarget, map->getIntersections()[intersection]);
+    }
+}
+
+void MapRenderer::drawInterchange(std::shared_ptr<sf::RenderTarget> renderTarget, const Intersection& intersection) {
     auto [posX, posY] = intersection.getPosition();
     intersectionCircle.setPosition(sf::Vector2f(static_cast<float>(posX) - INTERSECTION_MARKER_SIZE, static_cast<float>(posY) - INTERSECTION_MARKER_SIZE));
-    window->draw(intersectionCircle, globalTransform);
+    renderTarget->draw(intersectionCircle, globalTransform);
 }
 
 void MapRenderer::fadeRoads() {
 
-    for (RoadRenderer& road : whiteRoads) {
+    for (auto iterator = whiteRoads.begin(); iterator != whiteRoads.end();) {
+
+        const RoadIndex road = *iterator;
 
-        sf::Color targetColor = roadColorMap[road.getRoad().getType()];
-        double color = road.getColor();
+        sf::Color targetColor = roadColorMap[map->getRoads()[road].getType()];
+        double color = roads.getColor(road);
 
         if (solver->isDone())
             color = targetColor.r + (color - targetColor.r) * 0.99;
         else
             color = targetColor.r + (color - targetColor.r) * 0.997;
 
-        if (color < targetColor.r) {
-            whiteRoads.erase(road);
-            road.setColor(targetColor);
+        // the color only converges to the target, it is snapped once it is less than half a gray value away
+        if (color - targetColor.r < 0.5) {
+            iterator = whiteRoads.erase(iterator);
+            roads.setColor(road, targetColor);
+            markStaticLayerDirty(roads.getBounds(road));
         } else {
-            road.setColor(color);
+            roads.setColor(road, color);
+            iterator++;
         }
     }
 }
 
 void MapRenderer::resetWhiteRoads() {
 
-    for (RoadRenderer& road : whiteRoads) {
-        road.setColor(roadColorMap[road.getRoad().getType()]);
+    for (RoadIndex road : whiteRoads) {
+        roads.setColor(road, roadColorMap[map->getRoads()[road].getType()]);
+        markStaticLayerDirty(roads.getBounds(road));
     }
     whiteRoads.clear();
 }
@@ -2,16 +2,21 @@
 
 #include "RoadRenderer.h"
 #include "BuildingRenderer.h"
+#include "spatialgrid.h"
 
 #include "SFML/Graphics/Transform.hpp"
 #include "SFML/Graphics/Color.hpp"
 #include "SFML/Graphics/RenderTexture.hpp"
 #include "SFML/Graphics/CircleShape.hpp"
 
+#include <functional>
 #include <memory>
 #include <vector>
+#include <map>
 #include <set>
+#include <string>
 #include <chrono>
+#include <optional>
 
 namespace sf {
     class RenderWindow;
@@ -21,6 +26,7 @@ namespace sf {
 namespace AStarCities {
 
     class Map;
+    class VersionedMap;
     class Intersection;
     class Solver;
 
@@ -38,16 +44,31 @@ namespace AStarCities {
 
             void setRoadColor(RoadType type, sf::Color color);
             void setRoadColor(const std::set<RoadType>& types, sf::Color color);
+            // roads of the type are hidden below the zoom, has to be set before the map
+            void setRoadMinimumZoom(RoadType type, float minimumZoom);
+            void setRoadMinimumZoom(const std::set<RoadType>& types, float minimumZoom);
             void setBuildingColor(BuildingType type, sf::Color color);
             void setBuildingColor(const std::set<BuildingType>& types, sf::Color color);
+            // the building meshes are cached in the file, has to be set before the map
+            void setBuildingCache(const std::string& filePath, uint64_t mapHash);
 
-            void setMap(std::shared_ptr<Map> map);
+            void setMap(std::shared_ptr<const Map> map);
             void setSolver(std::shared_ptr<Solver> solver);
 
+            // shows the current version, a new version is taken before the next frame
+            // and a running solver is replaced, the old solver keeps its version until then
+            void setVersionedMap(std::shared_ptr<const VersionedMap> versionedMap);
+
+            // called with the U key, it can publish a new version of the versioned map
+            void setMapUpdate(std::function<void()> update) { mapUpdate = std::move(update); }
+
             void runSimulation();
 
         private:
 
+            // takes the roads, buildings and intersections of the current map version
+            void updateMap();
+
             void animateSolution();
             void doSolutionStep();
 
@@ -59,9 +80,18 @@ namespace AStarCities {
             void handleMouseButtons(const sf::Event& event);
             void handleMouseMove(const sf::Event& event);
 
+            // the part of the map shown in the window in local coordinates
+            [[nodiscard]] sf::FloatRect getVisibleArea() const;
+
             void drawMap();
-            void drawInterchanges();
-            void drawInterchange(const Intersection& inter);
+            void drawStaticLayers(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::FloatRect& area);
+            void drawInterchanges(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::FloatRect& visibleArea);
+            void drawInterchange(std::shared_ptr<sf::RenderTarget> renderTarget, const Intersection& inter);
+
+            // returns false if there is no static layer and everything has to be drawn to the window
+            [[nodiscard]] bool updateStaticLayer(const sf::FloatRect& visibleArea);
+            void redrawStaticLayer(const sf::FloatRect& area);
+            void markStaticLayerDirty(const sf::FloatRect& area);
 
             void fadeRoads();
             void resetWhiteRoads();
@@ -70,11 +100,28 @@ namespace AStarCities {
 
             std::shared_ptr<sf::RenderWindow> window;
 
-            std::shared_ptr<Map> map;
+            // roads, buildings and markers drawn once for the current view, only the white roads are drawn every frame
+            std::shared_ptr<sf::RenderTexture> staticLayer;
+            bool staticLayerValid = false;
+            bool useStaticLayer = true;
+
+            // part of the static layer to draw again in local coordinates
+            std::optional<sf::FloatRect> staticLayerDirtyArea;
+
+            std::shared_ptr<const Map> map;
             std::shared_ptr<Solver> solver;
 
-            std::map<uint64_t, RoadRenderer> roads;
-            std::vector<BuildingRenderer> buildings;
+            std::shared_ptr<const VersionedMap> versionedMap;
+            uint64_t mapVersion = 0;
+            std::function<void()> mapUpdate;
+
+            RoadRenderer roads;
+            BuildingRenderer buildings;
+
+            SpatialGrid intersectionGrid;
+
+            // items found in the visible area, reused by every frame
+            std::vector<uint32_t> visibleItems;
 
             sf::Transform globalTransform;
 
@@ -97,9 +144,14 @@ namespace AStarCities {
             sf::Color boundingBoxColor = sf::Color(255, 0, 0);
 
             std::map<RoadType, sf::Color> roadColorMap;
+            std::map<RoadType, float> roadMinimumZoomMap;
             std::map<BuildingType, sf::Color> buildingColorMap;
 
-            std::set<std::reference_wrapper<RoadRenderer>, std::less<RoadRenderer>> whiteRoads;
+            std::string buildingCachePath;
+            uint64_t buildingCacheHash = 0;
+
+            // roads fading back to their color
+            std::set<RoadIndex> whiteRoads;
 
             std::chrono::steady_clock::time_point timer = std::chrono::steady_clock::now();
 
@@ -2,51 +2,268 @@
 #include "roadrenderer.h"
 
 #include "MAP/node.h"
-#include "MAP/road.h"
 
 #include "SFML/Graphics/RenderTarget.hpp"
 #include "SFML/Graphics/PrimitiveType.hpp"
 #include "SFML/Graphics/Transform.hpp"
-#include "SFML/Graphics/Shader.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
 
 using namespace AStarCities;
 
-RoadRenderer::RoadRenderer(const Road& road, sf::Color color) :
-    road(road),
-    color((color.r + color.g + color.b) / 3),
-    line(sf::PrimitiveType::LineStrip, road.getNodes().size()) {
+/*
+ * Douglas-Peucker simplification without recursion. Returns the indices of
+ * the kept points, the first and the last point are always kept. The line
+ * must have at least two points.
+ */
+static std::vector<uint32_t> simplifyLine(const std::vector<sf::Vector2f>& points, float tolerance) {
+
+    std::vector<bool> keep(points.size(), tolerance == 0);
+    keep.front() = true;
+    keep.back() = true;
+
+    std::vector<std::pair<uint32_t, uint32_t>> sections;
+    if (tolerance > 0)
+        sections.push_back({0, static_cast<uint32_t>(points.size() - 1)});
+
+    while (!sections.empty()) {
 
-    /*const uint8_t r = static_cast<uint8_t>(std::rand() % 256);
-    const uint8_t g = static_cast<uint8_t>(std::rand() % 256);
-    const uint8_t b = static_cast<uint8_t>(std::rand() % 256);
-    color = sf::Color(r, g, b);*/
+        const auto [first, last] = sections.back();
+        sections.pop_back();
+
+        const sf::Vector2f start = points[first];
+        const float directionX = points[last].x - start.x;
+        const float directionY = points[last].y - start.y;
+        const float length = std::sqrt(directionX * directionX + directionY * directionY);
+
+        // distance to the line through the ends, or to the start for closed lines
+        float maxDistance = 0;
+        uint32_t farthest = first;
+        for (uint32_t index = first + 1; index < last; index++) {
+            const float offsetX = points[index].x - start.x;
+            const float offsetY = points[index].y - start.y;
+            const float distance = length > 0 ? std::abs(directionX * offsetY - directionY * offsetX) / length : std::sqrt(offsetX * offsetX + offsetY * offsetY);
+            if (distance > maxDistance) {
+                maxDistance = distance;
+                farthest = index;
+            }
+        }
+
+        if (maxDistance > tolerance) {
+            keep[farthest] = true;
+            sections.push_back({first, farthest});
+            sections.push_back({farthest, last});
+        }
+    }
 
-    const std::vector<std::reference_wrapper<const Node>>& nodes = road.getNodes();
-    for (std::size_t ii = 0; ii < nodes.size(); ii++) {
-        const auto [posX, posY] = nodes.at(ii).get().getLocalPosition();
-        line[ii].position = sf::Vector2f(static_cast<float>(posX), static_cast<float>(posY));
-        line[ii].color = color;
+    std::vector<uint32_t> kept;
+    for (uint32_t index = 0; index < points.size(); index++) {
+        if (keep[index])
+            kept.push_back(index);
     }
+    return kept;
 }
 
-bool RoadRenderer::operator<(const RoadRenderer& road) const {
-    return road.road.getId() < this->road.getId();
+/*
+ * A road with n nodes is stored as n - 1 separate line segments, so the
+ * roads do not have to be connected in the buffer. The levels follow each
+ * other in the buffer and the roads of every level are ordered by the grid
+ * cell containing the center of their bounding box. Within a cell the roads
+ * shown at every zoom come first.
+ */
+void RoadRenderer::setRoads(std::span<const Road> roads, const std::map<RoadType, sf::Color>& roadColors,
+                            const std::map<RoadType, float>& minimumZooms, const sf::FloatRect& area) {
+
+    colors.clear();
+    roadMinimumZooms.clear();
+    vertices.clear();
+
+    colors.reserve(roads.size());
+    roadMinimumZooms.reserve(roads.size());
+
+    for (const Road& road : roads) {
+        const sf::Color color = roadColors.at(road.getType());
+        colors.push_back((color.r + color.g + color.b) / 3);
+        const auto minimumZoom = minimumZooms.find(road.getType());
+        roadMinimumZooms.push_back(minimumZoom != minimumZooms.end() ? minimumZoom->second : 0.0f);
+    }
+
+    std::vector<std::vector<sf::Vector2f>> points;
+    points.reserve(roads.size());
+    bounds.clear();
+    bounds.reserve(roads.size());
+    for (const Road& road : roads) {
+        std::vector<sf::Vector2f>& roadPoints = points.emplace_back();
+        float minX = std::numeric_limits<float>::max();
+        float minY = std::numeric_limits<float>::max();
+        float maxX = std::numeric_limits<float>::lowest();
+        float maxY = std::numeric_limits<float>::lowest();
+        for (const Node& node : road.getNodes()) {
+            const auto [posX, posY] = node.getLocalPosition();
+            const sf::Vector2f& point = roadPoints.emplace_back(static_cast<float>(posX), static_cast<float>(posY));
+            minX = std::min(minX, point.x);
+            minY = std::min(minY, point.y);
+            maxX = std::max(maxX, point.x);
+            maxY = std::max(maxY, point.y);
+        }
+        bounds.push_back(sf::FloatRect(minX, minY, maxX - minX, maxY - minY));
+    }
+
+    // roads of the unanalysed map can lose all their nodes to missing node references, they are not drawn
+    grid.reset(area, roads.size());
+    for (RoadIndex index = 0; index < roads.size(); index++) {
+        if (points[index].size() >= 2)
+            grid.insert(index, bounds[index]);
+    }
+
+    std::vector<RoadIndex> order(roads.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::ranges::stable_sort(order, {}, [this](RoadIndex road) {
+        const sf::FloatRect& box = bounds[road];
+        return std::pair(grid.getCell(box.left + box.width / 2, box.top + box.height / 2), roadMinimumZooms[road]);
+    });
+
+    for (std::size_t level = 0; level < LEVEL_COUNT; level++) {
+
+        levels[level].ranges.assign(roads.size(), {0, 0});
+        levels[level].changedBegin = 0;
+        levels[level].changedEnd = 0;
+
+        for (RoadIndex index : order) {
+
+            const sf::Color color = roadColors.at(roads[index].getType());
+            const std::vector<sf::Vector2f>& roadPoints = points[index];
+            if (roadPoints.size() < 2)
+                continue;
+
+            const std::vector<uint32_t> kept = simplifyLine(roadPoints, LEVEL_TOLERANCES[level]);
+
+            levels[level].ranges[index] = {static_cast<uint32_t>(vertices.size()), static_cast<uint32_t>(2 * (kept.size() - 1))};
+
+            for (std::size_t ii = 1; ii < kept.size(); ii++) {
+                vertices.push_back(sf::Vertex(roadPoints[kept[ii - 1]], color));
+                vertices.push_back(sf::Vertex(roadPoints[kept[ii]], color));
+            }
+        }
+    }
+
+    useBuffer = sf::VertexBuffer::isAvailable() && buffer.create(vertices.size()) && buffer.update(vertices.data());
+}
+
+void RoadRenderer::setColor(RoadIndex road, double color) {
+    colors[road] = color;
+    const uint8_t gray = static_cast<uint8_t>(std::clamp(color, 0.0, 255.0));
+    setVertexColor(road, sf::Color(gray, gray, gray));
 }
 
-void RoadRenderer::setColor(double colorValue) {
-    this->color = colorValue;
-    const uint8_t color = static_cast<uint8_t>(std::clamp(colorValue, 0.0, 255.0));
-    setColor(sf::Color(color, color, color));
+void RoadRenderer::setColor(RoadIndex road, sf::Color color) {
+    colors[road] = (color.r + color.g + color.b) / 3;
+    setVertexColor(road, color);
 }
 
-void RoadRenderer::setColor(sf::Color color) {
-    for (std::size_t ii = 0; ii < line.getVertexCount(); ii++) {
-        line[ii].color = color;
+void RoadRenderer::setVertexColor(RoadIndex road, sf::Color color) {
+
+    for (Level& level : levels) {
+
+        const VertexRange& range = level.ranges[road];
+        if (range.vertexCount == 0)
+            continue;
+
+        for (uint32_t vertex = range.firstVertex; vertex < range.firstVertex + range.vertexCount; vertex++)
+            vertices[vertex].color = color;
+
+        if (level.changedBegin == level.changedEnd) {
+            level.changedBegin = range.firstVertex;
+            level.changedEnd = range.firstVertex + range.vertexCount;
+        } else {
+            level.changedBegin = std::min<std::size_t>(level.changedBegin, range.firstVertex);
+            level.changedEnd = std::max<std::size_t>(level.changedEnd, range.firstVertex + range.vertexCount);
+        }
+    }
+}
+
+std::size_t RoadRenderer::getLevel(float zoom) {
+
+    // the coarsest level that stays within the maximum error on the screen
+    for (std::size_t level = LEVEL_COUNT - 1; level > 0; level--) {
+        if (LEVEL_TOLERANCES[level] * zoom <= MAX_SCREEN_ERROR)
+            return level;
+    }
+    return 0;
+}
+
+void RoadRenderer::draw(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::Transform& transform, const sf::FloatRect& visibleArea, float zoom) {
+
+    Level& level = levels[getLevel(zoom)];
+    uploadChanges(level);
+
+    grid.query(visibleArea, visibleRoads);
+
+    visibleRanges.clear();
+    for (uint32_t road : visibleRoads) {
+        if (roadMinimumZooms[road] <= zoom)
+            visibleRanges.push_back(level.ranges[road]);
+    }
+
+    drawRanges(*renderTarget, transform);
+}
+
+void RoadRenderer::draw(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::Transform& transform, const std::set<RoadIndex>& roads, float zoom) {
+
+    Level& level = levels[getLevel(zoom)];
+    uploadChanges(level);
+
+    visibleRanges.clear();
+    for (RoadIndex road : roads) {
+        if (roadMinimumZooms[road] <= zoom)
+            visibleRanges.push_back(level.ranges[road]);
+    }
+
+    drawRanges(*renderTarget, transform);
+}
+
+void RoadRenderer::uploadChanges(Level& level) {
+
+    // one upload of the range that contains all changed roads of the level
+    if (level.changedBegin != level.changedEnd) {
+        if (useBuffer)
+            buffer.update(vertices.data() + level.changedBegin, level.changedEnd - level.changedBegin, static_cast<unsigned int>(level.changedBegin));
+        level.changedBegin = 0;
+        level.changedEnd = 0;
     }
 }
 
-void RoadRenderer::draw(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::Transform& transform) const {
+void RoadRenderer::drawRanges(sf::RenderTarget& renderTarget, const sf::Transform& transform) {
+
     sf::RenderStates renderStates;
     renderStates.transform = transform;
-    renderTarget->draw(line, renderStates);
+
+    std::ranges::sort(visibleRanges, {}, &VertexRange::firstVertex);
+
+    // roads following each other in the buffer are drawn together
+    VertexRange range = {0, 0};
+    for (const VertexRange& visibleRange : visibleRanges) {
+        if (visibleRange.firstVertex != range.firstVertex + range.vertexCount) {
+            drawRange(renderTarget, range, renderStates);
+            range = visibleRange;
+        } else {
+            range.vertexCount += visibleRange.vertexCount;
+        }
+    }
+    drawRange(renderTarget, range, renderStates);
+}
+
+void RoadRenderer::drawRange(sf::RenderTarget& renderTarget, const VertexRange& range, const sf::RenderStates& renderStates) const {
+
+    if (range.vertexCount == 0)
+        return;
+
+    // without vertex buffer support the vertices are drawn from the cpu
+    if (useBuffer)
+        renderTarget.draw(buffer, range.firstVertex, range.vertexCount, renderStates);
+    else
+        renderTarget.draw(vertices.data() + range.firstVertex, range.vertexCount, sf::PrimitiveType::Lines, renderStates);
 }
@@ -1,50 +1,116 @@
 #pragma once
 
 #include "MAP/roadtype.h"
+#include "MAP/road.h"
 
-#include "SFML/Graphics/VertexArray.hpp"
+#include "spatialgrid.h"
+
+#include "SFML/Graphics/VertexBuffer.hpp"
+#include "SFML/Graphics/Vertex.hpp"
 #include "SFML/Graphics/Color.hpp"
 
+#include <array>
+#include <map>
 #include <memory>
+#include <set>
+#include <span>
+#include <vector>
 
 namespace sf {
     class RenderTarget;
+    class RenderStates;
     class Transform;
-    class Shader;
 }
 
 namespace AStarCities {
 
-    class Road;
-
+    /*
+     * Draws all roads of a map from one vertex buffer. Every road is a range
+     * of line segments in the buffer. Color changes only update the vertices
+     * on the cpu, the changed part of the buffer is uploaded once before the
+     * next draw.
+     *
+     * Only the roads in the visible area are drawn. The vertices of roads in
+     * the same grid cell are next to each other in the buffer, so the visible
+     * roads are drawn with a few calls.
+     *
+     * Every road is stored at several levels of detail, simplified with
+     * growing tolerances. The level is chosen by the zoom, so a simplified
+     * road differs by at most one pixel from the full road on the screen.
+     * Road types with a minimum zoom are hidden when zoomed out further.
+     */
     class RoadRenderer {
 
         public:
 
-            RoadRenderer(const Road& road, sf::Color color = sf::Color(0, 0, 0));
+            RoadRenderer() = default;
             virtual ~RoadRenderer() = default;
 
-            bool operator<(const RoadRenderer& road) const;
+            // the area is the local area of the map, road types without a minimum zoom are always drawn
+            void setRoads(std::span<const Road> roads, const std::map<RoadType, sf::Color>& colors,
+                          const std::map<RoadType, float>& minimumZooms, const sf::FloatRect& area);
+
+            // gray value, values above 255 are drawn white
+            void setColor(RoadIndex road, double color);
+            void setColor(RoadIndex road, sf::Color color);
+            [[nodiscard]] double getColor(RoadIndex road) const { return colors[road]; }
 
-            void draw(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::Transform& transform) const;
+            // in local coordinates
+            [[nodiscard]] const sf::FloatRect& getBounds(RoadIndex road) const { return bounds[road]; }
 
-            void setColor(sf::Color color);
-            void setColor(double color);
-            //[[nodiscard]] sf::Color getColor() const { return color; }
-            [[nodiscard]] double getColor() const { return color; }
+            // the visible area is in local coordinates, the zoom is the size of a local unit in pixels
+            void draw(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::Transform& transform, const sf::FloatRect& visibleArea, float zoom);
 
-            [[nodiscard]] const Road& getRoad() const { return road; }
+            // draws only the given roads, at the same level of detail as all roads
+            void draw(std::shared_ptr<sf::RenderTarget> renderTarget, const sf::Transform& transform, const std::set<RoadIndex>& roads, float zoom);
 
         private:
 
-            const Road& road;
+            struct VertexRange {
+                uint32_t firstVertex;
+                uint32_t vertexCount;
+            };
+
+            // road index -> vertices, and the vertices not uploaded yet
+            struct Level {
+                std::vector<VertexRange> ranges;
+                std::size_t changedBegin = 0;
+                std::size_t changedEnd = 0;
+            };
+
+            static constexpr std::size_t LEVEL_COUNT = 4;
+
+            // largest distance of a removed node to the simplified road in local units
+            static constexpr std::array<float, LEVEL_COUNT> LEVEL_TOLERANCES = {0.0f, 0.25f, 1.0f, 4.0f};
+
+            // largest distance in pixels
+            static constexpr float MAX_SCREEN_ERROR = 1.0f;
+
+            [[nodiscard]] static std::size_t getLevel(float zoom);
+
+            void setVertexColor(RoadIndex road, sf::Color color);
+            void uploadChanges(Level& level);
+
+            // draws the visible ranges
+            void drawRanges(sf::RenderTarget& renderTarget, const sf::Transform& transform);
+            void drawRange(sf::RenderTarget& renderTarget, const VertexRange& range, const sf::RenderStates& renderStates) const;
+
+            std::array<Level, LEVEL_COUNT> levels;
+
+            // road index -> gray value, minimum zoom and bounding box
+            std::vector<double> colors;
+            std::vector<float> roadMinimumZooms;
+            std::vector<sf::FloatRect> bounds;
 
-            //sf::Color color;
+            std::vector<sf::Vertex> vertices;
 
-            double color;
+            SpatialGrid grid;
 
-            sf::VertexArray line;
+            // reused by every draw
+            std::vector<uint32_t> visibleRoads;
+            std::vector<VertexRange> visibleRanges;
 
-            [[nodiscard]] sf::Color getColorByType(RoadType type) const;
+            sf::VertexBuffer buffer{sf::PrimitiveType::Lines, sf::VertexBuffer::Dynamic};
+            bool useBuffer = false;
     };
 }
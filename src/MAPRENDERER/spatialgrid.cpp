@@ -0,0 +1,71 @@
+
+#include "spatialgrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace AStarCities;
+
+void SpatialGrid::reset(const sf::FloatRect& area, std::size_t itemCount) {
+
+    this->area = area;
+
+    // an empty area has a single cell
+    const double cellsPerSide = area.width > 0 && area.height > 0 ? std::ceil(std::sqrt(static_cast<double>(itemCount) / ITEMS_PER_CELL)) : 1.0;
+    columns = static_cast<uint32_t>(std::clamp(cellsPerSide, 1.0, static_cast<double>(MAX_CELLS_PER_SIDE)));
+    rows = columns;
+
+    cells.assign(static_cast<std::size_t>(columns) * rows, {});
+}
+
+void SpatialGrid::insert(uint32_t item, const sf::FloatRect& bounds) {
+
+    const CellRange range = getCellRange(bounds);
+
+    for (uint32_t row = range.firstRow; row <= range.lastRow; row++) {
+        for (uint32_t column = range.firstColumn; column <= range.lastColumn; column++)
+            cells[row * columns + column].push_back(item);
+    }
+}
+
+void SpatialGrid::query(const sf::FloatRect& queryArea, std::vector<uint32_t>& items) const {
+
+    items.clear();
+
+    const CellRange range = getCellRange(queryArea);
+
+    for (uint32_t row = range.firstRow; row <= range.lastRow; row++) {
+        for (uint32_t column = range.firstColumn; column <= range.lastColumn; column++) {
+            const std::vector<uint32_t>& cell = cells[row * columns + column];
+            items.insert(items.end(), cell.begin(), cell.end());
+        }
+    }
+
+    // items overlapping several cells are found more than once
+    if (range.firstRow != range.lastRow || range.firstColumn != range.lastColumn) {
+        std::ranges::sort(items);
+        items.erase(std::ranges::unique(items).begin(), items.end());
+    }
+}
+
+uint32_t SpatialGrid::getCell(float x, float y) const {
+    return getRow(y) * columns + getColumn(x);
+}
+
+uint32_t SpatialGrid::getColumn(float x) const {
+    if (columns == 1)
+        return 0;
+    const float column = (x - area.left) / area.width * static_cast<float>(columns);
+    return static_cast<uint32_t>(std::clamp(column, 0.0f, static_cast<float>(columns - 1)));
+}
+
+uint32_t SpatialGrid::getRow(float y) const {
+    if (rows == 1)
+        return 0;
+    const float row = (y - area.top) / area.height * static_cast<float>(rows);
+    return static_cast<uint32_t>(std::clamp(row, 0.0f, static_cast<float>(rows - 1)));
+}
+
+SpatialGrid::CellRange SpatialGrid::getCellRange(const sf::FloatRect& bounds) const {
+    return {getColumn(bounds.left), getColumn(bounds.left + bounds.width), getRow(bounds.top), getRow(bounds.top + bounds.height)};
+}
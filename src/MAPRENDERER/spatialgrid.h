@@ -0,0 +1,59 @@
+#pragma once
+
+#include "SFML/Graphics/Rect.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace AStarCities {
+
+    /*
+     * Uniform grid over the map to find the items in the visible part of it.
+     * An item is stored in every cell its bounding box overlaps, items outside
+     * of the grid are stored in the cells at its border. A query returns the
+     * items of all cells overlapping an area, which can include a few items
+     * that are close to the area but not inside of it.
+     */
+    class SpatialGrid {
+
+        public:
+
+            SpatialGrid() = default;
+            virtual ~SpatialGrid() = default;
+
+            // removes all items, the number of cells is chosen for the expected number of items
+            void reset(const sf::FloatRect& area, std::size_t itemCount);
+
+            void insert(uint32_t item, const sf::FloatRect& bounds);
+
+            // the items are sorted and every item is returned once
+            void query(const sf::FloatRect& area, std::vector<uint32_t>& items) const;
+
+            // index of the cell containing the point
+            [[nodiscard]] uint32_t getCell(float x, float y) const;
+
+        private:
+
+            struct CellRange {
+                uint32_t firstColumn;
+                uint32_t lastColumn;
+                uint32_t firstRow;
+                uint32_t lastRow;
+            };
+
+            static constexpr std::size_t ITEMS_PER_CELL = 16;
+            static constexpr uint32_t MAX_CELLS_PER_SIDE = 256;
+
+            [[nodiscard]] uint32_t getColumn(float x) const;
+            [[nodiscard]] uint32_t getRow(float y) const;
+            [[nodiscard]] CellRange getCellRange(const sf::FloatRect& bounds) const;
+
+            sf::FloatRect area;
+
+            uint32_t columns = 1;
+            uint32_t rows = 1;
+
+            // cell -> items, the cells are stored row by row
+            std::vector<std::vector<uint32_t>> cells = std::vector<std::vector<uint32_t>>(1);
+    };
+}
@@ -0,0 +1,104 @@
+
+#include "routinggraph.h"
+
+using namespace AStarCities;
+
+/*
+ * Chains without any node, closed rings of chain intersections, get one of
+ * their intersections as node after all other edges have been added.
+ */
+RoutingGraph::RoutingGraph(const Map& map) :
+    map(map), mapVersion(map.getVersion()) {
+
+    const std::span<const Intersection> intersections = map.getIntersections();
+
+    intersectionNodes.assign(intersections.size(), NO_NODE);
+    chainPositions.assign(intersections.size(), ChainPosition());
+
+    for (IntersectionIndex index = 0; index < intersections.size(); index++) {
+        if (!isChainIntersection(intersections[index])) {
+            intersectionNodes[index] = static_cast<uint32_t>(nodeIntersections.size());
+            nodeIntersections.push_back(index);
+        }
+    }
+
+    edgeOffsets.reserve(nodeIntersections.size() + 1);
+    edgeOffsets.push_back(0);
+
+    for (uint32_t node = 0; node < nodeIntersections.size(); node++) {
+        addNode(nodeIntersections[node]);
+    }
+
+    for (IntersectionIndex index = 0; index < intersections.size(); index++) {
+        if (intersectionNodes[index] == NO_NODE && chainPositions[index].edge == NO_EDGE) {
+            intersectionNodes[index] = static_cast<uint32_t>(nodeIntersections.size());
+            nodeIntersections.push_back(index);
+            addNode(index);
+        }
+    }
+}
+
+void RoutingGraph::addNode(IntersectionIndex intersection) {
+    for (const Intersection::Connection& connection : map.getIntersections()[intersection].getConnections())
+        addEdge(connection);
+    edgeOffsets.push_back(static_cast<uint32_t>(edges.size()));
+}
+
+/*
+ * Follows the connection through all contracted intersections until a node
+ * of the graph is reached. This can be the start of the edge for closed chains.
+ */
+void RoutingGraph::addEdge(const Intersection::Connection& firstConnection) {
+
+    const uint32_t edgeIndex = static_cast<uint32_t>(edges.size());
+    Edge edge = {NO_NODE, static_cast<uint32_t>(edgeRoads.size()), 0, 0};
+
+    const Intersection::Connection* connection = &firstConnection;
+    while (true) {
+        edgeRoads.push_back(connection->road.getIndex());
+        edge.roadCount++;
+        edge.length += connection->length;
+
+        const Intersection& next = connection->intersection;
+        if (getNode(next) != NO_NODE)
+            break;
+
+        // every chain is followed once in each direction
+        ChainPosition& position = chainPositions[next.getIndex()];
+        if (position.edge == NO_EDGE)
+            position = {edgeIndex, NO_EDGE, edge.roadCount};
+        else
+            position.reverseEdge = edgeIndex;
+
+        // leave the chain intersection on the other road
+        const std::span<const Intersection::Connection> connections = next.getConnections();
+        connection = &connections[&connections[0].road == &connection->road ? 1 : 0];
+    }
+
+    edge.target = getNode(connection->intersection);
+    edges.push_back(edge);
+}
+
+std::span<const RoutingGraph::Edge> RoutingGraph::getEdges(uint32_t node) const {
+    return std::span<const Edge>(edges).subspan(edgeOffsets[node], edgeOffsets[node + 1] - edgeOffsets[node]);
+}
+
+RoutingGraph::Edge RoutingGraph::getPartialEdge(uint32_t edge, uint32_t firstRoad, uint32_t lastRoad, uint32_t target) const {
+
+    Edge part = {target, edges[edge].firstRoad + firstRoad, lastRoad - firstRoad, 0};
+
+    // summed in the same order as the full edge
+    for (const Road& road : getRoads(part))
+        part.length += road.getLength();
+
+    return part;
+}
+
+RoadRange RoutingGraph::getRoads(const Edge& edge) const {
+    return RoadRange(map.getRoads().data(), std::span<const RoadIndex>(edgeRoads).subspan(edge.firstRoad, edge.roadCount));
+}
+
+bool RoutingGraph::isChainIntersection(const Intersection& intersection) const {
+    const std::span<const Intersection::Connection> connections = intersection.getConnections();
+    return connections.size() == 2 && connections[0].intersection != intersection && connections[1].intersection != intersection;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "MAP/map.h"
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+namespace AStarCities {
+
+    /*
+     * Graph used by the solver. Every chain of intersections with exactly two
+     * roads is contracted into a single edge, regardless of the name or type of
+     * the roads. An edge keeps the summed length and the roads it is made of, so
+     * a path through the graph can be unpacked into the roads of the map.
+     *
+     * The graph is built once for a map version and shared by all solvers.
+     * The start or the end of a path can be a contracted intersection, the
+     * solver splits the chain edges at its position for that search only.
+     */
+    class RoutingGraph {
+
+        public:
+
+            static constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+
+            // the roads are a range in the edge road buffer, in order from the source to the target
+            struct Edge {
+                uint32_t target;
+                uint32_t firstRoad;
+                uint32_t roadCount;
+                double length;
+            };
+
+            static constexpr uint32_t NO_EDGE = std::numeric_limits<uint32_t>::max();
+
+            // a contracted intersection is passed by the edges of its chain in both directions,
+            // the road is the number of roads of the edge before the intersection
+            struct ChainPosition {
+                uint32_t edge = NO_EDGE;
+                uint32_t reverseEdge = NO_EDGE;
+                uint32_t road = 0;
+            };
+
+            RoutingGraph(const Map& map);
+            virtual ~RoutingGraph() = default;
+
+            // the graph references the roads and intersections of the map version it was built for
+            [[nodiscard]] bool isOutdated() const { return map.getVersion() != mapVersion; }
+
+            [[nodiscard]] std::size_t getNodeCount() const noexcept { return nodeIntersections.size(); }
+            [[nodiscard]] std::size_t getEdgeCount() const noexcept { return edges.size(); }
+
+            [[nodiscard]] const Intersection& getIntersection(uint32_t node) const { return map.getIntersections()[nodeIntersections[node]]; }
+
+            // NO_NODE if the intersection has been contracted
+            [[nodiscard]] uint32_t getNode(const Intersection& intersection) const { return intersectionNodes[intersection.getIndex()]; }
+
+            [[nodiscard]] std::span<const Edge> getEdges(uint32_t node) const;
+            [[nodiscard]] const Edge& getEdge(uint32_t edge) const { return edges[edge]; }
+
+            [[nodiscard]] const ChainPosition& getChainPosition(const Intersection& intersection) const { return chainPositions[intersection.getIndex()]; }
+
+            // the roads [firstRoad, lastRoad) of the edge, leading to the target
+            [[nodiscard]] Edge getPartialEdge(uint32_t edge, uint32_t firstRoad, uint32_t lastRoad, uint32_t target) const;
+
+            [[nodiscard]] RoadRange getRoads(const Edge& edge) const;
+
+        private:
+
+            // an intersection with two different roads, which are not loops
+            [[nodiscard]] bool isChainIntersection(const Intersection& intersection) const;
+
+            void addNode(IntersectionIndex intersection);
+            void addEdge(const Intersection::Connection& firstConnection);
+
+            const Map& map;
+            uint64_t mapVersion;
+
+            // intersection -> graph node and graph node -> intersection
+            std::vector<uint32_t> intersectionNodes;
+            std::vector<IntersectionIndex> nodeIntersections;
+
+            // edges of a node are a range in edges
+            std::vector<uint32_t> edgeOffsets;
+            std::vector<Edge> edges;
+            std::vector<RoadIndex> edgeRoads;
+
+            // intersection -> position in its chain, only set for contracted intersections
+            std::vector<ChainPosition> chainPositions;
+
+    };
+}
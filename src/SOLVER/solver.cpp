@@ -1,19 +1,24 @@
 
 #include "solver.h"
 
-#include <iterator>
 #include <random>
 #include <iostream>
 
 using namespace AStarCities;
 
-Solver::Solver(std::shared_ptr<Map> map, const Intersection& start, const Intersection& end) :
-    map(map), startNode(start), endNode(end) {
+Solver::Solver(std::shared_ptr<const Map> map, const Intersection& start, const Intersection& end) :
+    Solver(map, nullptr, start, end) {}
+
+Solver::Solver(std::shared_ptr<const Map> map, std::shared_ptr<const RoutingGraph> graph, const Intersection& start, const Intersection& end) :
+    map(map), mapVersion(map->getVersion()), graph(graph), startNode(start), endNode(end) {
+
+    if (!this->graph || this->graph->isOutdated())
+        this->graph = std::make_shared<const RoutingGraph>(*map);
 
     init();
-    }
+}
 
-std::pair<const Intersection&, const Intersection&> Solver::selectStartAndEndIntersection(std::shared_ptr<Map> map) {
+std::pair<const Intersection&, const Intersection&> Solver::selectStartAndEndIntersection(std::shared_ptr<const Map> map) {
 
     double minDistance = std::max(map->getLocalWidth(), map->getLocalWidth()) / 2;
 
@@ -39,43 +44,101 @@ std::pair<const Intersection&, const Intersection&> Solver::selectStartAndEndInt
     }
 }
 
-const Intersection& Solver::selectRandomIntersection(std::shared_ptr<Map> map) {
+const Intersection& Solver::selectRandomIntersection(std::shared_ptr<const Map> map) {
 
-    const std::map<uint64_t, Intersection>& nodes = map->getIntersections();
+    const std::span<const Intersection> nodes = map->getIntersections();
 
     std::random_device rd;
     std::mt19937 generator(rd());
     std::uniform_int_distribution<> distr(0, static_cast<int>(nodes.size() - 1));
 
-    auto iter = nodes.begin();
-    int rand = distr(generator);
-    std::advance(iter, rand);
-    return iter->second;
+    return nodes[static_cast<std::size_t>(distr(generator))];
 }
 
 void Solver::init() {
 
     openList.clear();
-    closedList.clear();
     nodes.clear();
+    queryEdges.clear();
 
-    // init path nodes
-    // TODO: it is ineffective to generate all elements at the start
-    // maybe there is a better solution
-    for (const auto& [id, inter] : map->getIntersections()) {
-        nodes.insert({id, PathNode(inter)});
+    // init path nodes, one for every node of the routing graph and for the start and end
+    nodes.reserve(graph->getNodeCount() + 2);
+    for (uint32_t node = 0; node < graph->getNodeCount(); node++) {
+        nodes.push_back(PathNode(graph->getIntersection(node), node));
+    }
+
+    startGraphNode = addQueryNode(startNode);
+    endGraphNode = addQueryNode(endNode);
+
+    // both in the same chain, the path between them does not pass the ends of the chain
+    if (startGraphNode >= graph->getNodeCount() && endGraphNode >= graph->getNodeCount()) {
+        const RoutingGraph::ChainPosition& start = graph->getChainPosition(startNode);
+        const RoutingGraph::ChainPosition& end = graph->getChainPosition(endNode);
+        if (start.edge == end.edge) {
+            const uint32_t roadCount = graph->getEdge(start.edge).roadCount;
+            if (start.road < end.road)
+                addQueryEdge(startGraphNode, graph->getPartialEdge(start.edge, start.road, end.road, endGraphNode));
+            else
+                addQueryEdge(startGraphNode, graph->getPartialEdge(start.reverseEdge, roadCount - start.road, roadCount - end.road, endGraphNode));
+        }
     }
 
+    closedList.assign(nodes.size(), false);
+
     // init open list
-    PathNode& start = nodes.find(startNode.getId())->second;
-    start.setDistanceToTarget(startNode.getNode().localDistance(endNode.getNode()));
+    PathNode& start = nodes[startGraphNode];
+    start.setDistanceToTarget(startNode.getNode().distance(endNode.getNode()));
     start.setDistanceTraveled(0);
     openList.insert(start);
 }
 
+/*
+ * The contracted intersection gets edges to both ends of its chain, and the
+ * ends get edges to it. The full chain edges are kept.
+ */
+uint32_t Solver::addQueryNode(const Intersection& intersection) {
+
+    if (graph->getNode(intersection) != RoutingGraph::NO_NODE)
+        return graph->getNode(intersection);
+
+    const uint32_t node = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(PathNode(intersection, node));
+
+    const RoutingGraph::ChainPosition& position = graph->getChainPosition(intersection);
+    const RoutingGraph::Edge& edge = graph->getEdge(position.edge);
+    const RoutingGraph::Edge& reverseEdge = graph->getEdge(position.reverseEdge);
+    const uint32_t reversePosition = reverseEdge.roadCount - position.road;
+
+    addQueryEdge(node, graph->getPartialEdge(position.edge, position.road, edge.roadCount, edge.target));
+    addQueryEdge(node, graph->getPartialEdge(position.reverseEdge, reversePosition, reverseEdge.roadCount, reverseEdge.target));
+    addQueryEdge(reverseEdge.target, graph->getPartialEdge(position.edge, 0, position.road, node));
+    addQueryEdge(edge.target, graph->getPartialEdge(position.reverseEdge, 0, reversePosition, node));
+
+    return node;
+}
+
+void Solver::addQueryEdge(uint32_t node, const RoutingGraph::Edge& edge) {
+
+    auto [iterator, inserted] = queryEdges.try_emplace(node);
+    if (inserted && node < graph->getNodeCount()) {
+        const std::span<const RoutingGraph::Edge> edges = graph->getEdges(node);
+        iterator->second.assign(edges.begin(), edges.end());
+    }
+
+    iterator->second.push_back(edge);
+}
+
+std::span<const RoutingGraph::Edge> Solver::getEdges(uint32_t node) const {
+
+    if (const auto iterator = queryEdges.find(node); iterator != queryEdges.end())
+        return iterator->second;
+
+    return graph->getEdges(node);
+}
+
 void Solver::doStep(bool doSubSteps) {
 
-    if (solved)
+    if (solved || isOutdated())
         return;
 
     if (openList.empty()) {
@@ -97,18 +160,18 @@ void Solver::doStep(bool doSubSteps) {
 
     this->currentNode = &currentNode;
 
-    closedList.insert(currentNode);
+    closedList[currentNode.getGraphNode()] = true;
 
-    currentConnections = currentNode.getConnections();
-    currentConnectionIterator = currentConnections.begin();
+    currentEdges = getEdges(currentNode.getGraphNode());
+    currentEdgeIterator = currentEdges.begin();
 
     if (!doSubSteps)
         return;
 
     //expandNode(currentNode);
 
-    for (const Intersection::Connection& connection : currentConnections) {
-        doSubStep(currentNode, connection);
+    for (const RoutingGraph::Edge& edge : currentEdges) {
+        doSubStep(currentNode, edge);
     }
 
     if (openList.empty()) {
@@ -117,48 +180,54 @@ void Solver::doStep(bool doSubSteps) {
     }
 }
 
-Road const* Solver::doSubStep() {
+RoadRange Solver::doSubStep() {
 
     if (currentNode == nullptr)
         doStep(false);
 
-    if (solved)
-        return nullptr;
+    if (solved || isOutdated() || currentNode == nullptr)
+        return RoadRange(nullptr, {});
 
-    doSubStep(*currentNode, *currentConnectionIterator);
+    // the expanded node has no edges
+    if (currentEdgeIterator == currentEdges.end()) {
+        currentNode = nullptr;
+        return RoadRange(nullptr, {});
+    }
+
+    doSubStep(*currentNode, *currentEdgeIterator);
 
-    Road const* road = &currentConnectionIterator->road;
+    const RoadRange roads = graph->getRoads(*currentEdgeIterator);
 
-    currentConnectionIterator++;
+    currentEdgeIterator++;
 
-    if (currentConnectionIterator == currentConnections.end())
+    if (currentEdgeIterator == currentEdges.end())
         currentNode = nullptr;
 
-    return road;
+    return roads;
 }
 
-void Solver::doSubStep(const PathNode& currentNode, const Intersection::Connection& connection) {
+void Solver::doSubStep(const PathNode& currentNode, const RoutingGraph::Edge& edge) {
 
-    PathNode& nextNode = nodes.find(connection.intersection.getId())->second;
+    PathNode& nextNode = nodes[edge.target];
 
-    if (closedList.contains(nextNode))
+    if (closedList[edge.target])
         return;
 
-    double newDistance = connection.road.getLocalLength() + currentNode.getDistanceTraveled();
+    double newDistance = edge.length + currentNode.getDistanceTraveled();
 
     if (openList.contains(nextNode) && newDistance >= nextNode.getDistanceTraveled())
         return;
 
-    nextNode.setPredecessor(currentNode, connection.road);
+    nextNode.setPredecessor(currentNode, edge);
     nextNode.setDistanceTraveled(newDistance);
-    const double distanceToTarget = connection.intersection.getNode().localDistance(endNode.getNode());
+    const double distanceToTarget = nextNode.getIntersection().getNode().distance(endNode.getNode());
     nextNode.setDistanceToTarget(distanceToTarget);
 
     // Elements in a set are constant. Therefor the element has to be removed
     // and reinserted for the key to be updated
     auto [iter, success] = openList.insert(nextNode);
     if (!success) {
-        //std::cout << "Update node in open list: " << iter->get().getId() << '\n';
+        //std::cout << "Update node in open list: " << iter->get().getIntersection().getId() << '\n';
         openList.erase(iter);
         openList.insert(nextNode);
     } else {
@@ -172,13 +241,17 @@ std::vector<std::reference_wrapper<const Road>> Solver::getSolution() const {
 
     std::reference_wrapper<const PathNode> currentNode = openList.begin()->get();
 
-    while (currentNode.get().getId() != startNode.getId()) {
-        if (currentNode.get().getRoadToPredecessor() == nullptr) {
+    while (currentNode.get().getGraphNode() != startGraphNode) {
+        if (currentNode.get().getEdgeToPredecessor() == nullptr) {
             std::cerr << "Solver: ERROR - Node hast no road to predecessor.\n";
             break;
         }
 
-        solution.push_back(*currentNode.get().getRoadToPredecessor());
+        // the roads of an edge are stored from the predecessor to the node
+        const RoadRange roads = graph->getRoads(*currentNode.get().getEdgeToPredecessor());
+        for (std::size_t index = roads.size(); index > 0; index--) {
+            solution.push_back(roads[index - 1]);
+        }
 
         if (currentNode.get().getPredecessor() == nullptr) {
             std::cerr << "Solver: ERROR - Node hat no predecessor.\n";
@@ -193,8 +266,8 @@ std::vector<std::reference_wrapper<const Road>> Solver::getSolution() const {
 void Solver::printOpenList() {
     std::cout << "\nOpen List (" << openList.size() << "):\n";
     for (const PathNode& node : openList) {
-        //std::cout << node.getId() << " - " << node.getScore() << '\n';
-        std::cout << node.getId() << " - traveled: " << node.getDistanceTraveled() << " - distance: " << node.getDistanceToTarget() << '\n';
+        //std::cout << node.getIntersection().getId() << " - " << node.getScore() << '\n';
+        std::cout << node.getIntersection().getId() << " - traveled: " << node.getDistanceTraveled() << " - distance: " << node.getDistanceToTarget() << '\n';
     }
     std::cout << '\n';
 }
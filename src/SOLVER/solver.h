@@ -1,33 +1,56 @@
 #pragma once
 
 #include "MAP/map.h"
+#include "routinggraph.h"
 
 #include <limits>
+#include <map>
+#include <memory>
 
 namespace AStarCities {
 
+    /*
+     * A* search on the routing graph of a map. The graph can be shared by the
+     * solvers of the same map version. A start or end inside a contracted
+     * chain gets an additional node, the edges of its chain are split there
+     * for this search only.
+     *
+     * The search references the roads and intersections of the map version it
+     * was created for. Once the map changes the solver is outdated and does
+     * not take any more steps.
+     */
     class Solver {
 
         public:
 
-            Solver(std::shared_ptr<Map> map, const Intersection& startNode, const Intersection& endNode);
+            // builds the routing graph of the map
+            Solver(std::shared_ptr<const Map> map, const Intersection& startNode, const Intersection& endNode);
+
+            // the graph is built again if it is outdated
+            Solver(std::shared_ptr<const Map> map, std::shared_ptr<const RoutingGraph> graph, const Intersection& startNode, const Intersection& endNode);
 
             virtual ~Solver() = default;
 
-            static std::pair<const Intersection&, const Intersection&> selectStartAndEndIntersection(std::shared_ptr<Map> map);
+            static std::pair<const Intersection&, const Intersection&> selectStartAndEndIntersection(std::shared_ptr<const Map> map);
 
             const Intersection& getStart() const { return startNode; }
             const Intersection& getEnd()   const { return endNode; }
 
             void doStep(bool doSubSteps = true);
-            Road const* doSubStep();
+
+            // roads of the expanded edge, empty if no edge has been expanded
+            RoadRange doSubStep();
 
             [[nodiscard]] bool isDone() const { return solved; }
 
+            [[nodiscard]] bool isOutdated() const { return map->getVersion() != mapVersion; }
+
             [[nodiscard]] std::vector<std::reference_wrapper<const Road>> getSolution() const;
 
             [[nodiscard]] std::size_t getOpenListSize() const { return openList.size(); }
 
+            [[nodiscard]] std::shared_ptr<const RoutingGraph> getRoutingGraph() const { return graph; }
+
             void printOpenList();
 
             [[nodiscard]] std::vector<std::reference_wrapper<const Intersection>> getOpenListIntersections() const;
@@ -38,8 +61,8 @@ namespace AStarCities {
 
                 public:
 
-                    PathNode(const Intersection& inter) :
-                        intersection(inter) {}
+                    PathNode(const Intersection& inter, uint32_t graphNode) :
+                        intersection(inter), graphNode(graphNode) {}
 
                     virtual ~PathNode() = default;
 
@@ -53,10 +76,9 @@ namespace AStarCities {
                         }
                     }
 
-                    [[nodiscard]] uint64_t getId() const { return intersection.getId(); }
-
                     [[nodiscard]] const Intersection& getIntersection() const { return intersection; }
-                    [[nodiscard]] Road const* getRoadToPredecessor() const { return roadToPrev; }
+                    [[nodiscard]] uint32_t getGraphNode() const { return graphNode; }
+                    [[nodiscard]] RoutingGraph::Edge const* getEdgeToPredecessor() const { return edgeToPrev; }
                     [[nodiscard]] PathNode const* getPredecessor() const { return prevNode; }
 
                     [[nodiscard]] double getDistanceToTarget() const { return distanceToTarget; }
@@ -67,44 +89,61 @@ namespace AStarCities {
                     void setDistanceToTarget(double distance) { distanceToTarget = distance; }
                     void setDistanceTraveled(double distance) { distanceTraveled = distance; }
 
-                    void setPredecessor(const PathNode& prev, const Road& road) {
+                    // the edge leads from the predecessor to this node
+                    void setPredecessor(const PathNode& prev, const RoutingGraph::Edge& edge) {
                         prevNode = &prev;
-                        roadToPrev = &road;
+                        edgeToPrev = &edge;
                     }
 
-                    [[nodiscard]] std::vector<Intersection::Connection> getConnections() const { return intersection.getConnections(); }
-
                 private:
 
                     const Intersection& intersection;
+                    uint32_t graphNode;
                     PathNode const* prevNode = nullptr;
-                    Road const* roadToPrev = nullptr;
+                    RoutingGraph::Edge const* edgeToPrev = nullptr;
 
                     double distanceTraveled = std::numeric_limits<double>::max();
                     double distanceToTarget = std::numeric_limits<double>::max();
             };
 
-            static const Intersection& selectRandomIntersection(std::shared_ptr<Map> map);
+            static const Intersection& selectRandomIntersection(std::shared_ptr<const Map> map);
 
             void init();
 
-            void doSubStep(const PathNode& currentNode, const Intersection::Connection& connection);
+            // the graph node of the intersection, the chain of a contracted intersection is split
+            [[nodiscard]] uint32_t addQueryNode(const Intersection& intersection);
+            void addQueryEdge(uint32_t node, const RoutingGraph::Edge& edge);
 
-            std::shared_ptr<Map> map;
+            [[nodiscard]] std::span<const RoutingGraph::Edge> getEdges(uint32_t node) const;
 
-            std::map<uint64_t, PathNode> nodes;
+            void doSubStep(const PathNode& currentNode, const RoutingGraph::Edge& edge);
+
+            std::shared_ptr<const Map> map;
+            uint64_t mapVersion;
+
+            std::shared_ptr<const RoutingGraph> graph;
+
+            // graph node -> edges, for the nodes whose edges are changed by this search
+            std::map<uint32_t, std::vector<RoutingGraph::Edge>> queryEdges;
+
+            // graph node -> path node, followed by the nodes added for this search
+            std::vector<PathNode> nodes;
 
             using PriorityQueue = std::set<std::reference_wrapper<PathNode>, std::less<PathNode>>;
 
             PriorityQueue openList;
-            std::set<std::reference_wrapper<PathNode>, std::less<PathNode>> closedList;
+            // graph node -> expanded
+            std::vector<bool> closedList;
 
             const Intersection& startNode;
             const Intersection& endNode;
 
+            uint32_t startGraphNode = RoutingGraph::NO_NODE;
+            uint32_t endGraphNode = RoutingGraph::NO_NODE;
+
             PathNode* currentNode = nullptr;
-            std::vector<Intersection::Connection> currentConnections;
-            std::vector<Intersection::Connection>::iterator currentConnectionIterator;
+            std::span<const RoutingGraph::Edge> currentEdges;
+            std::span<const RoutingGraph::Edge>::iterator currentEdgeIterator;
 
             bool solved = false;
 